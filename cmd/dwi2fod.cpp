@@ -14,10 +14,13 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <atomic>
+
 #include "command.h"
 #include "header.h"
 #include "image.h"
 #include "phase_encoding.h"
+#include "timer.h"
 #include "algo/threaded_loop.h"
 #include "dwi/gradient.h"
 #include "dwi/shells.h"
@@ -119,113 +122,158 @@ void usage ()
 
 class CSD_Processor { MEMALIGN(CSD_Processor)
   public:
-    CSD_Processor (const DWI::SDeconv::CSD::Shared& shared, Image<bool>& mask) :
+    CSD_Processor (const DWI::SDeconv::CSD::Shared& shared, Image<float>& dwi, Image<float>& fod, Image<bool>& mask, size_t axis) :
       sdeconv (shared),
-      data (shared.dwis.size()),
-      mask (mask) { }
-
-
-    void operator () (Image<float>& dwi, Image<float>& fod) {
-      if (!load_data (dwi)) {
-        for (auto l = Loop (3) (fod); l; ++l)
-          fod.value() = 0.0;
-        return;
+      dwi (dwi),
+      fod (fod),
+      mask (mask),
+      axis (axis),
+      data (shared.dwis.size(), dwi.size (axis)) { }
+
+
+    // Process all voxels along the inner axis as a single batch
+    void operator () (const Iterator& pos) {
+      assign_pos_of (pos).to (dwi, fod);
+      voxels.clear();
+      for (auto l = Loop (axis) (dwi, fod); l; ++l) {
+        if (load_data (data.col (voxels.size())))
+          voxels.push_back (dwi.index (axis));
+        else
+          for (auto l2 = Loop (3) (fod); l2; ++l2)
+            fod.value() = 0.0;
       }
+      if (voxels.empty())
+        return;
 
-      sdeconv.set (data);
+      sdeconv.set (data.leftCols (voxels.size()));
 
       size_t n;
       for (n = 0; n < sdeconv.shared.niter; n++)
         if (sdeconv.iterate())
           break;
 
-      if (sdeconv.shared.niter && n >= sdeconv.shared.niter)
-        INFO ("voxel [ " + str (dwi.index(0)) + " " + str (dwi.index(1)) + " " + str (dwi.index(2)) +
-            " ] did not reach full convergence");
-
-      fod.row(3) = sdeconv.FOD();
+      for (size_t i = 0; i < voxels.size(); ++i) {
+        fod.index (axis) = voxels[i];
+        if (sdeconv.shared.niter && !sdeconv.converged (i))
+          INFO ("voxel [ " + str (fod.index(0)) + " " + str (fod.index(1)) + " " + str (fod.index(2)) +
+              " ] did not reach full convergence");
+        fod.row(3) = sdeconv.FOD().col (i);
+      }
     }
 
 
   private:
     DWI::SDeconv::CSD sdeconv;
-    Eigen::VectorXd data;
+    Image<float> dwi, fod;
     Image<bool> mask;
+    const size_t axis;
+    Eigen::MatrixXd data;
+    vector<ssize_t> voxels;
+
+
+    template <class VectorType>
+      bool load_data (VectorType&& voxel_data) {
+        if (mask.valid()) {
+          assign_pos_of (dwi, 0, 3).to (mask);
+          if (!mask.value())
+            return false;
+        }
+
+        for (size_t n = 0; n < sdeconv.shared.dwis.size(); n++) {
+          dwi.index(3) = sdeconv.shared.dwis[n];
+          voxel_data[n] = dwi.value();
+          if (!std::isfinite (voxel_data[n]))
+            return false;
+          if (voxel_data[n] < 0.0)
+            voxel_data[n] = 0.0;
+        }
+
+        return true;
+      }
 
 
-    bool load_data (Image<float>& dwi) {
-      if (mask.valid()) {
-        assign_pos_of (dwi, 0, 3).to (mask);
-        if (!mask.value())
-          return false;
-      }
+};
 
-      for (size_t n = 0; n < sdeconv.shared.dwis.size(); n++) {
-        dwi.index(3) = sdeconv.shared.dwis[n];
-        data[n] = dwi.value();
-        if (!std::isfinite (data[n]))
-          return false;
-        if (data[n] < 0.0)
-          data[n] = 0.0;
-      }
 
-      return true;
-    }
 
 
+// Totals across all processing threads
+class MSMT_Statistics { NOMEMALIGN
+  public:
+    MSMT_Statistics () : voxels (0), iterations (0) { }
+    std::atomic<size_t> voxels, iterations;
 };
 
 
 
-
 class MSMT_Processor { MEMALIGN (MSMT_Processor)
   public:
-    MSMT_Processor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<bool>& mask_image,
-      vector< Image<float> > odf_images, Image<float> dwi_modelled = Image<float>()) :
+    MSMT_Processor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<float>& dwi_image, Image<bool>& mask_image,
+      vector< Image<float> > odf_images, size_t axis, MSMT_Statistics& statistics, Image<float> dwi_modelled = Image<float>()) :
         sdeconv (shared),
+        dwi_image (dwi_image),
         mask_image (mask_image),
         odf_images (odf_images),
         modelled_image (dwi_modelled),
+        axis (axis),
+        statistics (statistics),
         dwi_data (shared.grad.rows()),
         output_data (shared.problem.H.cols()) { }
 
 
-    void operator() (Image<float>& dwi_image)
+    // Voxels along the inner axis are processed in order, each starting from
+    //   the active constraints at the solution of its predecessor
+    void operator() (const Iterator& pos)
     {
-      if (mask_image.valid()) {
-        assign_pos_of (dwi_image, 0, 3).to (mask_image);
-        if (!mask_image.value())
-          return;
-      }
-
-      dwi_data = dwi_image.row(3);
-
-      sdeconv (dwi_data, output_data);
-      if (sdeconv.niter >= sdeconv.shared.problem.max_niter) {
-        INFO ("voxel [ " + str (dwi_image.index(0)) + " " + str (dwi_image.index(1)) + " " + str (dwi_image.index(2)) +
-            " ] did not reach full convergence");
-      }
-
-      size_t j = 0;
-      for (size_t i = 0; i < odf_images.size(); ++i) {
-        assign_pos_of (dwi_image, 0, 3).to (odf_images[i]);
-        for (auto l = Loop(3)(odf_images[i]); l; ++l)
-          odf_images[i].value() = output_data[j++];
-      }
-
-      if (modelled_image.valid()) {
-        assign_pos_of (dwi_image, 0, 3).to (modelled_image);
-        dwi_data = sdeconv.shared.problem.H * output_data;
-        modelled_image.row(3) = dwi_data;
+      assign_pos_of (pos).to (dwi_image);
+      bool warm_start = false;
+      size_t voxels = 0, niter = 0;
+      for (auto l = Loop (axis) (dwi_image); l; ++l) {
+        if (mask_image.valid()) {
+          assign_pos_of (dwi_image, 0, 3).to (mask_image);
+          if (!mask_image.value()) {
+            warm_start = false;
+            continue;
+          }
+        }
+
+        dwi_data = dwi_image.row(3);
+
+        sdeconv (dwi_data, output_data, warm_start);
+        warm_start = output_data.allFinite();
+        ++voxels;
+        niter += sdeconv.niter;
+        if (sdeconv.niter >= sdeconv.shared.problem.max_niter) {
+          INFO ("voxel [ " + str (dwi_image.index(0)) + " " + str (dwi_image.index(1)) + " " + str (dwi_image.index(2)) +
+              " ] did not reach full convergence");
+        }
+
+        size_t j = 0;
+        for (size_t i = 0; i < odf_images.size(); ++i) {
+          assign_pos_of (dwi_image, 0, 3).to (odf_images[i]);
+          for (auto l = Loop(3)(odf_images[i]); l; ++l)
+            odf_images[i].value() = output_data[j++];
+        }
+
+        if (modelled_image.valid()) {
+          assign_pos_of (dwi_image, 0, 3).to (modelled_image);
+          dwi_data = sdeconv.shared.problem.H * output_data;
+          modelled_image.row(3) = dwi_data;
+        }
       }
+      statistics.voxels += voxels;
+      statistics.iterations += niter;
     }
 
 
   private:
     DWI::SDeconv::MSMT_CSD sdeconv;
+    Image<float> dwi_image;
     Image<bool> mask_image;
     vector< Image<float> > odf_images;
     Image<float> modelled_image;
+    const size_t axis;
+    MSMT_Statistics& statistics;
     Eigen::VectorXd dwi_data;
     Eigen::VectorXd output_data;
 };
@@ -275,10 +323,11 @@ void run ()
     header_out.size(3) = shared.nSH();
     auto fod = Image<float>::create (argument[3], header_out);
 
-    CSD_Processor processor (shared, mask);
     auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3)
-        .run (processor, dwi, fod);
+    auto loop = ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3);
+    CSD_Processor processor (shared, dwi, fod, mask, loop.inner_axes[0]);
+    loop.schedule (ThreadedLoopSchedule::WORK_STEALING)
+        .run_outer (processor);
 
   } else if (algorithm == 1) {
 
@@ -317,13 +366,18 @@ void run ()
     if (opt.size())
       dwi_modelled = Image<float>::create (opt[0][0], header_in);
 
-    MSMT_Processor processor (shared, mask, odfs, dwi_modelled);
     auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing MSMT CSD ("
-                  + str(shared.num_shells()) + " shell" + (shared.num_shells() > 1 ? "s" : "") + ", "
-                  + str(num_tissues) + " tissue" + (num_tissues > 1 ? "s" : "") + ")",
-                  dwi, 0, 3)
-        .run (processor, dwi);
+    auto loop = ThreadedLoop ("performing MSMT CSD ("
+                              + str(shared.num_shells()) + " shell" + (shared.num_shells() > 1 ? "s" : "") + ", "
+                              + str(num_tissues) + " tissue" + (num_tissues > 1 ? "s" : "") + ")",
+                              dwi, 0, 3);
+    MSMT_Statistics statistics;
+    MSMT_Processor processor (shared, dwi, mask, odfs, loop.inner_axes[0], statistics, dwi_modelled);
+    Timer timer;
+    loop.schedule (ThreadedLoopSchedule::WORK_STEALING)
+        .run_outer (processor);
+    INFO ("MSMT CSD of " + str(statistics.voxels.load()) + " voxels completed in " + str(timer.elapsed(), 4) + " seconds, "
+          + "mean of " + str(statistics.iterations.load() / std::max (default_type(statistics.voxels.load()), 1.0), 4) + " iterations per voxel");
 
   } else {
     assert (0);
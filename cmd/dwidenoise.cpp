@@ -255,7 +255,9 @@ void process_image (Header& data, Image<bool>& mask, Image<real_type> noise,
     auto output = Image<T>::create (output_name, header);
     // run
     DenoisingFunctor<T> func (data.size(3), extent, mask, noise, exp1);
-    ThreadedLoop ("running MP-PCA denoising", data, 0, 3).run (func, input, output);
+    ThreadedLoop ("running MP-PCA denoising", data, 0, 3)
+      .schedule (ThreadedLoopSchedule::WORK_STEALING)
+      .run (func, input, output);
   }
 
 
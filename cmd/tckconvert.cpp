@@ -684,7 +684,7 @@ void run ()
   // Reader
   Properties properties;
   std::unique_ptr<ReaderInterface<float> > reader;
-  if (Path::has_suffix(argument[0], ".tck")) {
+  if (Path::is_track_file (argument[0])) {
     reader.reset( new Reader<float>(argument[0], properties) );
   }
   else if (Path::has_suffix(argument[0], ".txt")) {
@@ -700,7 +700,7 @@ void run ()
 
   // Writer
   std::unique_ptr<WriterInterface<float> > writer;
-  if (Path::has_suffix(argument[1], ".tck")) {
+  if (Path::is_track_file (argument[1])) {
     writer.reset( new Writer<float>(argument[1], properties) );
   }
   else if (Path::has_suffix(argument[1], ".vtk")) {
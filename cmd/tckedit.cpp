@@ -217,6 +217,21 @@ void run ()
   Worker worker (properties, inverse, ends_only);
   Receiver receiver (output_path, properties, number, skip);
 
+  // If no streamline can be rejected or split by the worker, and a valid
+  //   sidecar index is available for the input, the streamlines to be skipped
+  //   can be bypassed entirely, rather than being read from file only to be
+  //   discarded by the receiver
+  if (skip && num_inputs == 1 && !inverse &&
+      !properties.include.size() && !properties.exclude.size() && !properties.mask.size() &&
+      properties.find ("min_dist") == properties.end() && properties.find ("max_dist") == properties.end() &&
+      properties.find ("min_weight") == properties.end() && properties.find ("max_weight") == properties.end() &&
+      loader.can_seek()) {
+    size_t num_empty;
+    const size_t num_skipped = loader.seek (skip, num_empty);
+    receiver.skipped (num_skipped, num_empty);
+    DEBUG ("skipped " + str(num_skipped) + " streamlines using track file index");
+  }
+
   Thread::run_ordered_queue (
       loader,
       Thread::batch (Streamline<>()),
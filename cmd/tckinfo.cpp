@@ -73,7 +73,7 @@ void run ()
 
 
     if (actual_count) {
-      Tractography::Streamline<float> tck;
+      Tractography::StreamlineView<float> tck;
       size_t count = 0;
       {
         ProgressBar progress ("counting tracks in file");
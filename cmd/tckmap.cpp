@@ -148,7 +148,13 @@ const OptionGroup MappingOption = OptionGroup ("Options for the streamline-to-vo
       "(these lengths are then taken into account during TWI calculation)")
 
   + Option ("ends_only",
-      "only map the streamline endpoints to the image");
+      "only map the streamline endpoints to the image")
+
+  + Option ("thread_buffers",
+      "accumulate the output image separately within each processing thread, combining these "
+      "once all streamlines have been mapped; this removes the bottleneck of a single thread "
+      "writing to the output image when mapping very large numbers of streamlines, at the expense "
+      "of one additional copy of the output image in memory per thread");
 
 
 
@@ -248,6 +254,15 @@ MapWriterBase* make_writer (Header& H, const std::string& name, const vox_stat_t
 
 
 
+template <class MapperType, class SetType>
+void run_thread_local (TrackLoader& loader, const MapperType& mapper, MapWriterBase& writer)
+{
+  MapAccumulator<MapperType, SetType> accumulator (mapper, writer);
+  Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (accumulator));
+}
+
+
+
 DataType determine_datatype (const DataType current_dt, const contrast_t contrast, const DataType default_dt, const bool precise)
 {
   if (current_dt == DataType::Undefined) {
@@ -602,18 +617,38 @@ void run () {
     case TOD:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, TOD));       break;
   }
 
+  const bool thread_buffers = get_options ("thread_buffers").size();
+
   // Finally get to do some number crunching!
   // Complete branch here for Gaussian track-wise statistic; it's a nightmare to manage, so am
   //   keeping the code as separate as possible
   if (stat_tck == GAUSSIAN) {
     Gaussian::TrackMapper* const mapper_ptr = dynamic_cast<Gaussian::TrackMapper*>(mapper.get());
     mapper_ptr->set_gaussian_FWHM (gaussian_fwhm_tck);
+    if (thread_buffers) {
+      switch (writer_type) {
+        case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+        case GREYSCALE: run_thread_local<Gaussian::TrackMapper, Gaussian::SetVoxel>    (loader, *mapper_ptr, *writer); break;
+        case DEC:       run_thread_local<Gaussian::TrackMapper, Gaussian::SetVoxelDEC> (loader, *mapper_ptr, *writer); break;
+        case DIXEL:     run_thread_local<Gaussian::TrackMapper, Gaussian::SetDixel>    (loader, *mapper_ptr, *writer); break;
+        case TOD:       run_thread_local<Gaussian::TrackMapper, Gaussian::SetVoxelTOD> (loader, *mapper_ptr, *writer); break;
+      }
+    } else {
+      switch (writer_type) {
+        case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+        case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxel()),    *writer); break;
+        case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelDEC()), *writer); break;
+        case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetDixel()),    *writer); break;
+        case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelTOD()), *writer); break;
+      }
+    }
+  } else if (thread_buffers) {
     switch (writer_type) {
       case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
-      case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxel()),    *writer); break;
-      case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelDEC()), *writer); break;
-      case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetDixel()),    *writer); break;
-      case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelTOD()), *writer); break;
+      case GREYSCALE: run_thread_local<TrackMapperTWI, SetVoxel>    (loader, *mapper, *writer); break;
+      case DEC:       run_thread_local<TrackMapperTWI, SetVoxelDEC> (loader, *mapper, *writer); break;
+      case DIXEL:     run_thread_local<TrackMapperTWI, SetDixel>    (loader, *mapper, *writer); break;
+      case TOD:       run_thread_local<TrackMapperTWI, SetVoxelTOD> (loader, *mapper, *writer); break;
     }
   } else {
     switch (writer_type) {
@@ -139,6 +139,12 @@ void usage ()
   + Option ("out_coeffs", "output text file containing the weighting coefficient for each streamline")
     + Argument ("path").type_file_out()
 
+  + Option ("max_memory", "limit the RAM used to hold the streamline-fixel contributions to this many megabytes; "
+                          "any in excess of this are written to a temporary file (see TmpFileDir), which is memory-mapped and read ahead "
+                          "during each iteration. This permits processing of tractograms whose contributions would not otherwise fit in RAM, "
+                          "at the cost of additional execution time")
+    + Argument ("MB").type_float (0.0)
+
   + SIFT2RegularisationOption
   + SIFT2AlgorithmOption;
 
@@ -155,7 +161,7 @@ void run ()
   if (get_options("max_factor").size() && get_options("max_coeff").size())
     throw Exception ("Options -max_factor and -max_coeff are mutually exclusive");
 
-  if (Path::has_suffix (argument[2], ".tck"))
+  if (Path::is_track_file (argument[2]))
     throw Exception ("Output of tcksift2 command should be a text file, not a tracks file");
 
   auto in_dwi = Image<float>::open (argument[1]);
@@ -172,6 +178,10 @@ void run ()
   tckfactor.perform_FOD_segmentation (in_dwi);
   tckfactor.scale_FDs_by_GM();
 
+  auto opt = get_options ("max_memory");
+  if (opt.size())
+    tckfactor.set_contribution_memory_budget (size_t (float(opt[0][0]) * 1024.0 * 1024.0));
+
   tckfactor.map_streamlines (argument[0]);
 
   tckfactor.store_orig_TDs();
@@ -227,7 +237,7 @@ void run ()
 
   tckfactor.output_factors (argument[2]);
 
-  auto opt = get_options ("out_coeffs");
+  opt = get_options ("out_coeffs");
   if (opt.size())
     tckfactor.output_coefficients (opt[0][0]);
 
@@ -132,7 +132,7 @@ void run ()
       dump.reset (new File::OFStream (std::string(opt[0][0]), std::ios_base::out | std::ios_base::trunc));
 
     ProgressBar progress ("Reading track file", header_count);
-    Streamline<> tck;
+    StreamlineView<> tck;
     while (reader (tck)) {
       ++count;
       const float length = Tractography::length (tck);
@@ -17,6 +17,8 @@
 #ifndef __algo_threaded_loop_h__
 #define __algo_threaded_loop_h__
 
+#include <atomic>
+
 #include "debug.h"
 #include "algo/loop.h"
 #include "algo/iterator.h"
@@ -231,6 +233,27 @@ namespace MR
    * invocation - the functor will need to then implement looping over the
    * inner axes from the position provided in the `Iterator`.
    *
+   * \section threaded_loop_schedule Load balancing
+   *
+   * By default, each thread obtains its next position from a single shared
+   * outer loop, locking a common mutex each time. This is adequate when each
+   * outer position involves a similar amount of work, but can lead to threads
+   * contending for the lock and idling towards the end of the loop when the
+   * cost is very uneven (for example, when most slices fall outside a brain
+   * mask). In such cases, a work-stealing scheduler can be requested for that
+   * call using the schedule() method:
+   *
+   * ~~~{.cpp}
+   * ThreadedLoop ("processing", vox, 0, 3)
+   *   .schedule (ThreadedLoopSchedule::WORK_STEALING)
+   *   .run (MyFunction(), vox);
+   * ~~~
+   *
+   * With this scheduler, the outer positions are initially split evenly
+   * across threads; each thread then processes its own range in chunks that
+   * shrink as its range is depleted, and steals half of the remaining range
+   * of another thread once its own is exhausted.
+   *
    * \sa Loop
    * \sa Thread::run()
    * \sa thread_queue
@@ -240,6 +263,12 @@ namespace MR
 
 
 
+  //! the strategy used to distribute outer positions across threads
+  /*! \sa threaded_loop_schedule */
+  enum class ThreadedLoopSchedule { SHARED, WORK_STEALING };
+
+
+
   namespace {
 
     inline vector<size_t> get_inner_axes (const vector<size_t>& axes, size_t num_inner_axes) {
@@ -312,12 +341,67 @@ namespace MR
         loop->progress.run_update_thread (*threads);
       }
 
+      inline void __increment_progress (...) { }
+      template <class LoopType>
+        inline auto __increment_progress (LoopType* loop, size_t count)
+        -> decltype((void) (&loop->progress), void())
+      {
+        while (count--)
+          ++loop->progress;
+      }
+
+
+
+    // per-thread range of linear outer loop indices, stolen from by other
+    // threads once their own range is exhausted:
+    struct ThreadedLoopWorkRange { NOMEMALIGN
+      std::mutex mutex;
+      size_t begin, end;
+
+      // take the next chunk from the front; chunks shrink as the range is
+      // depleted, so that little work remains to be balanced at the end:
+      bool pop (size_t& chunk_begin, size_t& chunk_end) {
+        std::lock_guard<std::mutex> lock (mutex);
+        if (begin >= end)
+          return false;
+        chunk_begin = begin;
+        begin += std::max<size_t> (1, (end - begin) / 4);
+        chunk_end = begin;
+        return true;
+      }
+
+      // remove the back half of the remaining range:
+      bool steal (size_t& range_begin, size_t& range_end) {
+        std::lock_guard<std::mutex> lock (mutex);
+        if (begin >= end)
+          return false;
+        range_end = end;
+        end -= (end - begin + 1) / 2;
+        range_begin = end;
+        return true;
+      }
+
+      void assign (size_t range_begin, size_t range_end) {
+        std::lock_guard<std::mutex> lock (mutex);
+        begin = range_begin;
+        end = range_end;
+      }
+    };
+
 
     template <class OuterLoopType>
       struct ThreadedLoopRunOuter { MEMALIGN(ThreadedLoopRunOuter<OuterLoopType>)
         Iterator iterator;
         OuterLoopType outer_loop;
         vector<size_t> inner_axes;
+        ThreadedLoopSchedule scheduler;
+
+        //! select the strategy used to distribute outer positions across threads
+        /*! \sa threaded_loop_schedule */
+        ThreadedLoopRunOuter& schedule (ThreadedLoopSchedule type) {
+          scheduler = type;
+          return *this;
+        }
 
         //! invoke \a functor (const Iterator& pos) per voxel <em> in the outer axes only</em>
         template <class Functor>
@@ -329,6 +413,11 @@ namespace MR
               return;
             }
 
+            if (scheduler == ThreadedLoopSchedule::WORK_STEALING) {
+              run_outer_work_stealing (functor);
+              return;
+            }
+
             std::mutex mutex;
             ProgressBar::SwitchToMultiThreaded progress_functions;
 
@@ -365,6 +454,89 @@ namespace MR
 
 
 
+        template <class Functor>
+          void run_outer_work_stealing (Functor& functor)
+          {
+            const size_t num_threads = Thread::threads_to_execute();
+            ProgressBar::SwitchToMultiThreaded progress_functions;
+
+            struct Shared { MEMALIGN(Shared)
+              Iterator& iterator;
+              decltype (outer_loop (iterator)) loop;
+              const vector<size_t>& axes;
+              size_t total;
+              vector<std::unique_ptr<ThreadedLoopWorkRange>> ranges;
+              std::atomic<size_t> next_thread_ID;
+              std::mutex progress_mutex;
+
+              void set_pos (Iterator& pos, size_t index) const {
+                for (auto axis : axes) {
+                  pos.index (axis) = index % pos.size (axis);
+                  index /= pos.size (axis);
+                }
+              }
+
+              FORCE_INLINE void inc_pos (Iterator& pos) const {
+                for (auto axis : axes) {
+                  if (++pos.index (axis) < pos.size (axis))
+                    return;
+                  pos.index (axis) = 0;
+                }
+              }
+
+              bool steal (size_t thief) {
+                size_t range_begin, range_end;
+                for (size_t n = 1; n < ranges.size(); ++n) {
+                  if (ranges[(thief+n) % ranges.size()]->steal (range_begin, range_end)) {
+                    ranges[thief]->assign (range_begin, range_end);
+                    return true;
+                  }
+                }
+                return false;
+              }
+
+              void done (size_t count) {
+                std::lock_guard<std::mutex> lock (progress_mutex);
+                __increment_progress (&loop, count);
+              }
+            } shared = { iterator, outer_loop (iterator), outer_loop.axes, 1, { }, { 0 }, { } };
+
+            for (auto axis : shared.axes)
+              shared.total *= iterator.size (axis);
+            for (size_t n = 0; n < num_threads; ++n) {
+              shared.ranges.push_back (std::unique_ptr<ThreadedLoopWorkRange> (new ThreadedLoopWorkRange));
+              shared.ranges.back()->begin = (n * shared.total) / num_threads;
+              shared.ranges.back()->end = ((n+1) * shared.total) / num_threads;
+            }
+
+            struct PerThread { MEMALIGN(PerThread)
+              Shared& shared;
+              typename std::remove_reference<Functor>::type func;
+              void execute () {
+                const size_t ID = shared.next_thread_ID++;
+                Iterator pos = shared.iterator;
+                size_t chunk_begin, chunk_end;
+                do {
+                  while (shared.ranges[ID]->pop (chunk_begin, chunk_end)) {
+                    shared.set_pos (pos, chunk_begin);
+                    for (size_t n = chunk_begin; n < chunk_end; ++n) {
+                      func (pos);
+                      shared.inc_pos (pos);
+                    }
+                    shared.done (chunk_end - chunk_begin);
+                  }
+                } while (shared.steal (ID));
+              }
+            } loop_thread = { shared, functor };
+
+            auto threads = Thread::run (Thread::multi (loop_thread, num_threads), "loop threads");
+
+            __manage_progress (&shared.loop, &threads);
+            threads.wait();
+          }
+
+
+
         //! invoke \a functor (const Iterator& pos) per voxel <em> in the outer axes only</em>
         template <class Functor, class... ImageType>
           void run (Functor&& functor, ImageType&&... vox)
@@ -0,0 +1,253 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <cstdio>
+#include <fstream>
+
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "file/dicom/index_cache.h"
+
+namespace MR {
+  namespace File {
+    namespace Dicom {
+
+      namespace {
+
+        // the cache is only ever read back on the system that wrote it, so
+        // values are stored in native byte order
+        const std::string cache_magic = "mrtrix DICOM index cache 2\n";
+
+        template <typename ValueType>
+          void write_value (std::ostream& out, ValueType value) {
+            out.write (reinterpret_cast<const char*> (&value), sizeof (ValueType));
+          }
+
+        void write_string (std::ostream& out, const std::string& value) {
+          write_value<uint32_t> (out, value.size());
+          out.write (value.data(), value.size());
+        }
+
+        template <typename ValueType>
+          ValueType read_value (std::istream& in) {
+            ValueType value;
+            in.read (reinterpret_cast<char*> (&value), sizeof (ValueType));
+            if (!in)
+              throw Exception ("unexpected end of file");
+            return value;
+          }
+
+        // sizes are checked against the bytes left in the file, so that a
+        // corrupt cache cannot trigger a huge allocation
+        int64_t bytes_left (std::istream& in, int64_t file_size) {
+          const int64_t pos = in.tellg();
+          return pos < 0 ? 0 : file_size - pos;
+        }
+
+        std::string read_string (std::istream& in, int64_t file_size) {
+          const uint32_t size = read_value<uint32_t> (in);
+          if (size > bytes_left (in, file_size))
+            throw Exception ("invalid string size");
+          std::string value (size, '\0');
+          in.read (&value[0], size);
+          if (!in)
+            throw Exception ("unexpected end of file");
+          return value;
+        }
+
+      }
+
+
+
+      IndexCache::IndexCache () :
+          //CONF option: DICOMIndexCache
+          //CONF default: none (no caching)
+          //CONF The path of a file in which to record the contents of
+          //CONF each DICOM file scanned, keyed by path, modification time
+          //CONF and size, so that subsequent imports of unchanged DICOM
+          //CONF folders need not parse every file again.
+          path (File::Config::get ("DICOMIndexCache")),
+          modified (false)
+      {
+        if (path.size() && Path::exists (path))
+          load();
+      }
+
+
+
+      const IndexCache::Entry* IndexCache::find (const std::string& filename, int64_t mtime, int64_t size) const
+      {
+        const auto entry = entries.find (filename);
+        if (entry == entries.end() || entry->second.mtime != mtime || entry->second.size != size)
+          return nullptr;
+        return &entry->second;
+      }
+
+
+
+      void IndexCache::insert (const std::string& filename, const Entry& entry)
+      {
+        entries[filename] = entry;
+        modified = true;
+      }
+
+
+
+      std::string IndexCache::key (const std::string& filename)
+      {
+        if (filename.size() && filename[0] == PATH_SEPARATORS[0])
+          return filename;
+        return Path::join (Path::cwd(), filename);
+      }
+
+
+
+      bool IndexCache::stat (const std::string& filename, int64_t& mtime, int64_t& size)
+      {
+        struct stat buf;
+        if (::stat (filename.c_str(), &buf))
+          return false;
+        mtime = File::modification_time (buf);
+        size = buf.st_size;
+        return true;
+      }
+
+
+
+      void IndexCache::load ()
+      {
+        std::ifstream in (path, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+        const int64_t file_size = in.tellg();
+        in.seekg (0);
+        try {
+          std::string magic (cache_magic.size(), '\0');
+          in.read (&magic[0], magic.size());
+          if (!in || magic != cache_magic)
+            throw Exception ("unrecognised format");
+
+          // each entry holds at least its name size, times, size and status:
+          constexpr int64_t min_entry_size = sizeof (uint32_t) + 2*sizeof (int64_t) + sizeof (uint8_t);
+          const uint64_t num_entries = read_value<uint64_t> (in);
+          if (num_entries > uint64_t (bytes_left (in, file_size) / min_entry_size))
+            throw Exception ("invalid number of entries");
+          for (uint64_t n = 0; n < num_entries; ++n) {
+            const std::string filename = read_string (in, file_size);
+            Entry entry;
+            entry.mtime = read_value<int64_t> (in);
+            entry.size = read_value<int64_t> (in);
+            entry.status = Status (read_value<uint8_t> (in));
+            QuickScan& scan (entry.scan);
+            scan.filename = filename;
+            if (entry.status == Status::Image) {
+              scan.modality = read_string (in, file_size);
+              scan.patient = read_string (in, file_size);
+              scan.patient_ID = read_string (in, file_size);
+              scan.patient_DOB = read_string (in, file_size);
+              scan.study = read_string (in, file_size);
+              scan.study_ID = read_string (in, file_size);
+              scan.study_date = read_string (in, file_size);
+              scan.study_time = read_string (in, file_size);
+              scan.series = read_string (in, file_size);
+              scan.series_date = read_string (in, file_size);
+              scan.series_time = read_string (in, file_size);
+              scan.sequence = read_string (in, file_size);
+              scan.series_number = read_value<uint64_t> (in);
+              const uint32_t num_image_types = read_value<uint32_t> (in);
+              for (uint32_t i = 0; i < num_image_types; ++i) {
+                const std::string image_type = read_string (in, file_size);
+                scan.image_type[image_type] = read_value<uint64_t> (in);
+              }
+              scan.transfer_syntax_supported = read_value<uint8_t> (in);
+            }
+            entries.insert (std::make_pair (filename, std::move (entry)));
+          }
+          INFO ("loaded " + str(entries.size()) + " entries from DICOM index cache \"" + path + "\"");
+        }
+        catch (Exception& E) {
+          WARN ("error reading DICOM index cache \"" + path + "\" (" + E[0] + ") - ignored");
+          entries.clear();
+        }
+        catch (std::bad_alloc&) {
+          WARN ("error reading DICOM index cache \"" + path + "\" (out of memory) - ignored");
+          entries.clear();
+        }
+      }
+
+
+
+      void IndexCache::save () const
+      {
+        if (!modified)
+          return;
+
+        // write to a temporary file first, so that concurrent imports never
+        // see a partially written cache
+        const std::string temp_path = path + "." + str(getpid()) + ".tmp";
+        {
+          std::ofstream out (temp_path, std::ios_base::out | std::ios_base::binary);
+          out.write (cache_magic.data(), cache_magic.size());
+          write_value<uint64_t> (out, entries.size());
+          for (const auto& entry : entries) {
+            write_string (out, entry.first);
+            write_value<int64_t> (out, entry.second.mtime);
+            write_value<int64_t> (out, entry.second.size);
+            write_value<uint8_t> (out, uint8_t (entry.second.status));
+            const QuickScan& scan (entry.second.scan);
+            if (entry.second.status == Status::Image) {
+              write_string (out, scan.modality);
+              write_string (out, scan.patient);
+              write_string (out, scan.patient_ID);
+              write_string (out, scan.patient_DOB);
+              write_string (out, scan.study);
+              write_string (out, scan.study_ID);
+              write_string (out, scan.study_date);
+              write_string (out, scan.study_time);
+              write_string (out, scan.series);
+              write_string (out, scan.series_date);
+              write_string (out, scan.series_time);
+              write_string (out, scan.sequence);
+              write_value<uint64_t> (out, scan.series_number);
+              write_value<uint32_t> (out, scan.image_type.size());
+              for (const auto& image_type : scan.image_type) {
+                write_string (out, image_type.first);
+                write_value<uint64_t> (out, image_type.second);
+              }
+              write_value<uint8_t> (out, scan.transfer_syntax_supported);
+            }
+          }
+          if (!out) {
+            WARN ("error writing DICOM index cache \"" + path + "\" - cache not updated");
+            std::remove (temp_path.c_str());
+            return;
+          }
+        }
+
+#ifdef MRTRIX_WINDOWS
+        std::remove (path.c_str());
+#endif
+        if (std::rename (temp_path.c_str(), path.c_str())) {
+          WARN ("error writing DICOM index cache \"" + path + "\": " + strerror (errno) + " - cache not updated");
+          std::remove (temp_path.c_str());
+          return;
+        }
+        INFO ("saved " + str(entries.size()) + " entries to DICOM index cache \"" + path + "\"");
+      }
+
+    }
+  }
+}
+
@@ -0,0 +1,85 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __file_dicom_index_cache_h__
+#define __file_dicom_index_cache_h__
+
+#include <map>
+
+#include "file/dicom/quick_scan.h"
+
+namespace MR {
+  namespace File {
+    namespace Dicom {
+
+      //! A persistent record of the outcome of scanning individual DICOM files
+      /*! Entries are keyed by the absolute path of each file, and are only
+       * considered valid if the modification time and size of the file are
+       * unchanged since it was scanned (the modification time is compared
+       * to the nanosecond where the filesystem supports it), so that
+       * re-scanning an unchanged archive requires no DICOM parsing at all.
+       * The cache is stored in the file given by the DICOMIndexCache config
+       * file entry, and is disabled if that entry is not set.
+       *
+       * The outcome is recorded for every file that was scanned to
+       * completion, including files that are not DICOM (Status::Unreadable)
+       * or contain no image data (Status::NoImage), so that these are also
+       * skipped next time. Only files whose scan raised an exception (e.g.
+       * due to a read failure) are left out, and are scanned again next
+       * time. */
+      class IndexCache { NOMEMALIGN
+        public:
+          enum class Status : uint8_t { Unreadable, NoImage, Image };
+
+          class Entry { NOMEMALIGN
+            public:
+              //! modification time in nanoseconds, and size in bytes
+              int64_t mtime, size;
+              Status status;
+              QuickScan scan;
+          };
+
+          IndexCache ();
+
+          bool enabled () const { return path.size(); }
+
+          //! the entry for \a filename, or nullptr if absent or out of date
+          const Entry* find (const std::string& filename, int64_t mtime, int64_t size) const;
+          void insert (const std::string& filename, const Entry& entry);
+
+          //! write the cache back to file, if any entries have changed
+          void save () const;
+
+          //! the key used for \a filename, i.e. its absolute path
+          static std::string key (const std::string& filename);
+          //! obtain the modification time (in nanoseconds) and size of \a filename
+          static bool stat (const std::string& filename, int64_t& mtime, int64_t& size);
+
+        protected:
+          std::string path;
+          std::map<std::string, Entry> entries;
+          bool modified;
+
+          void load ();
+      };
+
+    }
+  }
+}
+
+#endif
+
+
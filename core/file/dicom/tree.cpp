@@ -14,8 +14,10 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include "thread_queue.h"
 #include "file/path.h"
 #include "file/dicom/element.h"
+#include "file/dicom/index_cache.h"
 #include "file/dicom/quick_scan.h"
 #include "file/dicom/image.h"
 #include "file/dicom/series.h"
@@ -54,7 +56,82 @@ namespace MR {
 
 
 
-      void Tree::read_dir (const std::string& filename, ProgressBar& progress)
+      namespace {
+
+        IndexCache::Status scan_file (const std::string& filename, QuickScan& reader)
+        {
+          if (reader.read (filename))
+            return IndexCache::Status::Unreadable;
+          if (! (reader.dim[0] && reader.dim[1] && reader.bits_alloc && reader.data))
+            return IndexCache::Status::NoImage;
+          return IndexCache::Status::Image;
+        }
+
+        void report_ignored (const std::string& filename, IndexCache::Status status)
+        {
+          if (status == IndexCache::Status::Unreadable) {
+            INFO ("error reading file \"" + filename + "\" - ignored");
+          }
+          else if (status == IndexCache::Status::NoImage) {
+            INFO ("DICOM file \"" + filename + "\" does not seem to contain image data - ignored");
+          }
+        }
+
+        class ScanResult { NOMEMALIGN
+          public:
+            ScanResult () : scanned (false), cached (false) { }
+            IndexCache::Entry entry;
+            bool scanned, cached;
+        };
+
+        // scan the files in parallel, each into its own ScanResult
+        class FileScanner { NOMEMALIGN
+          public:
+            FileScanner (const vector<std::string>& filenames, vector<ScanResult>& results, const IndexCache& cache) :
+                filenames (filenames),
+                results (results),
+                cache (cache) { }
+
+            bool operator() (const size_t& index, size_t& scanned_index)
+            {
+              const std::string& filename (filenames[index]);
+              ScanResult& result (results[index]);
+              result.entry.mtime = result.entry.size = -1;
+              if (cache.enabled() && IndexCache::stat (filename, result.entry.mtime, result.entry.size)) {
+                const IndexCache::Entry* entry = cache.find (IndexCache::key (filename), result.entry.mtime, result.entry.size);
+                if (entry) {
+                  result.entry = *entry;
+                  result.entry.scan.filename = filename;
+                  result.scanned = result.cached = true;
+                  scanned_index = index;
+                  return true;
+                }
+              }
+
+              try {
+                result.entry.status = scan_file (filename, result.entry.scan);
+                result.scanned = true;
+              }
+              catch (Exception& E) {
+                E.display (3);
+              }
+              scanned_index = index;
+              return true;
+            }
+
+          protected:
+            const vector<std::string>& filenames;
+            vector<ScanResult>& results;
+            const IndexCache& cache;
+        };
+
+      }
+
+
+
+
+
+      void Tree::list_dir (const std::string& filename, vector<std::string>& filenames, ProgressBar& progress)
       {
         try {
           Path::Dir folder (filename);
@@ -62,15 +139,9 @@ namespace MR {
           while ((entry = folder.read_name()).size()) {
             std::string name (Path::join (filename, entry));
             if (Path::is_dir (name))
-              read_dir (name, progress);
-            else {
-              try {
-                read_file (name);
-              }
-              catch (Exception& E) {
-                E.display (3);
-              }
-            }
+              list_dir (name, filenames, progress);
+            else
+              filenames.push_back (name);
             ++progress;
           }
         }
@@ -83,26 +154,72 @@ namespace MR {
 
 
 
-      void Tree::read_file (const std::string& filename)
+      void Tree::read_files (const vector<std::string>& filenames)
       {
-        QuickScan reader;
-        if (reader.read (filename)) {
-          INFO ("error reading file \"" + filename + "\" - ignored");
-          return;
+        IndexCache cache;
+        vector<ScanResult> results (filenames.size());
+
+        {
+          ProgressBar progress ("reading DICOM files", filenames.size());
+          size_t next = 0;
+          Thread::run_queue (
+              [&] (size_t& index) { index = next++; return index < filenames.size(); },
+              size_t(),
+              Thread::multi (FileScanner (filenames, results, cache)),
+              size_t(),
+              [&] (const size_t&) { ++progress; return true; });
         }
 
-        if (! (reader.dim[0] && reader.dim[1] && reader.bits_alloc && reader.data)) {
-          INFO ("DICOM file \"" + filename + "\" does not seem to contain image data - ignored");
-          return;
+        // add to the tree in the order the files were listed, so that the
+        // order of patients, studies and series does not depend on threading
+        size_t num_cached = 0;
+        for (size_t n = 0; n < filenames.size(); ++n) {
+          const ScanResult& result (results[n]);
+          if (!result.scanned)
+            continue;
+          if (result.entry.status == IndexCache::Status::Image)
+            add (result.entry.scan);
+          else
+            report_ignored (filenames[n], result.entry.status);
+          if (result.cached)
+            ++num_cached;
+          else if (cache.enabled() && result.entry.mtime >= 0)
+            cache.insert (IndexCache::key (filenames[n]), result.entry);
         }
 
+        if (cache.enabled()) {
+          INFO (str(num_cached) + " of " + str(filenames.size()) + " DICOM files found in index cache");
+          cache.save();
+        }
+      }
+
+
+
+
+
+      void Tree::read_file (const std::string& filename)
+      {
+        QuickScan reader;
+        const auto status = scan_file (filename, reader);
+        if (status == IndexCache::Status::Image)
+          add (reader);
+        else
+          report_ignored (filename, status);
+      }
+
+
+
+
+
+      void Tree::add (const QuickScan& reader)
+      {
         std::shared_ptr<Patient> patient = find (reader.patient, reader.patient_ID, reader.patient_DOB);
         std::shared_ptr<Study> study = patient->find (reader.study, reader.study_ID, reader.study_date, reader.study_time);
         for (const auto& image_type : reader.image_type) {
           std::shared_ptr<Series> series = study->find (reader.series, reader.series_number, image_type.first, reader.modality, reader.series_date, reader.series_time);
 
           std::shared_ptr<Image> image (new Image);
-          image->filename = filename;
+          image->filename = reader.filename;
           image->series = series.get();
           image->sequence_name = reader.sequence;
           image->image_type = image_type.first;
@@ -118,9 +235,14 @@ namespace MR {
       void Tree::read (const std::string& filename)
       {
         description = filename;
-        ProgressBar progress ("scanning DICOM folder \"" + shorten (filename) + "\"", 0);
-        if (Path::is_dir (filename))
-          read_dir (filename, progress);
+        if (Path::is_dir (filename)) {
+          vector<std::string> filenames;
+          {
+            ProgressBar progress ("scanning DICOM folder \"" + shorten (filename) + "\"", 0);
+            list_dir (filename, filenames, progress);
+          }
+          read_files (filenames);
+        }
         else {
           try {
             read_file (filename);
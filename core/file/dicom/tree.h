@@ -26,6 +26,7 @@ namespace MR {
 
       class Series; 
       class Patient;
+      class QuickScan;
 
       class Tree : public vector<std::shared_ptr<Patient>> { NOMEMALIGN
         public:
@@ -43,8 +44,10 @@ namespace MR {
           }
 
         protected:
-          void read_dir (const std::string& filename, ProgressBar& progress);
+          void list_dir (const std::string& filename, vector<std::string>& filenames, ProgressBar& progress);
+          void read_files (const vector<std::string>& filenames);
           void read_file (const std::string& filename);
+          void add (const QuickScan& reader);
       }; 
 
       std::ostream& operator<< (std::ostream& stream, const Tree& item);
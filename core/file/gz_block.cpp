@@ -0,0 +1,325 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <zlib.h>
+
+#include "exception.h"
+#include "thread.h"
+#include "ordered_thread_queue.h"
+#include "file/config.h"
+#include "file/gz_block.h"
+#include "file/mmap.h"
+#include "file/ofstream.h"
+#include "raw.h"
+
+namespace MR
+{
+  namespace File
+  {
+    namespace GZBlock
+    {
+
+      namespace {
+
+        // gzip member header: fixed 10-byte header with FEXTRA set, followed
+        // by XLEN and a single 'MR' subfield holding the compressed size of
+        // the member and the uncompressed size of the block:
+        constexpr size_t header_size = 24;
+        // gzip member trailer: CRC32 & ISIZE
+        constexpr size_t trailer_size = 8;
+
+        inline void write_header (uint8_t* p, uint32_t member_size, uint32_t data_size)
+        {
+          const uint8_t fixed[] = {
+            0x1f, 0x8b,             // ID1, ID2
+            0x08,                   // CM: deflate
+            0x04,                   // FLG: FEXTRA
+            0x00, 0x00, 0x00, 0x00, // MTIME
+            0x00,                   // XFL
+            0xff,                   // OS: unknown
+            0x0c, 0x00,             // XLEN
+            'M', 'R',               // SI1, SI2
+            0x08, 0x00 };           // LEN
+          memcpy (p, fixed, sizeof (fixed));
+          Raw::store_LE<uint32_t> (member_size, p + 16);
+          Raw::store_LE<uint32_t> (data_size, p + 20);
+        }
+
+        inline bool parse_header (const uint8_t* p, int64_t available, uint32_t& member_size, uint32_t& data_size)
+        {
+          if (available < int64_t (header_size + trailer_size))
+            return false;
+          if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 0x08 || !(p[3] & 0x04))
+            return false;
+          if (Raw::fetch_LE<uint16_t> (p + 10) != 12 || p[12] != 'M' || p[13] != 'R' || Raw::fetch_LE<uint16_t> (p + 14) != 8)
+            return false;
+          member_size = Raw::fetch_LE<uint32_t> (p + 16);
+          data_size = Raw::fetch_LE<uint32_t> (p + 20);
+          return member_size >= header_size + trailer_size && member_size <= available;
+        }
+
+
+
+        vector<Block> build_index (const uint8_t* data, int64_t size)
+        {
+          vector<Block> blocks;
+          int64_t offset = 0, data_offset = 0;
+          while (offset < size) {
+            uint32_t member_size, data_size;
+            if (!parse_header (data + offset, size - offset, member_size, data_size))
+              return vector<Block>();
+            blocks.push_back ({ offset, member_size, data_offset, data_size });
+            offset += member_size;
+            data_offset += data_size;
+          }
+          return blocks;
+        }
+
+
+
+        class Chunk { NOMEMALIGN
+          public:
+            size_t block, data_size;
+            vector<uint8_t> data;
+        };
+
+
+
+        class Compressor { NOMEMALIGN
+          public:
+            Compressor (const vector<std::pair<const uint8_t*, size_t>>& pieces, size_t total, size_t block_size) :
+              pieces (pieces), total (total), block_size (block_size) { }
+
+            bool operator() (const Chunk& in, Chunk& out) {
+              const size_t begin = in.block * block_size;
+              const size_t size = std::min (block_size, total - begin);
+              const uint8_t* input = gather (begin, size);
+
+              z_stream zs;
+              memset (&zs, 0, sizeof (zs));
+              if (deflateInit2 (&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                throw Exception ("error initialising zlib compression stream");
+
+              out.block = in.block;
+              out.data_size = size;
+              out.data.resize (header_size + deflateBound (&zs, size) + trailer_size);
+              zs.next_in = const_cast<Bytef*> (input);
+              zs.avail_in = size;
+              zs.next_out = out.data.data() + header_size;
+              zs.avail_out = out.data.size() - header_size - trailer_size;
+              const int status = deflate (&zs, Z_FINISH);
+              const size_t compressed_size = zs.total_out;
+              deflateEnd (&zs);
+              if (status != Z_STREAM_END)
+                throw Exception ("error compressing data block: " + str (zs.msg ? zs.msg : "unknown error"));
+
+              const size_t member_size = header_size + compressed_size + trailer_size;
+              out.data.resize (member_size);
+              write_header (out.data.data(), member_size, size);
+              uint8_t* trailer = out.data.data() + header_size + compressed_size;
+              Raw::store_LE<uint32_t> (crc32 (crc32 (0L, Z_NULL, 0), input, size), trailer);
+              Raw::store_LE<uint32_t> (size, trailer + 4);
+              return true;
+            }
+
+          private:
+            const vector<std::pair<const uint8_t*, size_t>>& pieces;
+            const size_t total, block_size;
+            vector<uint8_t> buffer;
+
+            // return a pointer to the uncompressed data in [begin, begin+size),
+            // copying into a contiguous buffer if the block spans several pieces:
+            const uint8_t* gather (size_t begin, size_t size) {
+              size_t start = 0;
+              for (const auto& piece : pieces) {
+                if (begin < start + piece.second) {
+                  if (begin + size <= start + piece.second)
+                    return piece.first + (begin - start);
+                  break;
+                }
+                start += piece.second;
+              }
+              buffer.resize (size);
+              start = 0;
+              for (const auto& piece : pieces) {
+                const size_t from = std::max (begin, start);
+                const size_t to = std::min (begin + size, start + piece.second);
+                if (from < to)
+                  memcpy (buffer.data() + (from - begin), piece.first + (from - start), to - from);
+                start += piece.second;
+              }
+              return buffer.data();
+            }
+        };
+
+
+
+        class Decompressor { NOMEMALIGN
+          public:
+            Decompressor (const uint8_t* file, const vector<Block>& blocks, std::atomic<size_t>& next,
+                int64_t offset, uint8_t* destination, int64_t size, std::function<void(size_t)>& progress, std::mutex& mutex) :
+              file (file), blocks (blocks), next (next),
+              offset (offset), destination (destination), size (size),
+              progress (progress), mutex (mutex) { }
+
+            void execute () {
+              size_t n;
+              while ((n = next++) < blocks.size()) {
+                const Block& block (blocks[n]);
+                const int64_t from = std::max (offset, block.data_offset);
+                const int64_t to = std::min (offset + size, block.data_offset + block.data_size);
+                if (from >= to)
+                  continue;
+                if (from == block.data_offset && to == block.data_offset + block.data_size) {
+                  inflate_block (block, destination + (from - offset));
+                }
+                else {
+                  buffer.resize (block.data_size);
+                  inflate_block (block, buffer.data());
+                  memcpy (destination + (from - offset), buffer.data() + (from - block.data_offset), to - from);
+                }
+                if (progress) {
+                  std::lock_guard<std::mutex> lock (mutex);
+                  progress (to - from);
+                }
+              }
+            }
+
+          private:
+            const uint8_t* file;
+            const vector<Block>& blocks;
+            std::atomic<size_t>& next;
+            const int64_t offset;
+            uint8_t* destination;
+            const int64_t size;
+            std::function<void(size_t)>& progress;
+            std::mutex& mutex;
+            vector<uint8_t> buffer;
+
+            void inflate_block (const Block& block, uint8_t* out) {
+              const uint8_t* member = file + block.offset;
+              const uint8_t* trailer = member + block.compressed_size - trailer_size;
+
+              z_stream zs;
+              memset (&zs, 0, sizeof (zs));
+              if (inflateInit2 (&zs, -15) != Z_OK)
+                throw Exception ("error initialising zlib decompression stream");
+              zs.next_in = const_cast<Bytef*> (member + header_size);
+              zs.avail_in = block.compressed_size - header_size - trailer_size;
+              zs.next_out = out;
+              zs.avail_out = block.data_size;
+              const int status = inflate (&zs, Z_FINISH);
+              const size_t decompressed_size = zs.total_out;
+              inflateEnd (&zs);
+
+              if (status != Z_STREAM_END || decompressed_size != size_t (block.data_size) ||
+                  Raw::fetch_LE<uint32_t> (trailer + 4) != uint32_t (block.data_size))
+                throw Exception ("error decompressing data block at offset " + str (block.offset) + ": corrupted data");
+              if (Raw::fetch_LE<uint32_t> (trailer) != crc32 (crc32 (0L, Z_NULL, 0), out, block.data_size))
+                throw Exception ("error decompressing data block at offset " + str (block.offset) + ": CRC mismatch");
+            }
+        };
+
+      }
+
+
+
+
+      size_t block_size ()
+      {
+        //CONF option: ImageIOGZBlockSize
+        //CONF default: 1048576
+        //CONF The size (in bytes) of the independently compressed blocks
+        //CONF used when writing compressed images (e.g. .mif.gz, .nii.gz).
+        //CONF Smaller blocks allow finer-grained parallelism and random
+        //CONF access, at the expense of a slightly lower compression ratio.
+        static const size_t value = std::min (std::max (File::Config::get_int ("ImageIOGZBlockSize", 1048576), 65536), 268435456);
+        return value;
+      }
+
+
+
+      vector<Block> index (const std::string& filename)
+      {
+        File::MMap file (Entry (filename), false);
+        return build_index (file.address(), file.size());
+      }
+
+
+
+      void write (const std::string& filename,
+          const vector<std::pair<const uint8_t*, size_t>>& pieces,
+          std::function<void(size_t)> progress)
+      {
+        size_t total = 0;
+        for (const auto& piece : pieces)
+          total += piece.second;
+        const size_t bsize = block_size();
+        const size_t num_blocks = std::max ((total + bsize - 1) / bsize, size_t(1));
+
+        File::OFStream out (filename, std::ios::out | std::ios::binary);
+        size_t next = 0;
+
+        auto source = [&] (Chunk& chunk) {
+          if (next >= num_blocks)
+            return false;
+          chunk.block = next++;
+          return true;
+        };
+
+        auto sink = [&] (const Chunk& chunk) {
+          out.write (reinterpret_cast<const char*> (chunk.data.data()), chunk.data.size());
+          if (!out.good())
+            throw Exception ("error writing to file \"" + filename + "\": " + strerror (errno));
+          if (progress)
+            progress (chunk.data_size);
+          return true;
+        };
+
+        Thread::run_ordered_queue (source,
+            Chunk(),
+            Thread::multi (Compressor (pieces, total, bsize)),
+            Chunk(),
+            sink);
+      }
+
+
+
+      bool read (const std::string& filename, int64_t offset, uint8_t* destination, int64_t size,
+          std::function<void(size_t)> progress)
+      {
+        File::MMap file (Entry (filename), false);
+        const vector<Block> blocks = build_index (file.address(), file.size());
+        if (blocks.empty())
+          return false;
+        if (offset + size > blocks.back().data_offset + blocks.back().data_size)
+          throw Exception ("file \"" + filename + "\" is smaller than expected");
+
+        std::atomic<size_t> next (0);
+        std::mutex mutex;
+        Decompressor decompressor (file.address(), blocks, next, offset, destination, size, progress, mutex);
+        auto threads = Thread::run (Thread::multi (decompressor, std::min (Thread::threads_to_execute(), blocks.size())), "gzip block decompression");
+        threads.wait();
+        return true;
+      }
+
+    }
+  }
+}
+
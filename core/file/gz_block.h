@@ -0,0 +1,92 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __file_gz_block_h__
+#define __file_gz_block_h__
+
+#include <functional>
+
+#include "types.h"
+
+namespace MR
+{
+  namespace File
+  {
+
+    //! Multi-threaded block-compressed gzip files
+    /*! Files written using these functions consist of a series of
+     * independent gzip members, each holding a fixed-size block of the
+     * uncompressed data (the last block may be smaller). The concatenation of
+     * gzip members is itself a valid gzip file, so these files can be read
+     * by any standard gzip implementation. Each member header additionally
+     * holds an extra field (subfield ID 'MR') recording the compressed size
+     * of the member and the uncompressed size of its block, which forms an
+     * index of the file: blocks can be located without decompressing the
+     * preceding data, and can therefore be decompressed in parallel, or
+     * individually for random access.
+     *
+     * The size of each block is set by the ImageIOGZBlockSize configuration
+     * file option. */
+    namespace GZBlock
+    {
+
+      //! the location of one block within a block-compressed gzip file
+      class Block { NOMEMALIGN
+        public:
+          int64_t offset;             /**< byte offset of the gzip member within the file */
+          int64_t compressed_size;    /**< total size of the gzip member */
+          int64_t data_offset;        /**< offset of the block within the uncompressed data */
+          int64_t data_size;          /**< uncompressed size of the block */
+      };
+
+      //! the block size to use when writing, in bytes
+      size_t block_size ();
+
+      //! obtain the block index of the file \a filename
+      /*! This returns an empty index if the file is not in block-compressed
+       * format (e.g. if it was written by another gzip implementation). */
+      vector<Block> index (const std::string& filename);
+
+      //! write data to file \a filename in block-compressed format
+      /*! The uncompressed data written to file is the concatenation of the
+       * \a pieces supplied, each given as a (pointer, size) pair. Blocks are
+       * compressed concurrently using Thread::threads_to_execute() threads,
+       * and written to file in order. If supplied, \a progress is invoked
+       * with the uncompressed size of each block as it is written. */
+      void write (const std::string& filename,
+          const vector<std::pair<const uint8_t*, size_t>>& pieces,
+          std::function<void(size_t)> progress = nullptr);
+
+      //! read \a size bytes from file \a filename into \a destination
+      /*! The region read starts at byte \a offset in the uncompressed data.
+       * Only the blocks overlapping that region are decompressed, and these
+       * are processed concurrently using Thread::threads_to_execute()
+       * threads. If supplied, \a progress is invoked with the number of bytes
+       * copied to \a destination as each block is decompressed.
+       *
+       * \returns false (without reading anything) if the file is not in
+       * block-compressed format, in which case it should be read using a
+       * regular sequential gzip stream (e.g. File::GZ). */
+      bool read (const std::string& filename, int64_t offset, uint8_t* destination, int64_t size,
+          std::function<void(size_t)> progress = nullptr);
+
+    }
+
+  }
+}
+
+#endif
+
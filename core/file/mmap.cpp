@@ -194,7 +194,7 @@ namespace MR
 #ifdef MRTRIX_WINDOWS
         if (!UnmapViewOfFile ( (LPVOID) addr))
 #else
-          if (munmap (addr, msize))
+          if (munmap (addr, start + msize))
 #endif
             WARN ("error unmapping file \"" + Entry::name + "\": " + strerror (errno));
         close (fd);
@@ -224,6 +224,78 @@ namespace MR
 
 
 
+    namespace {
+      // expand the byte range [offset, offset+size) relative to 'first' to
+      // page boundaries, clamped to the mapped region:
+      inline bool __page_range (const uint8_t* addr, const uint8_t* first, int64_t msize,
+          int64_t offset, int64_t size, uint8_t*& start, size_t& length)
+      {
+        if (offset < 0 || offset >= msize || size <= 0)
+          return false;
+        size = std::min (size, msize - offset);
+        static const size_t page_size = sysconf (_SC_PAGESIZE);
+        const size_t begin = (first - addr) + offset;
+        const size_t aligned_begin = begin - (begin % page_size);
+        start = const_cast<uint8_t*> (addr) + aligned_begin;
+        length = begin + size - aligned_begin;
+        return true;
+      }
+    }
+
+
+
+    void MMap::prefetch (int64_t offset, int64_t size) const
+    {
+#ifndef MRTRIX_WINDOWS
+      if (!addr)
+        return;
+      uint8_t* start;
+      size_t length;
+      if (__page_range (addr, first, msize, offset, size, start, length))
+        if (madvise (start, length, MADV_WILLNEED))
+          DEBUG ("read-ahead request failed for file \"" + Entry::name + "\": " + strerror (errno));
+#endif
+    }
+
+
+
+    void MMap::flush_async (int64_t offset, int64_t size) const
+    {
+#ifndef MRTRIX_WINDOWS
+      if (!addr || !readwrite)
+        return;
+      uint8_t* start;
+      size_t length;
+      if (__page_range (addr, first, msize, offset, size, start, length))
+#ifdef __linux__
+        // msync (MS_ASYNC) is a no-op on Linux; request write-out explicitly:
+        if (sync_file_range (fd, start - addr, length, SYNC_FILE_RANGE_WRITE))
+#else
+        if (msync (start, length, MS_ASYNC))
+#endif
+          DEBUG ("write-back request failed for file \"" + Entry::name + "\": " + strerror (errno));
+#endif
+    }
+
+
+
+    void MMap::release (int64_t offset, int64_t size) const
+    {
+#ifndef MRTRIX_WINDOWS
+      if (!addr)
+        return;
+      uint8_t* start;
+      size_t length;
+      // for shared file mappings, this only drops the page table entries:
+      // modified pages are retained in the page cache until written back
+      if (__page_range (addr, first, msize, offset, size, start, length))
+        if (madvise (start, length, MADV_DONTNEED))
+          DEBUG ("release request failed for file \"" + Entry::name + "\": " + strerror (errno));
+#endif
+    }
+
+
+
     bool MMap::changed () const
     {
       assert (fd >= 0);
@@ -73,6 +73,32 @@ namespace MR
         }
         bool changed () const;
 
+        //! whether the file is memory-mapped (rather than held in RAM)
+        bool is_mapped () const {
+          return addr;
+        }
+
+        //! hint to the OS that the given region will be accessed soon
+        /*! This initiates asynchronous read-ahead of the \a size bytes
+         * starting at byte \a offset relative to address(), so that the
+         * corresponding pages are likely to be resident by the time they
+         * are accessed. This has no effect if the file is held in RAM. */
+        void prefetch (int64_t offset, int64_t size) const;
+
+        //! initiate write-back of any modifications to the given region
+        /*! This asks the OS to start writing out any modified pages within
+         * the \a size bytes starting at byte \a offset relative to
+         * address(), without waiting for this to complete. This has no
+         * effect if the file is held in RAM or is read-only. */
+        void flush_async (int64_t offset, int64_t size) const;
+
+        //! remove the given region from the resident set of this process
+        /*! The contents of the file are unaffected: any modified pages
+         * remain queued for write-back, and subsequent accesses to the
+         * region read the data back in from the page cache or the file.
+         * This has no effect if the file is held in RAM. */
+        void release (int64_t offset, int64_t size) const;
+
         friend std::ostream& operator<< (std::ostream& stream, const MMap& m) {
           stream << "File::MMap { " << m.name() << " [" << m.fd << "], size: "
                  << m.size() << ", mapped " << (m.readwrite ? "RW" : "RO")
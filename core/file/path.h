@@ -153,19 +153,21 @@ namespace MR
         Path::has_suffix (name, {".mif", ".mih", ".mif.gz"});
     }
 
+    //! whether \a name is a regular (.tck) or compressed (.tckz) track file
+    inline bool is_track_file (const std::string& name)
+    {
+      return Path::has_suffix (name, {".tck", ".tckz"});
+    }
+
     inline std::string cwd ()
     {
-      std::string path;
-      size_t buf_size = 32;
-      while (true) {
-        path.reserve (buf_size);
-        if (getcwd (&path[0], buf_size))
-          break;
+      vector<char> path (32);
+      while (!getcwd (path.data(), path.size())) {
         if (errno != ERANGE)
           throw Exception ("failed to get current working directory!");
-        buf_size *= 2;
+        path.resize (2 * path.size());
       }
-      return path;
+      return path.data();
     }
 
     inline std::string home ()
@@ -200,6 +200,23 @@ namespace MR
 
 
 
+    //! the modification time recorded in \a buf, in nanoseconds
+    /*! This includes the sub-second part of the time stamp where the
+     * system provides it, so that files modified in quick succession can
+     * be told apart. */
+    inline int64_t modification_time (const struct stat& buf)
+    {
+#if defined(MRTRIX_WINDOWS)
+      return int64_t (buf.st_mtime) * 1000000000;
+#elif defined(MRTRIX_MACOSX)
+      return int64_t (buf.st_mtimespec.tv_sec) * 1000000000 + buf.st_mtimespec.tv_nsec;
+#else
+      return int64_t (buf.st_mtim.tv_sec) * 1000000000 + buf.st_mtim.tv_nsec;
+#endif
+    }
+
+
+
     inline bool is_tempfile (const std::string& name, const char* suffix = NULL)
     {
       if (Path::basename (name).compare (0, tmpfile_prefix().size(), tmpfile_prefix()))
@@ -17,11 +17,15 @@
 #ifndef __image_filter_gaussian_h__
 #define __image_filter_gaussian_h__
 
+#include <complex>
+
 #include "memory.h"
 #include "image.h"
 #include "algo/copy.h"
 #include "algo/threaded_copy.h"
+#include "algo/threaded_loop.h"
 #include "adapter/gaussian1D.h"
+#include "file/config.h"
 #include "filter/base.h"
 
 namespace MR
@@ -42,6 +46,14 @@ namespace MR
      * smooth_filter (input, output);
      *
      * \endcode
+     *
+     * By default, each axis is convolved with an explicit Gaussian kernel
+     * truncated at the specified extent, at a cost proportional to the
+     * extent. If set_recursive() is enabled (or the RecursiveGaussianSmoothing
+     * config file option is set), axes for which no extent has been set and
+     * the standard deviation is at least one voxel are instead smoothed
+     * using a recursive approximation to the Gaussian, at a cost independent
+     * of the standard deviation.
      */
 
     class Smooth : public Base
@@ -54,7 +66,8 @@ namespace MR
             extent (3, 0),
             stdev (3, 0.0),
             stride_order (Stride::order (in)),
-            zero_boundary (false)
+            zero_boundary (false),
+            recursive (default_recursive())
         {
           for (int i = 0; i < 3; i++)
             stdev[i] = in.spacing(i);
@@ -66,7 +79,9 @@ namespace MR
             Base (in),
             extent (3, 0),
             stdev (3, 0.0),
-            stride_order (Stride::order (in))
+            stride_order (Stride::order (in)),
+            zero_boundary (false),
+            recursive (default_recursive())
         {
           set_stdev (stdev_in);
           datatype() = DataType::Float32;
@@ -99,6 +114,11 @@ namespace MR
           zero_boundary = do_zero_boundary;
         }
 
+        //! use the recursive (IIR) approximation to the Gaussian where possible
+        void set_recursive (bool use_recursive) {
+          recursive = use_recursive;
+        }
+
         //! Set the standard deviation of the Gaussian defined in mm.
         //! This must be set as a single value to be used for the first 3 dimensions
         //! or separate values, one for each dimension. (Default: 1 voxel)
@@ -136,7 +156,11 @@ namespace MR
           }
 
           for (size_t dim = 0; dim < 3; dim++) {
-            if (stdev[dim] > 0) {
+            if (use_recursive (input, dim)) {
+              smooth_recursive (*in, dim);
+              if (progress)
+                ++(*progress);
+            } else if (stdev[dim] > 0) {
               DEBUG ("creating scratch image for smoothing image along dimension " + str(dim));
               out = make_shared<Image<ValueType> > (Image<ValueType>::scratch (input));
               Adapter::Gaussian1D<Image<ValueType> > gaussian (*in, stdev[dim], dim, extent[dim], zero_boundary);
@@ -163,7 +187,11 @@ namespace MR
           }
 
           for (size_t dim = 0; dim < 3; dim++) {
-            if (stdev[dim] > 0) {
+            if (use_recursive (in_and_output, dim)) {
+              smooth_recursive (in_and_output, dim);
+              if (progress)
+                ++(*progress);
+            } else if (stdev[dim] > 0) {
               vector<size_t> axes (in_and_output.ndim(), dim);
               size_t axdim = 1;
               for (size_t i = 0; i < in_and_output.ndim(); ++i) {
@@ -185,6 +213,46 @@ namespace MR
         vector<default_type> stdev;
         const vector<size_t> stride_order;
         bool zero_boundary;
+        bool recursive;
+
+        static bool default_recursive () {
+          //CONF option: RecursiveGaussianSmoothing
+          //CONF default: 0 (false)
+          //CONF Whether Gaussian smoothing of images (e.g. in mrfilter and
+          //CONF mrregister) should use a recursive approximation to the
+          //CONF Gaussian, the cost of which does not depend on its width,
+          //CONF rather than an explicit truncated kernel.
+          static const bool value = File::Config::get_bool ("RecursiveGaussianSmoothing", false);
+          return value;
+        }
+
+        // the recursive approximation is poor for a standard deviation below
+        // one voxel, where the truncated kernel is short anyway; an explicitly
+        // set extent requests the truncated kernel
+        template <class HeaderType>
+          bool use_recursive (const HeaderType& header, size_t dim) const {
+            return recursive && !extent[dim] && stdev[dim] >= header.spacing (dim);
+          }
+
+        template <class ImageType>
+          void smooth_recursive (ImageType& image, size_t dim)
+          {
+            // lines along dim are filtered together across the axis with the
+            // smallest stride, so that the recursion operates on contiguous data
+            size_t across_axis = image.ndim();
+            vector<size_t> outer_axes;
+            for (auto axis : Stride::order (image)) {
+              if (axis == dim)
+                continue;
+              if (across_axis == image.ndim())
+                across_axis = axis;
+              else
+                outer_axes.push_back (axis);
+            }
+            DEBUG ("smoothing dimension " + str(dim) + " recursively across axis " + str(across_axis));
+            RecursiveSmoothFunctor1D<ImageType> smooth (image, stdev[dim], dim, across_axis, zero_boundary);
+            ThreadedLoop (image, outer_axes, 0).run_outer (smooth);
+          }
 
         template <class ImageType>
           class SmoothFunctor1D { MEMALIGN (SmoothFunctor1D)
@@ -284,6 +352,155 @@ namespace MR
             ssize_t buffer_size;
             Eigen::VectorXd buffer;
           };
+
+
+        //! Smooth one plane of lines at a time using a recursive Gaussian
+        /*! This implements the third-order recursive filter of Young, van
+         * Vliet & van Ginkel (IEEE Trans. Signal Processing, 2002), with the
+         * poles scaled to match the requested variance exactly, and the
+         * initial conditions of the
+         * anti-causal pass computed as in Triggs & Sdika (IEEE Trans. Signal
+         * Processing, 2006) so that the image is effectively zero-padded.
+         * As with the truncated kernel, the result is renormalised near the
+         * image edges, and non-finite values are excluded by smoothing the
+         * mask of finite values alongside the data.
+         *
+         * All lines of each plane spanned by the smoothing axis and \a
+         * across_axis are filtered together, one column of the buffer per
+         * position along the line, so that each step of the recursion
+         * operates on a contiguous vector of values. */
+        template <class ImageType>
+          class RecursiveSmoothFunctor1D { MEMALIGN (RecursiveSmoothFunctor1D<ImageType>)
+          public:
+            using value_type = typename ImageType::value_type;
+
+            RecursiveSmoothFunctor1D (const ImageType& image,
+                                      default_type stdev,
+                                      size_t axis,
+                                      size_t across_axis,
+                                      bool zero_boundary) :
+                image (image),
+                axis (axis),
+                across_axis (across_axis),
+                zero_boundary (zero_boundary)
+            {
+              // poles of the filter for a standard deviation of 2 voxels,
+              // scaled by the power 1/q to obtain the requested variance
+              const std::complex<default_type> poles[] = { { 1.86543, 0.0 }, { 1.41650, 1.00829 }, { 1.41650, -1.00829 } };
+              auto scaled_pole = [&] (size_t k, default_type q) {
+                return std::polar (std::pow (std::abs (poles[k]), 1.0/q), std::arg (poles[k]) / q);
+              };
+              auto variance = [&] (default_type q) {
+                std::complex<default_type> sum (0.0, 0.0);
+                for (size_t k = 0; k < 3; ++k) {
+                  const auto z = scaled_pole (k, q);
+                  sum += z / ((z - 1.0) * (z - 1.0));
+                }
+                return 2.0 * sum.real();
+              };
+              const default_type sigma = stdev / image.spacing (axis);
+              default_type q_low = 0.01, q_high = 1.0;
+              while (variance (q_high) < sigma * sigma)
+                q_high *= 2.0;
+              for (size_t iter = 0; iter < 100; ++iter) {
+                const default_type q = 0.5 * (q_low + q_high);
+                (variance (q) < sigma * sigma ? q_low : q_high) = q;
+              }
+              std::complex<default_type> r[3];
+              for (size_t k = 0; k < 3; ++k)
+                r[k] = 1.0 / scaled_pole (k, 0.5 * (q_low + q_high));
+              b[0] = (r[0] + r[1] + r[2]).real();
+              b[1] = -(r[0]*r[1] + r[0]*r[2] + r[1]*r[2]).real();
+              b[2] = (r[0]*r[1]*r[2]).real();
+              B = 1.0 - (b[0] + b[1] + b[2]);
+
+              // the anti-causal pass beyond the end of the line is a linear
+              // function of the last three outputs of the causal pass; obtain
+              // this mapping from the impulse responses of the filter
+              const ssize_t tail = 30 + std::ceil (12.0 * sigma);
+              vector<default_type> w (tail + 3), y (tail + 3);
+              for (size_t j = 0; j < 3; ++j) {
+                std::fill (w.begin(), w.end(), 0.0);
+                std::fill (y.begin(), y.end(), 0.0);
+                w[2-j] = 1.0;
+                for (ssize_t i = 3; i < tail; ++i)
+                  w[i] = b[0] * w[i-1] + b[1] * w[i-2] + b[2] * w[i-3];
+                for (ssize_t i = tail - 1; i >= 3; --i)
+                  y[i] = B * w[i] + b[0] * y[i+1] + b[1] * y[i+2] + b[2] * y[i+3];
+                for (size_t i = 0; i < 3; ++i)
+                  M(i,j) = y[3+i];
+              }
+
+              // response to a line of ones, to renormalise near the edges
+              Eigen::ArrayXXd ones = Eigen::ArrayXXd::Zero (1, image.size (axis) + 6);
+              ones.middleCols (3, image.size (axis)).setOnes();
+              filter (ones);
+              norm = ones.middleCols (3, image.size (axis)).inverse();
+            }
+
+            void operator() (const Iterator& pos)
+            {
+              assign_pos_of (pos).to (image);
+              const ssize_t n = image.size (axis);
+              buffer.resize (image.size (across_axis), n + 6);
+              for (ssize_t i = 0; i < n; ++i) {
+                image.index (axis) = i;
+                for (ssize_t k = 0; k < buffer.rows(); ++k) {
+                  image.index (across_axis) = k;
+                  buffer(k,i+3) = image.value();
+                }
+              }
+
+              auto data = buffer.middleCols (3, n);
+              if (data.isFinite().all()) {
+                filter (buffer);
+                data.rowwise() *= norm;
+              } else {
+                weights.resize (buffer.rows(), n + 6);
+                weights.middleCols (3, n) = data.isFinite().template cast<default_type>();
+                data = data.isFinite().select (data, 0.0);
+                filter (buffer);
+                filter (weights);
+                data /= weights.middleCols (3, n);
+              }
+
+              if (zero_boundary) {
+                data.col (0).setZero();
+                data.col (n-1).setZero();
+              }
+
+              for (ssize_t i = 0; i < n; ++i) {
+                image.index (axis) = i;
+                for (ssize_t k = 0; k < buffer.rows(); ++k) {
+                  image.index (across_axis) = k;
+                  image.value() = buffer(k,i+3);
+                }
+              }
+            }
+
+          private:
+            ImageType image;
+            const size_t axis, across_axis;
+            const bool zero_boundary;
+            default_type b[3], B;
+            Eigen::Matrix3d M;
+            Eigen::Array<default_type, 1, Eigen::Dynamic> norm;
+            Eigen::ArrayXXd buffer, weights;
+
+            // filter each row of data in place, with the line itself held in
+            // columns [ 3, cols()-3 ); the remaining columns are overwritten
+            void filter (Eigen::ArrayXXd& data) const
+            {
+              const ssize_t end = data.cols() - 3;
+              data.leftCols (3).setZero();
+              for (ssize_t i = 3; i < end; ++i)
+                data.col (i) = B * data.col (i) + b[0] * data.col (i-1) + b[1] * data.col (i-2) + b[2] * data.col (i-3);
+              for (ssize_t i = 0; i < 3; ++i)
+                data.col (end+i) = M(i,0) * data.col (end-1) + M(i,1) * data.col (end-2) + M(i,2) * data.col (end-3);
+              for (ssize_t i = end - 1; i >= 3; --i)
+                data.col (i) = B * data.col (i) + b[0] * data.col (i+1) + b[1] * data.col (i+2) + b[2] * data.col (i+3);
+            }
+          };
     };
     //! @}
   }
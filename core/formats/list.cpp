@@ -29,6 +29,7 @@ namespace MR
     Pipe          pipe_handler;
     MRtrix        mrtrix_handler;
     MRtrix_GZ     mrtrix_gz_handler;
+    MRtrix_tiled  mrtrix_tiled_handler;
     MRI           mri_handler;
     PAR           par_handler;
     NIfTI1        nifti1_handler;
@@ -56,6 +57,7 @@ namespace MR
       &dicom_handler,
       &mrtrix_handler,
       &mrtrix_gz_handler,
+      &mrtrix_tiled_handler,
       &nifti1_handler,
       &nifti2_handler,
       &nifti1_gz_handler,
@@ -81,6 +83,7 @@ namespace MR
       ".mih",
       ".mif",
       ".mif.gz",
+      ".mift",
       ".img",
       ".nii",
       ".nii.gz",
@@ -93,6 +93,7 @@ namespace MR
     DECLARE_IMAGEFORMAT (DICOM, "DICOM");
     DECLARE_IMAGEFORMAT (MRtrix, "MRtrix");
     DECLARE_IMAGEFORMAT (MRtrix_GZ, "MRtrix (GZip compressed)");
+    DECLARE_IMAGEFORMAT (MRtrix_tiled, "MRtrix (tiled)");
     DECLARE_IMAGEFORMAT (NIfTI1, "NIfTI-1.1");
     DECLARE_IMAGEFORMAT (NIfTI2, "NIfTI-2");
     DECLARE_IMAGEFORMAT (NIfTI1_GZ, "NIfTI-1.1 (GZip compressed)");
@@ -0,0 +1,165 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "header.h"
+#include "image_io/tiled.h"
+#include "formats/list.h"
+#include "formats/mrtrix_utils.h"
+#include "file/config.h"
+#include "file/entry.h"
+#include "file/key_value.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+namespace MR
+{
+  namespace Formats
+  {
+
+    // extension is:
+    // mift: MRtrix Image File, Tiled
+
+    namespace {
+
+      vector<size_t> default_chunk_size (const Header& H)
+      {
+        //CONF option: TiledImageChunkSize
+        //CONF default: 16,16,16
+        //CONF The dimensions of the chunks used when writing images in tiled
+        //CONF MRtrix format (.mift). Any axes beyond those listed are
+        //CONF stored in full within each chunk.
+        const auto spec = parse_ints<size_t> (File::Config::get ("TiledImageChunkSize", "16,16,16"));
+        vector<size_t> chunk_size (H.ndim());
+        for (size_t n = 0; n < H.ndim(); ++n)
+          chunk_size[n] = n < spec.size() ? std::max (spec[n], size_t(1)) : H.size (n);
+        return chunk_size;
+      }
+
+      bool compress_by_default ()
+      {
+        //CONF option: TiledImageCompression
+        //CONF default: 1 (true)
+        //CONF Whether the chunks of images written in tiled MRtrix format
+        //CONF (.mift) should be individually zlib-compressed.
+        return File::Config::get_bool ("TiledImageCompression", true);
+      }
+
+      // remove a format-specific entry from the header key-value pairs, so
+      // that it does not propagate into images created using this header:
+      std::string take_key (Header& H, const std::string& key)
+      {
+        auto it = H.keyval().find (key);
+        if (it == H.keyval().end())
+          throw Exception ("missing \"" + key + "\" specification for tiled MRtrix image \"" + H.name() + "\"");
+        const std::string value = it->second;
+        H.keyval().erase (it);
+        return value;
+      }
+
+    }
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_tiled::read (Header& H) const
+    {
+      if (!Path::has_suffix (H.name(), ".mift"))
+        return std::unique_ptr<ImageIO::Base>();
+
+      File::KeyValue::Reader kv (H.name(), "mrtrix tiled image");
+
+      read_mrtrix_header (H, kv);
+
+      const auto chunk_size = parse_ints<size_t> (take_key (H, "chunks"));
+      if (chunk_size.size() != H.ndim())
+        throw Exception ("invalid \"chunks\" specification for tiled MRtrix image \"" + H.name() + "\"");
+
+      const std::string compression = lowercase (take_key (H, "compression"));
+      if (compression != "zlib" && compression != "none")
+        throw Exception ("unsupported compression \"" + compression + "\" for tiled MRtrix image \"" + H.name() + "\"");
+
+      std::string fname;
+      size_t offset;
+      get_mrtrix_file_path (H, "file", fname, offset);
+      if (fname != H.name())
+        throw Exception ("tiled MRtrix format images must have image data within the same file as the header");
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Tiled (H, chunk_size, compression == "zlib"));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return io_handler;
+    }
+
+
+
+
+
+    bool MRtrix_tiled::check (Header& H, size_t num_axes) const
+    {
+      if (!Path::has_suffix (H.name(), ".mift"))
+        return false;
+
+      H.ndim() = num_axes;
+      for (size_t i = 0; i < H.ndim(); i++)
+        if (H.size (i) < 1)
+          H.size(i) = 1;
+
+      if (H.datatype().bits() == 1) {
+        INFO ("tiled MRtrix format does not support bitwise data; image \"" + H.name() + "\" will be stored as 8-bit integer");
+        H.datatype() = DataType::UInt8;
+      }
+
+      return true;
+    }
+
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_tiled::create (Header& H) const
+    {
+      const auto chunk_size = default_chunk_size (H);
+      const bool compressed = compress_by_default();
+
+      File::OFStream out (H.name(), std::ios::out | std::ios::binary);
+
+      out << "mrtrix tiled image\n";
+
+      write_mrtrix_header (H, out);
+
+      out << "chunks: " << chunk_size[0];
+      for (size_t n = 1; n < chunk_size.size(); ++n)
+        out << "," << chunk_size[n];
+      out << "\ncompression: " << (compressed ? "zlib" : "none") << "\n";
+
+      int64_t offset = int64_t(out.tellp()) + int64_t(18);
+      offset += ((4 - (offset % 4)) % 4);
+      out << "file: . " << offset << "\nEND\n";
+      out.close();
+
+      File::resize (H.name(), offset);
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Tiled (H, chunk_size, compressed));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return io_handler;
+    }
+
+
+  }
+}
+
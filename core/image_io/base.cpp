@@ -53,6 +53,7 @@ namespace MR
       unload (header);
       DEBUG ("image \"" + header.name() + "\" unloaded");
       addresses.clear();
+      segment_ready.reset();
     }
 
 
@@ -17,6 +17,7 @@
 #ifndef __image_io_base_h__
 #define __image_io_base_h__
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <unistd.h>
@@ -75,6 +76,8 @@ namespace MR
 
         uint8_t* segment (size_t n) const {
           assert (n < addresses.size());
+          if (segment_ready && !segment_ready[n].load (std::memory_order_acquire))
+            load_segment (n);
           return addresses[n].get();
         }
         size_t nsegments () const {
@@ -105,6 +108,14 @@ namespace MR
         vector<std::unique_ptr<uint8_t[]>> addresses;
         bool is_new, writable;
 
+        //! for handlers that only fill in each segment when first accessed
+        /*! If allocated (with one entry per segment), segment() invokes
+         * load_segment() whenever the entry for the requested segment is
+         * false. load_segment() may be invoked concurrently from several
+         * threads, and must set the entry once the segment is ready. */
+        std::unique_ptr<std::atomic<bool>[]> segment_ready;
+        virtual void load_segment (size_t) const { }
+
         void check () const {
           assert (addresses.size());
         }
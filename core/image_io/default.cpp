@@ -14,10 +14,15 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <atomic>
+#include <functional>
 #include <limits>
+#include <mutex>
 
 #include "app.h"
 #include "header.h"
+#include "thread.h"
+#include "file/config.h"
 #include "file/ofstream.h"
 #include "image_io/default.h"
 
@@ -26,6 +31,137 @@ namespace MR
   namespace ImageIO
   {
 
+    namespace {
+
+      int64_t stream_window ()
+      {
+        //CONF option: ImageIOStreamWindow
+        //CONF default: 0 (no streaming)
+        //CONF The amount of memory (in MB) through which memory-mapped
+        //CONF images larger than this are streamed. Slabs of the image
+        //CONF ahead of the one being processed are read in advance, and
+        //CONF those already processed are written back and released from
+        //CONF memory, so that disk access overlaps with computation and
+        //CONF memory usage remains bounded. This only benefits commands
+        //CONF that process images in the order in which they are stored;
+        //CONF streamed images are also copied into RAM by commands that
+        //CONF require direct access to the image data.
+        static const int64_t value = int64_t (std::max (File::Config::get_int ("ImageIOStreamWindow", 0), 0)) << 20;
+        return value;
+      }
+
+
+
+      // invoke func (n) for n in [0, num), using several threads to allow
+      // concurrent access to different files:
+      class FileIOWorker { NOMEMALIGN
+        public:
+          FileIOWorker (std::atomic<size_t>& next, size_t num, const std::function<void(size_t)>& func) :
+            next (next), num (num), func (func) { }
+          void execute () {
+            size_t n;
+            while ((n = next++) < num)
+              func (n);
+          }
+        private:
+          std::atomic<size_t>& next;
+          const size_t num;
+          const std::function<void(size_t)>& func;
+      };
+
+      void for_each_file (size_t num, const std::function<void(size_t)>& func)
+      {
+        const size_t num_threads = std::min (num, Thread::threads_to_execute());
+        if (num_threads <= 1) {
+          for (size_t n = 0; n < num; ++n)
+            func (n);
+          return;
+        }
+        std::atomic<size_t> next (0);
+        FileIOWorker worker (next, num, func);
+        auto threads = Thread::run (Thread::multi (worker, num_threads), "file I/O");
+        threads.wait();
+      }
+
+    }
+
+
+
+
+    // the state of an image being streamed: slabs are either consecutive
+    // regions of a single file, or whole files if there are several
+    class Default::Stream { NOMEMALIGN
+      public:
+        Stream (const vector<std::shared_ptr<File::MMap>>& mmaps, std::atomic<bool>* ready,
+            size_t num_slabs, int64_t slab_bytes, size_t window, bool read_ahead) :
+            mmaps (mmaps),
+            ready (ready),
+            num_slabs (num_slabs),
+            slab_bytes (slab_bytes),
+            ahead (std::max (window/4, size_t(1))),
+            behind (window - ahead - 1),
+            read_ahead (read_ahead),
+            releasing (true),
+            cursor (0),
+            next_prefetch (0),
+            next_release (0)
+        {
+          prefetch_to (ahead);
+        }
+
+        // invoked (with the mutex held) on the first access to slab n since
+        // the image was opened, or since that slab was released:
+        void access (size_t n)
+        {
+          if (n < next_release) {
+            if (releasing)
+              DEBUG ("file \"" + mmaps[0]->name() + "\" is not being accessed sequentially - no longer releasing slabs");
+            releasing = false;
+            return;
+          }
+          if (n <= cursor)
+            return;
+
+          cursor = n;
+          next_prefetch = std::max (next_prefetch, cursor + 1);
+          prefetch_to (cursor + ahead);
+
+          if (!releasing)
+            return;
+          for (; next_release + behind < cursor; ++next_release) {
+            file (next_release).flush_async (offset (next_release), slab_bytes);
+            file (next_release).release (offset (next_release), slab_bytes);
+            ready[next_release].store (false, std::memory_order_relaxed);
+          }
+        }
+
+        std::mutex mutex;
+
+      private:
+        const vector<std::shared_ptr<File::MMap>> mmaps;
+        std::atomic<bool>* const ready;
+        const size_t num_slabs;
+        const int64_t slab_bytes;
+        const size_t ahead, behind;
+        const bool read_ahead;
+        bool releasing;
+        size_t cursor, next_prefetch, next_release;
+
+        const File::MMap& file (size_t n) const { return *mmaps[mmaps.size() > 1 ? n : 0]; }
+        int64_t offset (size_t n) const { return mmaps.size() > 1 ? 0 : n * slab_bytes; }
+
+        void prefetch_to (size_t last)
+        {
+          if (!read_ahead)
+            return;
+          for (last = std::min (last, num_slabs-1); next_prefetch <= last; ++next_prefetch)
+            file (next_prefetch).prefetch (offset (next_prefetch), slab_bytes);
+        }
+    };
+
+
+
+
     void Default::load (const Header& header, size_t)
     {
       if (files.empty())
@@ -57,20 +193,14 @@ namespace MR
       if (mmaps.empty() && addresses.size()) {
         assert (addresses[0].get());
 
-        if (writable) {
-          for (size_t n = 0; n < files.size(); n++) {
-            File::OFStream out (files[n].name, std::ios::in | std::ios::out | std::ios::binary);
-            out.seekp (files[n].start, out.beg);
-            out.write ((char*) (addresses[0].get() + n*bytes_per_segment), bytes_per_segment);
-            if (!out.good())
-              throw Exception ("error writing back contents of file \"" + files[n].name + "\": " + strerror(errno));
-          }
-        }
+        if (writable)
+          write_back (header);
       }
       else {
         for (size_t n = 0; n < addresses.size(); ++n)
           addresses[n].release();
         mmaps.clear();
+        stream.reset();
       }
     }
 
@@ -79,11 +209,60 @@ namespace MR
     void Default::map_files (const Header& header)
     {
       mmaps.resize (files.size());
-      addresses.resize (mmaps.size());
-      for (size_t n = 0; n < files.size(); n++) {
+      for (size_t n = 0; n < files.size(); n++)
         mmaps[n].reset (new File::MMap (files[n], writable, !is_new, bytes_per_segment));
-        addresses[n].reset (mmaps[n]->address());
+
+      // determine whether to stream the image, and if so, the number and size
+      // of the slabs, and the number held in memory at any one time; 1-bit
+      // images are excluded, since each segment must hold whole bytes:
+      const int64_t window = stream_window();
+      size_t num_slabs = 0, window_slabs = 0;
+      int64_t slab_bytes = 0;
+      if (window && int64_t (files.size()) * bytes_per_segment > window &&
+          header.datatype().bits() > 1 && mmaps[0]->is_mapped()) {
+        if (files.size() == 1) {
+          const int64_t bytes_per_voxel = header.datatype().bytes();
+          const size_t slab_voxels = std::max (window / (8 * bytes_per_voxel), int64_t(1));
+          num_slabs = (segsize + slab_voxels - 1) / slab_voxels;
+          slab_bytes = slab_voxels * bytes_per_voxel;
+          window_slabs = 8;
+          segsize = slab_voxels;
+        }
+        else if (4 * bytes_per_segment <= window) {
+          num_slabs = files.size();
+          slab_bytes = bytes_per_segment;
+          window_slabs = window / bytes_per_segment;
+        }
+      }
+
+      if (!num_slabs) {
+        addresses.resize (mmaps.size());
+        for (size_t n = 0; n < mmaps.size(); n++)
+          addresses[n].reset (mmaps[n]->address());
+        return;
       }
+
+      DEBUG ("streaming image \"" + header.name() + "\" as " + str(num_slabs) + " slabs of "
+          + str(slab_bytes) + " bytes, " + str(window_slabs) + " at a time");
+      addresses.resize (num_slabs);
+      for (size_t n = 0; n < num_slabs; ++n)
+        addresses[n].reset (files.size() > 1 ? mmaps[n]->address() : mmaps[0]->address() + n*slab_bytes);
+      segment_ready.reset (new std::atomic<bool> [num_slabs]);
+      for (size_t n = 0; n < num_slabs; ++n)
+        segment_ready[n] = false;
+      stream = std::make_shared<Stream> (mmaps, segment_ready.get(), num_slabs, slab_bytes, window_slabs, !is_new);
+    }
+
+
+
+    void Default::load_segment (size_t n) const
+    {
+      assert (stream);
+      std::lock_guard<std::mutex> lock (stream->mutex);
+      if (segment_ready[n].load (std::memory_order_relaxed))
+        return;
+      stream->access (n);
+      segment_ready[n].store (true, std::memory_order_release);
     }
 
 
@@ -100,10 +279,12 @@ namespace MR
 
       if (is_new) memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
       else {
-        for (size_t n = 0; n < files.size(); n++) {
-          File::MMap file (files[n], false, false, bytes_per_segment);
-          memcpy (addresses[0].get() + n*bytes_per_segment, file.address(), bytes_per_segment);
-        }
+        uint8_t* const data = addresses[0].get();
+        const int64_t size = bytes_per_segment;
+        for_each_file (files.size(), [&] (size_t n) {
+            File::MMap file (files[n], false, false, size);
+            memcpy (data + n*size, file.address(), size);
+            });
       }
 
       if (addresses.size() > 1)
@@ -112,7 +293,22 @@ namespace MR
       else segsize = std::numeric_limits<size_t>::max();
     }
 
-  }
-}
 
 
+
+    void Default::write_back (const Header& header)
+    {
+      DEBUG ("writing back contents of image \"" + header.name() + "\"...");
+      const uint8_t* const data = addresses[0].get();
+      const int64_t size = bytes_per_segment;
+      for_each_file (files.size(), [&] (size_t n) {
+          File::OFStream out (files[n].name, std::ios::in | std::ios::out | std::ios::binary);
+          out.seekp (files[n].start, out.beg);
+          out.write ((const char*) (data + n*size), size);
+          if (!out.good())
+            throw Exception ("error writing back contents of file \"" + files[n].name + "\": " + strerror(errno));
+          });
+    }
+
+  }
+}
@@ -26,6 +26,18 @@ namespace MR
   namespace ImageIO
   {
 
+    //! the default handler for uncompressed images stored in one or more files
+    /*! Files are memory-mapped where possible, and otherwise copied into RAM.
+     *
+     * If the ImageIOStreamWindow config file option is set, memory-mapped
+     * images larger than that window are instead streamed: they are divided
+     * into slabs, each exposed as a separate segment, and the first access to
+     * each slab moves the streaming cursor forward. The OS is then asked to
+     * read in the next few slabs ahead of the cursor, while those that have
+     * fallen behind it are written back asynchronously and removed from the
+     * resident set of the process. If a slab is accessed again once removed,
+     * the image is not being processed sequentially, and the handler stops
+     * removing slabs for the remainder of its lifetime. */
     class Default : public Base
     { NOMEMALIGN
       public:
@@ -36,14 +48,19 @@ namespace MR
         Default& operator=(Default&&) = delete;
 
       protected:
+        class Stream;
+
         vector<std::shared_ptr<File::MMap> > mmaps;
         int64_t bytes_per_segment;
+        std::shared_ptr<Stream> stream;
 
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
+        virtual void load_segment (size_t) const;
 
         void map_files (const Header&);
         void copy_to_mem (const Header&);
+        void write_back (const Header&);
 
     };
 
@@ -21,6 +21,7 @@
 #include "header.h"
 #include "image_io/gz.h"
 #include "file/gz.h"
+#include "file/gz_block.h"
 
 #define BYTES_PER_ZCALL 524288
 
@@ -50,7 +51,17 @@ namespace MR
       else {
         ProgressBar progress ("uncompressing image \"" + header.name() + "\"",
             files.size() * bytes_per_segment / BYTES_PER_ZCALL);
+        size_t bytes_done = 0;
+        auto update_progress = [&] (size_t bytes) {
+          for (bytes_done += bytes; bytes_done >= BYTES_PER_ZCALL; bytes_done -= BYTES_PER_ZCALL)
+            ++progress;
+        };
         for (size_t n = 0; n < files.size(); n++) {
+          // files written by MRtrix3 are block-compressed, and can be
+          // uncompressed in parallel; otherwise use a regular gzip stream:
+          if (File::GZBlock::read (files[n].name, files[n].start,
+                addresses[0].get() + n*bytes_per_segment, bytes_per_segment, update_progress))
+            continue;
           File::GZ zf (files[n].name, "rb");
           zf.seek (files[n].start);
           uint8_t* address = addresses[0].get() + n*bytes_per_segment;
@@ -82,23 +93,18 @@ namespace MR
 
         if (writable) {
           ProgressBar progress ("compressing image \"" + header.name() + "\"",
-              files.size() * bytes_per_segment / BYTES_PER_ZCALL);
+              files.size() * (lead_in_size + bytes_per_segment + lead_out_size) / BYTES_PER_ZCALL);
+          size_t bytes_done = 0;
+          auto update_progress = [&] (size_t bytes) {
+            for (bytes_done += bytes; bytes_done >= BYTES_PER_ZCALL; bytes_done -= BYTES_PER_ZCALL)
+              ++progress;
+          };
           for (size_t n = 0; n < files.size(); n++) {
             assert (files[n].start == int64_t (lead_in_size));
-            File::GZ zf (files[n].name, "wb");
-            if (lead_in)
-              zf.write (reinterpret_cast<const char*> (lead_in.get()), lead_in_size);
-            uint8_t* address = addresses[0].get() + n*bytes_per_segment;
-            uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
-            while (address < last) {
-              zf.write (reinterpret_cast<const char*> (address), BYTES_PER_ZCALL);
-              address += BYTES_PER_ZCALL;
-              ++progress;
-            }
-            last += BYTES_PER_ZCALL;
-            zf.write (reinterpret_cast<const char*> (address), last - address);
-            if (lead_out)
-              zf.write (reinterpret_cast<const char*> (lead_out.get()), lead_out_size);
+            File::GZBlock::write (files[n].name, {
+                { lead_in.get(), lead_in_size },
+                { addresses[0].get() + n*bytes_per_segment, bytes_per_segment },
+                { lead_out.get(), lead_out_size } }, update_progress);
           }
         }
 
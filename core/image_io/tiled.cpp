@@ -0,0 +1,414 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <zlib.h>
+
+#include "header.h"
+#include "progressbar.h"
+#include "raw.h"
+#include "stride.h"
+#include "thread.h"
+#include "ordered_thread_queue.h"
+#include "file/mmap.h"
+#include "file/ofstream.h"
+#include "file/utils.h"
+#include "image_io/tiled.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    namespace {
+
+      // geometry of the chunk grid, and mapping of each chunk onto the
+      // regular strided buffer:
+      class ChunkLayout { NOMEMALIGN
+        public:
+          ChunkLayout (const Header& header, const vector<size_t>& chunk_size) :
+            size (header.ndim()),
+            chunk (header.ndim()),
+            grid (header.ndim()),
+            stride (Stride::get_actual (header)),
+            bytes (header.datatype().bytes()),
+            num_chunks (1)
+          {
+            if (chunk_size.size() != header.ndim())
+              throw Exception ("chunk dimensions do not match those of image \"" + header.name() + "\"");
+            origin = Stride::offset (stride, header);
+            for (size_t n = 0; n < header.ndim(); ++n) {
+              size[n] = header.size (n);
+              chunk[n] = std::max (std::min (chunk_size[n], size[n]), size_t(1));
+              grid[n] = (size[n] + chunk[n] - 1) / chunk[n];
+              num_chunks *= grid[n];
+              axes.push_back (n);
+            }
+            std::sort (axes.begin(), axes.end(), [&] (size_t a, size_t b) { return abs (stride[a]) < abs (stride[b]); });
+            assert (abs (stride[axes[0]]) == 1);
+          }
+
+          const size_t index_size () const { return 2 * sizeof (uint64_t) * num_chunks; }
+
+          //! the number of segments the buffer is divided into, each spanning
+          //! one row of chunks along the axis with the largest stride
+          size_t num_segments () const { return grid[axes.back()]; }
+          //! the number of bytes in each (but the last) segment of the buffer
+          size_t segment_bytes () const { return chunk[axes.back()] * abs (stride[axes.back()]) * bytes; }
+
+          //! the chunks holding any of the voxels in segment s
+          vector<size_t> segment_chunks (size_t s) const {
+            const size_t outer = axes.back();
+            const size_t first_row = s * chunk[outer];
+            const size_t last_row = std::min (first_row + chunk[outer], size[outer]) - 1;
+            // rows of the buffer run in reverse order for negative strides:
+            size_t from = stride[outer] > 0 ? first_row : size[outer]-1 - last_row;
+            size_t to = stride[outer] > 0 ? last_row : size[outer]-1 - first_row;
+            from /= chunk[outer];
+            to /= chunk[outer];
+            size_t inner_chunks = 1;
+            for (size_t n = 0; n < outer; ++n)
+              inner_chunks *= grid[n];
+            vector<size_t> list;
+            for (size_t c = 0; c < num_chunks; ++c) {
+              const size_t k = (c / inner_chunks) % grid[outer];
+              if (k >= from && k <= to)
+                list.push_back (c);
+            }
+            return list;
+          }
+
+          //! the size of chunk c in bytes, and its extent in voxels along each axis
+          size_t extent (size_t c, vector<size_t>& from, vector<size_t>& to) const {
+            from.resize (size.size());
+            to.resize (size.size());
+            size_t voxels = 1;
+            for (size_t n = 0; n < size.size(); ++n) {
+              from[n] = (c % grid[n]) * chunk[n];
+              to[n] = std::min (from[n] + chunk[n], size[n]);
+              voxels *= to[n] - from[n];
+              c /= grid[n];
+            }
+            return voxels * bytes;
+          }
+
+          //! invoke func (buffer byte offset, row bytes) for each contiguous
+          //! row of chunk c, in the order in which they are stored on file
+          template <class Functor>
+            void for_each_row (size_t c, Functor&& func) const {
+              vector<size_t> from, to;
+              extent (c, from, to);
+              const size_t inner = axes[0];
+              const size_t row_bytes = (to[inner] - from[inner]) * bytes;
+              const size_t row_start = stride[inner] > 0 ? from[inner] : to[inner] - 1;
+              vector<size_t> pos (from);
+              while (true) {
+                ssize_t offset = origin + ssize_t (row_start) * stride[inner];
+                for (size_t n = 1; n < axes.size(); ++n)
+                  offset += ssize_t (pos[axes[n]]) * stride[axes[n]];
+                func (offset * bytes, row_bytes);
+                size_t n = 1;
+                for (; n < axes.size(); ++n) {
+                  if (++pos[axes[n]] < to[axes[n]])
+                    break;
+                  pos[axes[n]] = from[axes[n]];
+                }
+                if (n == axes.size())
+                  return;
+              }
+            }
+
+        private:
+          vector<size_t> size, chunk, grid, axes;
+          Stride::List stride;
+          size_t origin, bytes;
+        public:
+          size_t num_chunks;
+      };
+
+
+
+      class EncodedChunk { NOMEMALIGN
+        public:
+          size_t index;
+          vector<uint8_t> data;
+      };
+
+
+
+      class Encoder { NOMEMALIGN
+        public:
+          Encoder (const ChunkLayout& layout, const uint8_t* buffer, bool compressed) :
+            layout (layout), buffer (buffer), compressed (compressed) { }
+
+          bool operator() (const EncodedChunk& in, EncodedChunk& out) {
+            vector<size_t> from, to;
+            const size_t nbytes = layout.extent (in.index, from, to);
+            out.index = in.index;
+            raw.resize (nbytes);
+            uint8_t* p = raw.data();
+            layout.for_each_row (in.index, [&] (size_t offset, size_t row_bytes) {
+                memcpy (p, buffer + offset, row_bytes);
+                p += row_bytes;
+                });
+            if (!compressed) {
+              std::swap (out.data, raw);
+              return true;
+            }
+            uLongf compressed_size = compressBound (nbytes);
+            out.data.resize (compressed_size);
+            if (compress2 (out.data.data(), &compressed_size, raw.data(), nbytes, Z_DEFAULT_COMPRESSION) != Z_OK)
+              throw Exception ("error compressing image chunk " + str(in.index));
+            out.data.resize (compressed_size);
+            return true;
+          }
+
+        private:
+          const ChunkLayout& layout;
+          const uint8_t* buffer;
+          const bool compressed;
+          vector<uint8_t> raw;
+      };
+
+
+
+      // decodes the given chunks, copying only those voxels that lie within
+      // bytes [begin, end) of the buffer:
+      class Decoder { NOMEMALIGN
+        public:
+          Decoder (const ChunkLayout& layout, const File::MMap& file, bool compressed,
+              uint8_t* buffer, size_t begin, size_t end, const vector<size_t>& list, std::atomic<size_t>& next) :
+            layout (layout), index (file.address()), data (file.address() + layout.index_size()),
+            data_size (file.size() - layout.index_size()), compressed (compressed),
+            buffer (buffer), begin (begin), end (end), list (list), next (next) { }
+
+          void execute () {
+            size_t n;
+            while ((n = next++) < list.size())
+              decode (list[n]);
+          }
+
+        private:
+          const ChunkLayout& layout;
+          const uint8_t* index;
+          const uint8_t* data;
+          const int64_t data_size;
+          const bool compressed;
+          uint8_t* buffer;
+          const size_t begin, end;
+          const vector<size_t>& list;
+          std::atomic<size_t>& next;
+          vector<uint8_t> raw;
+          vector<size_t> from, to;
+
+          void decode (size_t c) {
+            const uint64_t offset = Raw::fetch_LE<uint64_t> (index, 2*c);
+            const uint64_t stored_size = Raw::fetch_LE<uint64_t> (index, 2*c+1);
+            if (offset + stored_size > uint64_t (data_size))
+              throw Exception ("chunk " + str(c) + " lies beyond end of file");
+            const size_t nbytes = layout.extent (c, from, to);
+            const uint8_t* p = data + offset;
+            if (compressed) {
+              raw.resize (nbytes);
+              uLongf decoded_size = nbytes;
+              if (uncompress (raw.data(), &decoded_size, p, stored_size) != Z_OK || decoded_size != nbytes)
+                throw Exception ("error uncompressing image chunk " + str(c));
+              p = raw.data();
+            }
+            else if (stored_size != nbytes)
+              throw Exception ("unexpected size for image chunk " + str(c));
+
+            layout.for_each_row (c, [&] (size_t row_offset, size_t row_bytes) {
+                const size_t lower = std::max (row_offset, begin);
+                const size_t upper = std::min (row_offset + row_bytes, end);
+                if (lower < upper)
+                  memcpy (buffer + lower, p + (lower - row_offset), upper - lower);
+                p += row_bytes;
+                });
+          }
+      };
+
+    }
+
+
+
+
+    class Tiled::Chunks { NOMEMALIGN
+      public:
+        Chunks (const Header& header, const vector<size_t>& chunk_size, const File::Entry& entry, bool is_new) :
+            layout (header, chunk_size),
+            total_bytes (footprint (header)),
+            mutex (new std::mutex [layout.num_segments()])
+        {
+          if (is_new)
+            return;
+          file.reset (new File::MMap (entry));
+          if (file->size() < int64_t (layout.index_size()))
+            throw Exception ("tiled image \"" + header.name() + "\" is truncated");
+        }
+
+        const ChunkLayout layout;
+        const size_t total_bytes;
+        // the mapped file, or nullptr if the image is new:
+        std::unique_ptr<File::MMap> file;
+        // one per segment, held while that segment is being loaded:
+        std::unique_ptr<std::mutex[]> mutex;
+    };
+
+
+
+
+    void Tiled::load (const Header& header, size_t)
+    {
+      if (files.size() != 1)
+        throw Exception ("tiled image \"" + header.name() + "\" must be stored in a single file");
+
+      const int64_t bytes = footprint (header);
+      if (double (bytes) >= double (std::numeric_limits<size_t>::max()))
+        throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
+
+      chunks = std::make_shared<Chunks> (header, chunk_size, files[0], is_new);
+      const ChunkLayout& layout (chunks->layout);
+      DEBUG ("opening tiled image \"" + header.name() + "\" (" + str(layout.num_chunks) + " chunks, "
+          + str(layout.num_segments()) + " segments)...");
+
+      // pages of the buffer are only committed by the OS as segments are
+      // filled in:
+      const size_t num_segments = layout.num_segments();
+      addresses.resize (num_segments);
+      addresses[0].reset (new uint8_t [bytes]);
+      if (!addresses[0])
+        throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
+      for (size_t n = 1; n < num_segments; ++n)
+        addresses[n].reset (addresses[0].get() + n*layout.segment_bytes());
+      segsize = num_segments > 1 ? layout.segment_bytes() / header.datatype().bytes() : std::numeric_limits<size_t>::max();
+
+      segment_ready.reset (new std::atomic<bool> [num_segments]);
+      for (size_t n = 0; n < num_segments; ++n)
+        segment_ready[n] = false;
+    }
+
+
+
+
+    void Tiled::load_segment (size_t n) const
+    {
+      assert (chunks);
+      std::lock_guard<std::mutex> lock (chunks->mutex[n]);
+      if (segment_ready[n].load (std::memory_order_relaxed))
+        return;
+
+      const ChunkLayout& layout (chunks->layout);
+      const size_t begin = n * layout.segment_bytes();
+      const size_t end = std::min (begin + layout.segment_bytes(), chunks->total_bytes);
+      uint8_t* buffer = addresses[0].get();
+
+      if (!chunks->file) {
+        memset (buffer + begin, 0, end - begin);
+      }
+      else {
+        const vector<size_t> list = layout.segment_chunks (n);
+        DEBUG ("decoding " + str(list.size()) + " chunks for segment " + str(n) + " of tiled image \"" + chunks->file->name() + "\"");
+        std::atomic<size_t> next (0);
+        Decoder decoder (layout, *chunks->file, compressed, buffer, begin, end, list, next);
+        const size_t num_threads = std::min (Thread::threads_to_execute(), list.size());
+        if (num_threads > 1) {
+          auto threads = Thread::run (Thread::multi (decoder, num_threads), "tiled image decoder");
+          threads.wait();
+        }
+        else
+          decoder.execute();
+      }
+
+      segment_ready[n].store (true, std::memory_order_release);
+    }
+
+
+
+
+    void Tiled::unload (const Header& header)
+    {
+      if (addresses.empty())
+        return;
+      assert (addresses[0] && chunks);
+
+      // all but the first segment point into the buffer owned by the first:
+      for (size_t n = 1; n < addresses.size(); ++n)
+        addresses[n].release();
+
+      if (writable)
+        write_chunks (header);
+
+      chunks.reset();
+    }
+
+
+
+
+    void Tiled::write_chunks (const Header& header)
+    {
+      const ChunkLayout& layout (chunks->layout);
+      for (size_t n = 0; n < layout.num_segments(); ++n)
+        if (!segment_ready[n])
+          load_segment (n);
+      // release the mapping before the file is rewritten:
+      chunks->file.reset();
+
+      vector<uint8_t> index (layout.index_size());
+      uint64_t position = 0;
+
+      File::OFStream out (files[0].name, std::ios::in | std::ios::out | std::ios::binary);
+      out.seekp (files[0].start + layout.index_size(), out.beg);
+
+      ProgressBar progress ("encoding image \"" + header.name() + "\"", layout.num_chunks);
+      size_t next = 0;
+      auto source = [&] (EncodedChunk& chunk) {
+        if (next >= layout.num_chunks)
+          return false;
+        chunk.index = next++;
+        return true;
+      };
+      auto sink = [&] (const EncodedChunk& chunk) {
+        out.write (reinterpret_cast<const char*> (chunk.data.data()), chunk.data.size());
+        if (!out.good())
+          throw Exception ("error writing tiled image \"" + header.name() + "\": " + strerror (errno));
+        Raw::store_LE<uint64_t> (position, index.data(), 2*chunk.index);
+        Raw::store_LE<uint64_t> (chunk.data.size(), index.data(), 2*chunk.index+1);
+        position += chunk.data.size();
+        ++progress;
+        return true;
+      };
+      Thread::run_ordered_queue (source,
+          EncodedChunk(),
+          Thread::multi (Encoder (layout, addresses[0].get(), compressed)),
+          EncodedChunk(),
+          sink);
+
+      out.seekp (files[0].start, out.beg);
+      out.write (reinterpret_cast<const char*> (index.data()), index.size());
+      if (!out.good())
+        throw Exception ("error writing chunk index for tiled image \"" + header.name() + "\": " + strerror (errno));
+      out.close();
+
+      // discard any data left over from a previous, larger version of the file:
+      File::resize (files[0].name, files[0].start + layout.index_size() + position);
+    }
+
+  }
+}
+
@@ -0,0 +1,70 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __image_io_tiled_h__
+#define __image_io_tiled_h__
+
+#include "image_io/base.h"
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+    //! handler for images stored as a grid of independently compressed chunks
+    /*! The image data (starting at the offset given in the single
+     * File::Entry) consist of a chunk index, holding the byte offset
+     * (relative to the end of the index) and stored size of each chunk as
+     * pairs of little-endian 64-bit integers, followed by the chunk data.
+     * Chunks are ordered with the first image axis varying fastest; the
+     * voxels within each chunk are stored in the order given by the image
+     * strides. Each chunk is optionally zlib-compressed.
+     *
+     * The image is held in RAM as a regular strided buffer, divided into
+     * segments that each span one row of chunks along the axis with the
+     * largest stride. Each segment is only decoded (or zero-filled for new
+     * images) when first accessed, so that accessing part of an image only
+     * requires the corresponding chunks to be decoded. If the image is
+     * writable, any remaining segments are loaded and all chunks encoded
+     * concurrently on unload. */
+    class Tiled : public Base
+    { NOMEMALIGN
+      public:
+        Tiled (const Header& header, const vector<size_t>& chunk_size, bool compressed) :
+          Base (header),
+          chunk_size (chunk_size),
+          compressed (compressed) { }
+        Tiled (Tiled&&) = default;
+
+      protected:
+        class Chunks;
+
+        const vector<size_t> chunk_size;
+        const bool compressed;
+        std::shared_ptr<Chunks> chunks;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+        virtual void load_segment (size_t) const;
+
+        void write_chunks (const Header&);
+    };
+
+  }
+}
+
+#endif
+
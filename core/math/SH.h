@@ -503,6 +503,109 @@ namespace MR
 
 
 
+      //! evaluate SH series along a batch of directions
+      /*! The SH basis is computed for all directions in a single pass and
+       * stored with one column per direction, so that the amplitude of any
+       * SH series along one of these directions reduces to a single
+       * (vectorised) dot product, and its amplitudes along all directions to
+       * a single matrix-vector product. If a PrecomputedAL object is
+       * supplied, the associated Legendre polynomials are interpolated from
+       * its lookup table, as for PrecomputedAL::value(). */
+      template <typename ValueType> class Batch
+      { MEMALIGN(Batch<ValueType>)
+        public:
+          using value_type = ValueType;
+          using matrix_type = Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>;
+
+          Batch (int lmax, const PrecomputedAL<ValueType>* precomputer = nullptr) :
+              lmax (lmax),
+              precomputer (precomputer && *precomputer ? precomputer : nullptr),
+              AL (NforL_mpos (lmax)),
+              buf (lmax+1) { }
+
+          //! compute the SH basis for all (unit) directions in \a dirs
+          template <class DirectionList>
+            void set (const DirectionList& dirs) {
+              resize (dirs.size());
+              for (size_t n = 0; n < size_t(dirs.size()); ++n)
+                set (n, dirs[n]);
+            }
+
+          //! set the number of directions in the batch
+          /*! The basis for each direction must then be computed using
+           * set (n, unit_dir) before it is used. */
+          void resize (size_t num) {
+            basis.resize (NforL (lmax), num);
+          }
+
+          //! compute the SH basis for (unit) direction \a unit_dir at position \a n in the batch
+          template <class UnitVectorType>
+            void set (size_t n, const UnitVectorType& unit_dir) {
+              if (precomputer) {
+                PrecomputedFraction<ValueType> f;
+                precomputer->set (f, std::acos (unit_dir[2]));
+                const ssize_t nAL = AL.size();
+                if (f.f2)
+                  AL = f.f1 * Eigen::Map<const Eigen::Matrix<ValueType,Eigen::Dynamic,1>> (&*f.p1, nAL)
+                     + f.f2 * Eigen::Map<const Eigen::Matrix<ValueType,Eigen::Dynamic,1>> (&*f.p2, nAL);
+                else
+                  AL = f.f1 * Eigen::Map<const Eigen::Matrix<ValueType,Eigen::Dynamic,1>> (&*f.p1, nAL);
+              }
+              else {
+                for (int m = 0; m <= lmax; m++) {
+                  Legendre::Plm_sph (buf, lmax, m, ValueType (unit_dir[2]));
+                  for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2)
+                    AL[index_mpos (l,m)] = buf[l];
+                }
+              }
+
+              auto b = basis.col (n);
+              for (int l = 0; l <= lmax; l+=2)
+                b[index (l,0)] = AL[index_mpos (l,0)];
+              const ValueType rxy = std::sqrt (pow2(unit_dir[1]) + pow2(unit_dir[0]));
+              const ValueType cp = rxy ? unit_dir[0]/rxy : 1.0;
+              const ValueType sp = rxy ? unit_dir[1]/rxy : 0.0;
+              ValueType c = Math::sqrt2 * cp, s = Math::sqrt2 * sp;
+              for (int m = 1; m <= lmax; m++) {
+                for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+                  b[index (l,m)]  = AL[index_mpos (l,m)] * c;
+                  b[index (l,-m)] = AL[index_mpos (l,m)] * s;
+                }
+                const ValueType c_next = c * cp - s * sp;
+                s = s * cp + c * sp;
+                c = c_next;
+              }
+            }
+
+          //! the number of directions in the batch
+          size_t size () const { return basis.cols(); }
+
+          //! the amplitude of SH series \a coefs along direction \a n
+          template <class VectorType>
+            ValueType value (const VectorType& coefs, size_t n) const {
+              return basis.col (n).dot (coefs.head (basis.rows()));
+            }
+
+          //! the amplitudes of SH series \a coefs along all directions
+          template <class VectorType>
+            Eigen::Matrix<ValueType,Eigen::Dynamic,1> values (const VectorType& coefs) const {
+              return basis.transpose() * coefs.head (basis.rows());
+            }
+
+          //! the SH basis, with one column per direction
+          const matrix_type& matrix () const { return basis; }
+
+        protected:
+          const int lmax;
+          const PrecomputedAL<ValueType>* precomputer;
+          Eigen::Matrix<ValueType,Eigen::Dynamic,1> AL;
+          Eigen::Matrix<ValueType,Eigen::Dynamic,1,0,64> buf;
+          matrix_type basis;
+      };
+
+
+
+
 
 
       //! estimate direction & amplitude of SH peak
@@ -224,9 +224,9 @@ namespace MR
 
             Solver (const Problem<value_type>& problem) :
               P (problem),
-              BtB (P.chol_HtH.rows(), P.chol_HtH.cols()),
+              chol_BtB (P.B.rows(), P.B.rows()),
               B (P.B.rows(), P.B.cols()),
-              y_u (BtB.rows()),
+              y_u (P.chol_HtH.rows()),
               c (P.B.rows()),
               c_u (P.B.rows()),
               lambda (c.size()),
@@ -234,8 +234,85 @@ namespace MR
               l (lambda.size()),
               active (lambda.size(), false) { }
 
+            //! solve for the measurements \a b, starting from no active constraints
             size_t operator() (vector_type& x, const vector_type& b)
             {
+              return solve (x, b, false);
+            }
+
+            //! solve for the measurements \a b, starting from the given active set
+            /*! The set of constraints active at the solution of a closely
+             * related problem (e.g. that of an adjacent voxel) is typically
+             * close to that at the solution of this problem; starting from it
+             * can then considerably reduce the number of iterations required.
+             * The active set at the last solution can be obtained using
+             * active_set(). */
+            size_t operator() (vector_type& x, const vector_type& b, const vector<bool>& initial_active_set)
+            {
+              assert (initial_active_set.size() == active.size());
+              if (&initial_active_set != &active)
+                active = initial_active_set;
+              return solve (x, b, true);
+            }
+
+            //! the set of constraints active at the last solution
+            const vector<bool>& active_set () const { return active; }
+
+            const Problem<value_type>& problem () const { return P; }
+
+          protected:
+            const Problem<value_type>& P;
+            // Cholesky factor of B*B' over the active constraints, with the rows of
+            //   B and chol_BtB in the order listed in active_list; this is updated
+            //   as constraints enter / leave the active set, rather than
+            //   recomputed for every change
+            matrix_type chol_BtB, B;
+            vector_type y_u, c, c_u, lambda, lambda_prev, l, v;
+            vector<bool> active;
+            vector<size_t> active_list;
+
+            void activate (const size_t n)
+            {
+              const size_t k = active_list.size();
+              auto L = chol_BtB.topLeftCorner (k, k).template triangularView<Eigen::Lower>();
+              v.noalias() = B.topRows (k) * P.B.row (n).transpose();
+              L.solveInPlace (v);
+              value_type d2 = P.B.row (n).squaredNorm() + P.lambda_min_norm - v.squaredNorm();
+              d2 = std::max (d2, std::numeric_limits<value_type>::epsilon());
+              chol_BtB.row (k).head (k) = v.transpose();
+              chol_BtB (k, k) = std::sqrt (d2);
+              B.row (k) = P.B.row (n);
+              active_list.push_back (n);
+              active[n] = true;
+            }
+
+            void deactivate (const size_t n)
+            {
+              const size_t k = active_list.size();
+              const size_t p = std::find (active_list.begin(), active_list.end(), n) - active_list.begin();
+              assert (p < k);
+              // remove row p, and restore the lower triangular form using Givens
+              //   rotations between successive pairs of columns
+              for (size_t i = p; i+1 < k; ++i) {
+                chol_BtB.row (i).head (i+2) = chol_BtB.row (i+1).head (i+2);
+                B.row (i) = B.row (i+1);
+              }
+              for (size_t j = p; j+1 < k; ++j) {
+                const value_type a = chol_BtB (j, j), b = chol_BtB (j, j+1);
+                const value_type r = std::hypot (a, b);
+                const value_type cs = a / r, sn = b / r;
+                for (size_t i = j; i+1 < k; ++i) {
+                  const value_type x = chol_BtB (i, j), y = chol_BtB (i, j+1);
+                  chol_BtB (i, j) = cs * x + sn * y;
+                  chol_BtB (i, j+1) = cs * y - sn * x;
+                }
+              }
+              active_list.erase (active_list.begin() + p);
+              active[n] = false;
+            }
+
+            size_t solve (vector_type& x, const vector_type& b, const bool warm_start)
+            {
 #ifdef MRTRIX_ICLS_DEBUG
               std::ofstream l_stream ("l.txt");
               std::ofstream n_stream ("n.txt");
@@ -253,10 +330,15 @@ namespace MR
               // set all Lagrangian multipliers to zero:
               lambda.setZero();
               lambda_prev.setZero();
-              // set active set empty:
-              std::fill (active.begin(), active.end(), false);
+              // set active set empty, unless provided:
+              if (!warm_start)
+                std::fill (active.begin(), active.end(), false);
               if (num_eq > 0)
                 std::fill (active.begin() + num_ineq, active.end(), true);
+              active_list.clear();
+              for (size_t n = 0; n < active.size(); ++n)
+                if (active[n])
+                  activate (n);
 
               // initial estimate of constraint values:
               c = c_u;
@@ -264,31 +346,21 @@ namespace MR
               // initial estimate of solution:
               x = y_u;
 
-              size_t min_c_index;
-              size_t niter = 0;
-
-              while (c.head(num_ineq).minCoeff (&min_c_index) < -P.tol) {
-                bool active_set_changed = !active[min_c_index];
-                active[min_c_index] = true;
-
+              // solve for the Lagrange multipliers of the active set, removing
+              // constraints for which these are negative; returns whether any
+              // constraint was removed:
+              auto update_multipliers = [&] () {
+                bool removed = false;
                 while (1) {
-                  // form submatrix of active constraints:
-                  size_t num_active = 0;
-                  for (size_t n = 0; n < active.size(); ++n) {
-                    if (active[n]) {
-                      B.row (num_active) = P.B.row (n);
-                      l[num_active] = -c_u[n];
-                      ++num_active;
-                    }
-                  }
-                  auto B_active = B.topRows (num_active);
+                  const size_t num_active = active_list.size();
                   auto l_active = l.head (num_active);
+                  for (size_t a = 0; a < num_active; ++a)
+                    l_active[a] = -c_u[active_list[a]];
 
-                  BtB.resize (num_active, num_active);
-                  // solve for l in B*B'l = -c_u by Cholesky decomposition:
-                  BtB.template triangularView<Eigen::Lower>() = B_active * B_active.transpose();
-                  BtB.diagonal().array() += P.lambda_min_norm;
-                  BtB.template selfadjointView<Eigen::Lower>().llt().solveInPlace (l_active);
+                  // solve for l in B*B'l = -c_u using the Cholesky factor:
+                  auto L = chol_BtB.topLeftCorner (num_active, num_active).template triangularView<Eigen::Lower>();
+                  L.solveInPlace (l_active);
+                  L.transpose().solveInPlace (l_active);
 
                   // update lambda values in full vector
                   // and identify worst offender if any lambda < 0
@@ -296,27 +368,25 @@ namespace MR
                   // subset (i.e. l>=0):
                   value_type s_min = std::numeric_limits<value_type>::infinity();
                   size_t s_min_index = 0;
-                  size_t a = 0;
-                  for (size_t n = 0; n < num_ineq; ++n) {
-                    if (active[n]) {
-                      if (l_active[a] < 0.0) {
-                        value_type s = lambda_prev[n] / (lambda_prev[n] - l_active[a]);
-                        if (s < s_min) {
-                          s_min = s;
-                          s_min_index = n;
-                        }
+                  lambda.head (num_ineq).setZero();
+                  for (size_t a = 0; a < num_active; ++a) {
+                    const size_t n = active_list[a];
+                    if (n >= num_ineq)
+                      continue;
+                    if (l_active[a] < 0.0) {
+                      value_type s = lambda_prev[n] / (lambda_prev[n] - l_active[a]);
+                      if (s < s_min || (s == s_min && n < s_min_index)) {
+                        s_min = s;
+                        s_min_index = n;
                       }
-                      lambda[n] = l_active[a];
-                      ++a;
                     }
-                    else
-                      lambda[n] = 0.0;
+                    lambda[n] = l_active[a];
                   }
 
                   // if no lambda < 0, proceed:
                   if (!std::isfinite (s_min)) {
                     // update solution vector:
-                    x = y_u + B_active.transpose() * l_active;
+                    x = y_u + B.topRows (num_active).transpose() * l_active;
                     break;
                   }
 #ifdef MRTRIX_ICLS_DEBUG
@@ -325,10 +395,34 @@ namespace MR
 
                   // remove worst offending lambda from active set,
                   // and re-estimate remaining lambdas:
-                  if (active[s_min_index])
-                    active_set_changed = true;
-                  active[s_min_index] = false;
+                  deactivate (s_min_index);
+                  removed = true;
                 }
+                return removed;
+              };
+
+
+              size_t min_c_index;
+              size_t niter = 0;
+
+              // with a starting active set, solve for it prior to seeking
+              // the most violated constraint:
+              if (warm_start && std::find (active.begin(), active.begin() + num_ineq, true) != active.begin() + num_ineq) {
+                update_multipliers();
+                lambda_prev = lambda;
+                ++niter;
+                c = P.B * x;
+                if (P.t.size())
+                  c -= P.t;
+              }
+
+              while (c.head(num_ineq).minCoeff (&min_c_index) < -P.tol) {
+                bool active_set_changed = !active[min_c_index];
+                if (active_set_changed)
+                  activate (min_c_index);
+
+                if (update_multipliers())
+                  active_set_changed = true;
 
                 // store feasible subset of lambdas:
                 lambda_prev = lambda;
@@ -355,14 +449,6 @@ namespace MR
               P.chol_HtH.template triangularView<Eigen::Lower>().transpose().solveInPlace (x);
               return niter;
             }
-
-            const Problem<value_type>& problem () const { return P; }
-
-          protected:
-            const Problem<value_type>& P;
-            matrix_type BtB, B;
-            vector_type y_u, c, c_u, lambda, lambda_prev, l;
-            vector<bool> active;
         };
 
 
@@ -553,6 +553,15 @@ namespace MR
 
 
 
+        void TestBase::operator() (const vector<Shuffle>& shuffles, vector<matrix_type>& output) const
+        {
+          output.resize (shuffles.size());
+          for (size_t i = 0; i != shuffles.size(); ++i)
+            (*this) (shuffles[i].data, output[i]);
+        }
+
+
+
 
 
 
@@ -585,79 +594,119 @@ namespace MR
                                                 matrix_type& zstats) const
         {
           assert (size_t(shuffling_matrix.rows()) == num_inputs());
-          stats .resize (num_elements(), num_hypotheses());
-          zstats.resize (num_elements(), num_hypotheses());
+          // Use the same arithmetic as for a block of shuffles, such that the
+          //   default permutation yields precisely the same statistics either way
+          vector<Shuffle> shuffles (1);
+          shuffles[0].index = 0;
+          shuffles[0].data = shuffling_matrix;
+          vector<matrix_type> all_stats, all_zstats;
+          compute (shuffles, &all_stats, all_zstats);
+          stats.swap (all_stats[0]);
+          zstats.swap (all_zstats[0]);
+        }
+
+
+
+        void TestFixedHomoscedastic::operator() (const vector<Shuffle>& shuffles, vector<matrix_type>& output) const
+        {
+          compute (shuffles, nullptr, output);
+        }
+
+
+
+        void TestFixedHomoscedastic::compute (const vector<Shuffle>& shuffles, vector<matrix_type>* stats, vector<matrix_type>& zstats) const
+        {
+          const size_t num_shuffles = shuffles.size();
+          zstats.resize (num_shuffles);
+          for (auto& i : zstats)
+            i.resize (num_elements(), num_hypotheses());
+          if (stats) {
+            stats->resize (num_shuffles);
+            for (auto& i : *stats)
+              i.resize (num_elements(), num_hypotheses());
+          }
+          if (!num_shuffles)
+            return;
 
-          matrix_type Sy, lambdas, residuals, beta;
-          vector_type sse;
+          matrix_type stacked, RzY, products;
+          value_type stat;
 
           // Freedman-Lane for fixed design matrix case
           // Each hypothesis needs to be handled explicitly on its own
           for (size_t ih = 0; ih != c.size(); ++ih) {
 
-            // First, we perform permutation of the input data
             // In Freedman-Lane, the initial 'effective' regression against the nuisance
-            //   variables, and permutation of the data, are done in a single step
-#ifdef GLM_TEST_DEBUG
-            VAR (shuffling_matrix.rows());
-            VAR (shuffling_matrix.cols());
-            VAR (partitions[ih].Rz.rows());
-            VAR (partitions[ih].Rz.cols());
-            VAR (y.rows());
-            VAR (y.cols());
-#endif
-            Sy.noalias() = shuffling_matrix * partitions[ih].Rz * y;
-#ifdef GLM_TEST_DEBUG
-            VAR (Sy.rows());
-            VAR (Sy.cols());
-            VAR (pinvM.rows());
-            VAR (pinvM.cols());
-#endif
-            // Now, we regress this shuffled data against the full model
-            lambdas.noalias() = pinvM * Sy;
-#ifdef GLM_TEST_DEBUG
-            VAR (lambdas.rows());
-            VAR (lambdas.cols());
-            //VAR (matrix_type(c[ih]).rows());
-            //VAR (matrix_type(c[ih]).cols());
-            VAR (Rm.rows());
-            VAR (Rm.cols());
-            VAR (XtX[ih].rows());
-            VAR (XtX[ih].cols());
-            VAR (one_over_dof);
-#endif
-            const size_t dof = num_inputs() - partitions[ih].rank_x - partitions[ih].rank_z;
-            const default_type one_over_dof = 1.0 / default_type(dof);
-            sse = (Rm*Sy).colwise().squaredNorm();
+            //   variables, and permutation of the data, are done in a single step;
+            //   the shuffled data are then regressed against the full model.
+            // Rather than forming the shuffled data for each shuffle S, the rows of a
+            //   stacked matrix hold, for each shuffle, firstly c.pinv(M).S, which yields
+            //   the effect of interest, and secondly Rm.S, which yields the residuals of
+            //   the full model, when multiplied by the nuisance-regressed data Rz.y
+            const ssize_t num_beta = c[ih].matrix().rows();
+            const ssize_t stride = num_beta + num_inputs();
+            const matrix_type c_pinvM (c[ih].matrix() * pinvM);
+
+            // Process shuffles in sub-blocks, and elements in chunks, so that both the
+            //   stacked matrix and its product remain of modest size (~8MB) however
+            //   many inputs there are
+            const size_t shuffles_per_pass = std::max (size_t(1), size_t(1048576) / (stride * num_inputs()));
+            for (size_t first = 0; first < num_shuffles; first += shuffles_per_pass) {
+              const size_t pass_size = std::min (shuffles_per_pass, num_shuffles - first);
+              stacked.resize (pass_size * stride, num_inputs());
+              for (size_t i = 0; i != pass_size; ++i) {
+                assert (size_t(shuffles[first+i].data.rows()) == num_inputs());
+                stacked.middleRows (i * stride, num_beta).noalias() = c_pinvM * shuffles[first+i].data;
+                stacked.middleRows (i * stride + num_beta, num_inputs()).noalias() = Rm * shuffles[first+i].data;
+              }
 #ifdef GLM_TEST_DEBUG
-            VAR (dof);
-            VAR (one_over_dof);
-            VAR (sse.size());
+              VAR (stacked.rows());
+              VAR (stacked.cols());
+              VAR (one_over_dof[ih]);
 #endif
-            for (size_t ie = 0; ie != num_elements(); ++ie) {
-              beta.noalias() = c[ih].matrix() * lambdas.col (ie);
-              const default_type F = ((beta.transpose() * XtX[ih] * beta) (0,0) / c[ih].rank()) /
-                                     (one_over_dof * sse[ie]);
-              if (!std::isfinite (F)) {
-                stats  (ie, ih) = zstats (ie, ih) = value_type(0);
-              } else if (c[ih].is_F()) {
-                stats  (ie, ih) = F;
+
+              const size_t chunk_size = std::max (size_t(256), size_t(1048576) / stacked.rows());
+              for (size_t start = 0; start < num_elements(); start += chunk_size) {
+                const size_t count = std::min (chunk_size, num_elements() - start);
+                RzY.noalias() = partitions[ih].Rz * y.middleCols (start, count);
+                products.noalias() = stacked * RzY;
+                for (size_t i = 0; i != pass_size; ++i) {
+                  for (size_t ie = 0; ie != count; ++ie) {
+                    const auto beta = products.block (i * stride, ie, num_beta, 1);
+                    const default_type sse = products.block (i * stride + num_beta, ie, num_inputs(), 1).squaredNorm();
+                    statistic (ih, beta, sse, stats ? (*stats)[first+i] (start + ie, ih) : stat, zstats[first+i] (start + ie, ih));
+                  }
+                }
+              }
+            }
+
+          }
+        }
+
+
+
+        template <class BetaType>
+        void TestFixedHomoscedastic::statistic (const size_t ih, const BetaType& beta, const default_type sse, value_type& stat, value_type& zstat) const
+        {
+          const size_t dof = num_inputs() - partitions[ih].rank_x - partitions[ih].rank_z;
+          const default_type F = ((beta.transpose() * XtX[ih] * beta) (0,0) / c[ih].rank()) /
+                                 (one_over_dof[ih] * sse);
+          if (!std::isfinite (F)) {
+            stat = zstat = value_type(0);
+          } else if (c[ih].is_F()) {
+            stat = F;
 #ifdef MRTRIX_USE_ZSTATISTIC_LOOKUP
-                zstats (ie, ih) = stat2z->F2z (F, c[ih].rank(), dof);
+            zstat = stat2z->F2z (F, c[ih].rank(), dof);
 #else
-                zstats (ie, ih) = Math::F2z (F, c[ih].rank(), dof);
+            zstat = Math::F2z (F, c[ih].rank(), dof);
 #endif
-              } else {
-                assert (beta.rows() == 1);
-                stats  (ie, ih) = std::sqrt (F) * (beta.sum() > 0.0 ? 1.0 : -1.0);
+          } else {
+            assert (beta.rows() == 1);
+            stat = std::sqrt (F) * (beta.sum() > 0.0 ? 1.0 : -1.0);
 #ifdef MRTRIX_USE_ZSTATISTIC_LOOKUP
-                zstats (ie, ih) = stat2z->t2z (stats (ie, ih), dof);
+            zstat = stat2z->t2z (stat, dof);
 #else
-                zstats (ie, ih) = Math::t2z (stats (ie, ih), dof);
+            zstat = Math::t2z (stat, dof);
 #endif
-              }
-            }
-
           }
         }
 
@@ -24,6 +24,7 @@
 #include "math/least_squares.h"
 #include "math/zstatistic.h"
 #include "math/stats/import.h"
+#include "math/stats/shuffle.h"
 #include "math/stats/typedefs.h"
 
 #include "misc/bitset.h"
@@ -242,6 +243,15 @@ namespace MR
              */
             virtual void operator() (const matrix_type& shuffling_matrix, matrix_type& stat, matrix_type& zstat) const = 0;
 
+            /*! Compute Z-statistics for a block of shuffles
+             * @param shuffles the shuffles for which statistics are to be computed
+             * @param output the matrices containing the output Z-statistics (one per shuffle)
+             *
+             * By default, each shuffle is processed in turn; derived classes may instead
+             *   process the whole block using a small number of large matrix products
+             */
+            virtual void operator() (const vector<Shuffle>& shuffles, vector<matrix_type>& output) const;
+
 
             size_t num_inputs () const { return M.rows(); }
             size_t num_elements () const { return y.cols(); }
@@ -289,6 +299,17 @@ namespace MR
              */
             void operator() (const matrix_type& shuffling_matrix, matrix_type& stats, matrix_type& zstats) const override;
 
+            /*! Compute the Z-statistics for a block of shuffles
+             * @param shuffles the shuffles for which statistics are to be computed
+             * @param output the matrices containing the output Z-statistics (one per shuffle)
+             *
+             * The shuffling matrices for all shuffles are stacked, such that the
+             *   Freedman-Lane regression for each hypothesis is performed using a
+             *   single matrix product per block of elements; with many inputs, the
+             *   shuffles are stacked in smaller groups to limit memory usage
+             */
+            void operator() (const vector<Shuffle>& shuffles, vector<matrix_type>& output) const override;
+
           protected:
             // New classes to store information relevant to Freedman-Lane implementation
             vector<Hypothesis::Partition> partitions;
@@ -297,6 +318,15 @@ namespace MR
             vector<matrix_type> XtX;
             vector<default_type> one_over_dof;
 
+            // Compute statistics for any number of shuffles; the statistics themselves are
+            //   only written if stats is non-null
+            void compute (const vector<Shuffle>& shuffles, vector<matrix_type>* stats, vector<matrix_type>& zstats) const;
+
+            // Compute the statistic for one element & hypothesis, given the effect of interest
+            //   and the sum of squared errors of the full model fit
+            template <class BetaType>
+            void statistic (const size_t ih, const BetaType& beta, const default_type sse, value_type& stat, value_type& zstat) const;
+
         };
         //! @}
 
@@ -335,6 +365,9 @@ namespace MR
              */
             void operator() (const matrix_type& shuffling_matrix, matrix_type& stats, matrix_type& zstats) const override;
 
+            // The block implementation of TestFixedHomoscedastic does not apply here
+            void operator() (const vector<Shuffle>& shuffles, vector<matrix_type>& output) const override { TestBase::operator() (shuffles, output); }
+
           protected:
             // Variance group assignments
             const index_array_type& VG;
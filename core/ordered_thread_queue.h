@@ -64,6 +64,11 @@ namespace MR {
        ***********************************************************************/
 
 
+       // Unlike the regular run_queue() stages, these do not coalesce items
+       // into ThreadQueueBatchSize transfers: the sink stashes out-of-order
+       // items individually until their turn comes, which relies on each
+       // queue slot holding a single indexed item. Use Thread::batch() to
+       // amortise the per-item queue overhead instead.
        template <class Item> struct Type<__Ordered<Item>> { NOMEMALIGN
          using item = Item;
          using queue = Queue<__Ordered<Item>>;
@@ -86,19 +91,24 @@ namespace MR {
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           __StageStats& stats;
 
-           __Source (queue_t& queue, Functor& functor, const queued_t& item) :
+           __Source (queue_t& queue, Functor& functor, const queued_t& item, __StageStats& stats) :
              writer (queue),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<queued_t> (item)) { }
+             batch_size (__batch_size<queued_t> (item)),
+             stats (stats) { }
 
            void execute () {
              size_t count = 0;
+             __StageStats::Counts counts (stats);
              auto out = writer.placeholder();
              do {
                if (!func (out->item))
                  break;
                out->index = count++;
+               ++counts.items_out;
+               ++counts.transfers;
              } while (out.write());
            }
          };
@@ -125,21 +135,27 @@ namespace MR {
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           __StageStats& stats;
 
-           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const queued2_t& item2) :
+           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const queued2_t& item2, __StageStats& stats) :
              reader (queue_in),
              writer (queue_out),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<queued2_t> (item2)) { }
+             batch_size (__batch_size<queued2_t> (item2)),
+             stats (stats) { }
 
            void execute () {
+             __StageStats::Counts counts (stats);
              auto in = reader.placeholder();
              auto out = writer.placeholder();
              while (in.read()) {
+               ++counts.items_in;
                if (!func (in->item, out->item))
                  break;
                out->index = in->index;
                out.write();
+               ++counts.items_out;
+               counts.transfers += 2;
              }
            }
 
@@ -161,16 +177,21 @@ namespace MR {
 
            reader_t reader;
            functor_t func;
+           __StageStats& stats;
 
-           __Sink (queue_t& queue, Functor& functor) :
+           __Sink (queue_t& queue, Functor& functor, __StageStats& stats) :
              reader (queue),
-             func (__job<Functor>::functor (functor)) { }
+             func (__job<Functor>::functor (functor)),
+             stats (stats) { }
 
            void execute () {
              size_t expected = 0;
+             __StageStats::Counts counts (stats);
              auto in = reader.placeholder();
              std::set<queued_t*,CompareItems> buffer;
              while (in.read()) {
+               ++counts.items_in;
+               ++counts.transfers;
                if (in->index > expected) {
                  buffer.emplace (in.stash());
                  continue;
@@ -224,14 +245,17 @@ namespace MR {
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           __StageStats& stats;
 
-           __Source (queue_t& queue, Functor& functor, const passed_t& item) :
+           __Source (queue_t& queue, Functor& functor, const passed_t& item, __StageStats& stats) :
              writer (queue),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<passed_t> (item)) { }
+             batch_size (__batch_size<passed_t> (item)),
+             stats (stats) { }
 
            void execute () {
              size_t count = 0;
+             __StageStats::Counts counts (stats);
              auto out = writer.placeholder();
              bool stop = false;
              do {
@@ -244,6 +268,8 @@ namespace MR {
                  }
                }
                out->index = count++;
+               counts.items_out += out->item.size();
+               ++counts.transfers;
              } while (out.write() && !stop);
            }
          };
@@ -271,17 +297,21 @@ namespace MR {
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           __StageStats& stats;
 
-           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const passed2_t& item2) :
+           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const passed2_t& item2, __StageStats& stats) :
              reader (queue_in),
              writer (queue_out),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<passed2_t> (item2)) { }
+             batch_size (__batch_size<passed2_t> (item2)),
+             stats (stats) { }
 
            void execute () {
+             __StageStats::Counts counts (stats);
              auto in = reader.placeholder();
              auto out = writer.placeholder();
              while (in.read()) {
+               counts.items_in += in->item.size();
                out->item.resize (in->item.size());
                size_t k = 0;
                for (size_t n = 0; n < in->item.size(); ++n) {
@@ -290,6 +320,8 @@ namespace MR {
                }
                out->item.resize (k);
                out->index = in->index;
+               counts.items_out += k;
+               counts.transfers += 2;
                if (!out.write())
                  return;
              }
@@ -313,16 +345,21 @@ namespace MR {
 
            reader_t reader;
            functor_t func;
+           __StageStats& stats;
 
-           __Sink (queue_t& queue, Functor& functor) :
+           __Sink (queue_t& queue, Functor& functor, __StageStats& stats) :
              reader (queue),
-             func (__job<Functor>::functor (functor)) { }
+             func (__job<Functor>::functor (functor)),
+             stats (stats) { }
 
            void execute () {
              size_t expected = 0;
+             __StageStats::Counts counts (stats);
              auto in = reader.placeholder();
              std::set<queued_t*,CompareItems> buffer;
              while (in.read()) {
+               counts.items_in += in->item.size();
+               ++counts.transfers;
                if (in->index > expected) {
                  buffer.emplace (in.stash());
                  continue;
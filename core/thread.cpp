@@ -89,6 +89,45 @@ namespace MR
     }
 
 
+    bool queue_lock_free ()
+    {
+      //CONF option: ThreadQueueLockFree
+      //CONF default: 0 (false)
+      //CONF Use a lock-free ring buffer rather than a mutex-protected one for
+      //CONF the queues used in multi-threaded processing pipelines. This can
+      //CONF reduce contention when many threads feed into or read from the
+      //CONF same queue.
+      static const bool value = File::Config::get_bool ("ThreadQueueLockFree", false);
+      return value;
+    }
+
+
+    size_t queue_batch_size ()
+    {
+      //CONF option: ThreadQueueBatchSize
+      //CONF default: 16
+      //CONF The maximum number of items that multi-threaded processing
+      //CONF pipelines will send through each queue in a single transfer.
+      //CONF Set to 1 to send items one at a time.
+      static const size_t value = std::max (1, File::Config::get_int ("ThreadQueueBatchSize", 16));
+      return value;
+    }
+
+
+    std::chrono::milliseconds queue_batch_timeout ()
+    {
+      //CONF option: ThreadQueueBatchTimeout
+      //CONF default: 10
+      //CONF The maximum time (in milliseconds) that multi-threaded processing
+      //CONF pipelines will hold on to a partially filled batch of items
+      //CONF before sending it through the queue. This is checked whenever a
+      //CONF further item is added to the batch; stages that take longer
+      //CONF than this to produce each item send items one at a time.
+      static const std::chrono::milliseconds value (std::max (0, File::Config::get_int ("ThreadQueueBatchTimeout", 10)));
+      return value;
+    }
+
+
 
 
 
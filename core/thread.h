@@ -271,6 +271,25 @@ namespace MR
      * should run explicitly single-threaded. */
     size_t threads_to_execute ();
 
+    /*! whether Thread::Queue objects should use the lock-free backend by
+     * default, as specified in the variable ThreadQueueLockFree in the MRtrix
+     * configuration file.
+     * \sa thread_queue_backend */
+    bool queue_lock_free ();
+
+    /*! the maximum number of items that Thread::run_queue() will coalesce
+     * into a single queue transfer, as specified in the variable
+     * ThreadQueueBatchSize in the MRtrix configuration file.
+     * \sa thread_run_queue_batch */
+    size_t queue_batch_size ();
+
+    /*! the maximum time that Thread::run_queue() will hold on to a partially
+     * filled batch of items before sending it through the queue, as
+     * specified in the variable ThreadQueueBatchTimeout in the MRtrix
+     * configuration file.
+     * \sa thread_run_queue_batch */
+    std::chrono::milliseconds queue_batch_timeout ();
+
 
 
     //! used to request multiple threads of the corresponding functor
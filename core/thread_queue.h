@@ -18,11 +18,14 @@
 #define __mrtrix_thread_queue_h__
 
 #include <stack>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 #include "exception.h"
 #include "memory.h"
 #include "thread.h"
+#include "timer.h"
 
 #define MRTRIX_QUEUE_DEFAULT_CAPACITY 128
 #define MRTRIX_QUEUE_DEFAULT_BATCH_SIZE 128
@@ -64,6 +67,118 @@ namespace MR
         };
 
 
+
+      // bounded multi-producer / multi-consumer ring of item pointers, based
+      // on per-cell sequence numbers (D. Vyukov). Producers and consumers
+      // only contend on the atomic enqueue / dequeue positions, and can
+      // claim several consecutive cells with a single compare-and-swap.
+      template <class T>
+        class __LockFreeRing { NOMEMALIGN
+          public:
+            __LockFreeRing (size_t min_capacity) :
+              mask (round_up (min_capacity) - 1),
+              cells (new Cell [mask+1]),
+              enqueue_pos (0),
+              dequeue_pos (0) {
+                for (size_t n = 0; n <= mask; ++n)
+                  cells[n].sequence.store (n, std::memory_order_relaxed);
+              }
+
+            size_t capacity () const { return mask+1; }
+
+            //! push up to \a num items, returning the number actually pushed
+            size_t push (T* const* items, size_t num) {
+              size_t pos = enqueue_pos.load (std::memory_order_relaxed);
+              while (true) {
+                bool stale = false;
+                const size_t n = claimable (pos, num, 0, stale);
+                if (!n) {
+                  if (!stale)
+                    return 0;
+                  pos = enqueue_pos.load (std::memory_order_relaxed);
+                }
+                else if (enqueue_pos.compare_exchange_weak (pos, pos+n, std::memory_order_relaxed)) {
+                  for (size_t i = 0; i < n; ++i) {
+                    Cell& cell (cells[(pos+i) & mask]);
+                    cell.data = items[i];
+                    cell.sequence.store (pos+i+1, std::memory_order_release);
+                  }
+                  return n;
+                }
+              }
+            }
+
+            //! pop up to \a num items, returning the number actually popped
+            size_t pop (T** items, size_t num) {
+              size_t pos = dequeue_pos.load (std::memory_order_relaxed);
+              while (true) {
+                bool stale = false;
+                const size_t n = claimable (pos, num, 1, stale);
+                if (!n) {
+                  if (!stale)
+                    return 0;
+                  pos = dequeue_pos.load (std::memory_order_relaxed);
+                }
+                else if (dequeue_pos.compare_exchange_weak (pos, pos+n, std::memory_order_relaxed)) {
+                  for (size_t i = 0; i < n; ++i) {
+                    Cell& cell (cells[(pos+i) & mask]);
+                    items[i] = cell.data;
+                    cell.sequence.store (pos+i+mask+1, std::memory_order_release);
+                  }
+                  return n;
+                }
+              }
+            }
+
+            bool full () const {
+              const size_t pos = enqueue_pos.load (std::memory_order_relaxed);
+              return cells[pos & mask].sequence.load (std::memory_order_acquire) != pos;
+            }
+
+            bool empty () const {
+              const size_t pos = dequeue_pos.load (std::memory_order_relaxed);
+              return cells[pos & mask].sequence.load (std::memory_order_acquire) != pos+1;
+            }
+
+          private:
+            struct Cell { NOMEMALIGN
+              std::atomic<size_t> sequence;
+              T* data;
+            };
+
+            const size_t mask;
+            std::unique_ptr<Cell[]> cells;
+            // keep positions on separate cache lines to avoid false sharing:
+            char padding0[64];
+            std::atomic<size_t> enqueue_pos;
+            char padding1[64];
+            std::atomic<size_t> dequeue_pos;
+            char padding2[64];
+
+            // number of consecutive cells from pos whose sequence number
+            // matches the expected value (pos+offset for each cell):
+            size_t claimable (size_t pos, size_t num, size_t offset, bool& stale) const {
+              size_t n = 0;
+              for (; n < num && n <= mask; ++n) {
+                const size_t seq = cells[(pos+n) & mask].sequence.load (std::memory_order_acquire);
+                const ssize_t diff = ssize_t (seq) - ssize_t (pos+n+offset);
+                if (diff) {
+                  stale = !n && diff > 0;
+                  break;
+                }
+              }
+              return n;
+            }
+
+            static size_t round_up (size_t n) {
+              size_t c = 2;
+              while (c < n)
+                c <<= 1;
+              return c;
+            }
+        };
+
+
     }
 
     //! \endcond
@@ -293,6 +408,25 @@ namespace MR
      * }
      * \endcode
      *
+     * \section thread_queue_backend Queue backends
+     *
+     * By default, the queue protects its ring buffer with a single mutex,
+     * and uses condition variables to block writers when the queue is full,
+     * and readers when it is empty. When many threads access the same queue
+     * and the processing per item is small, contention for this mutex can
+     * become the bottleneck. The queue can instead be constructed with the
+     * Queue::LOCK_FREE backend, in which case writers and readers only
+     * synchronise via atomic operations on a bounded multi-producer /
+     * multi-consumer ring, and only fall back to blocking on a condition
+     * variable when the ring is full or empty respectively. Recycled items
+     * are likewise managed via a lock-free ring. The default backend for
+     * all queues can be selected using the ThreadQueueLockFree configuration
+     * file option.
+     *
+     * In both cases, the Writer::Items and Reader::Items classes can be used
+     * in place of the Writer::Item and Reader::Item classes to transfer
+     * several items per synchronisation operation.
+     *
      * \section thread_queue_rationale Rationale for the Writer, Reader, and Item member classes
      *
      * The motivation for the use of additional member classes to perform the
@@ -333,23 +467,39 @@ namespace MR
      */
      template <class T> class Queue { NOMEMALIGN
        public:
+         //! the synchronisation strategy used by the queue
+         /*! \sa thread_queue_backend */
+         enum backend_t { MUTEX, LOCK_FREE };
+
          //! Construct a Queue of items of type \c T
          /*! \param description a string identifying the queue for degugging purposes
           * \param buffer_size the maximum number of items that can be pushed onto the queue before
           * blocking. If a thread attempts to push more data onto the queue when the
           * queue already contains this number of items, the thread will block until
           * at least one item has been popped.  By default, the buffer size is
-          * MRTRIX_QUEUE_DEFAULT_CAPACITY items.
+          * MRTRIX_QUEUE_DEFAULT_CAPACITY items. With the LOCK_FREE backend, this
+          * is rounded up to the next power of two.
+          * \param backend the synchronisation strategy to use; by default, this
+          * is set by the ThreadQueueLockFree configuration file option.
           */
-         Queue (const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
-           buffer (new T* [buffer_size]),
+         Queue (const std::string& description = "unnamed",
+                size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY,
+                backend_t backend = (queue_lock_free() ? LOCK_FREE : MUTEX)) :
+           buffer (backend == MUTEX ? new T* [buffer_size] : nullptr),
            front (buffer),
            back (buffer),
            capacity (buffer_size),
            writer_count (0),
            reader_count (0),
+           readers_waiting (0),
+           writers_waiting (0),
            name (description) {
              assert (capacity > 0);
+             if (backend == LOCK_FREE) {
+               ring.reset (new __LockFreeRing<T> (buffer_size));
+               spare.reset (new __LockFreeRing<T> (2*ring->capacity()));
+               DEBUG ("using lock-free backend for queue \"" + name + "\"");
+             }
            }
 
          Queue (const Queue&) = delete;
@@ -427,6 +577,41 @@ namespace MR
 
              Item placeholder () const { return Item (*this); }
 
+             //! This class is used to write several items to the queue at once
+             /*! This behaves as the Writer::Item class, but holds \a batch_size
+              * items, all of which are pushed onto the queue in a single
+              * synchronisation operation. As with Writer::Item, there should
+              * only be one Writer::Items object per Writer, and it will
+              * unregister from the queue on destruction.
+              *
+              * \sa Thread::Queue for more detailed information. */
+             class Items { NOMEMALIGN
+               public:
+                 Items (const Writer& writer, size_t batch_size) : Q (writer.Q), p (batch_size) {
+                   for (auto& item : p)
+                     item = Q.get_item();
+                 }
+                 ~Items () {
+                   Q.unregister_writer();
+                 }
+
+                 using item_type = T;
+
+                 //! Push the first \a num items onto the queue
+                 /*! Defaults to pushing all items held. The items pushed are
+                  * replaced by fresh (or recycled) items. */
+                 FORCE_INLINE bool write (size_t num) {
+                   assert (num <= p.size());
+                   return Q.push (p.data(), num);
+                 }
+                 FORCE_INLINE bool write () { return write (p.size()); }
+                 FORCE_INLINE size_t size () const { return p.size(); }
+                 FORCE_INLINE T& operator[] (size_t n) const { return *p[n]; }
+               private:
+                 Queue<T>& Q;
+                 vector<T*> p;
+             };
+
            private:
              Queue<T>& Q;
          };
@@ -508,6 +693,38 @@ namespace MR
 
              Item placeholder () const { return Item (*this); }
 
+             //! This class is used to read several items from the queue at once
+             /*! This behaves as the Reader::Item class, but reads up to \a
+              * batch_size items in a single synchronisation operation. As with
+              * Reader::Item, there should only be one Reader::Items object per
+              * Reader, and it will unregister from the queue on destruction.
+              *
+              * \sa Thread::Queue for more detailed information. */
+             class Items { NOMEMALIGN
+               public:
+                 Items (const Reader& reader, size_t batch_size) : Q (reader.Q), p (batch_size, nullptr), num (0) { }
+                 ~Items () {
+                   Q.unregister_reader();
+                 }
+
+                 using item_type = T;
+
+                 //! Get the next items from the queue
+                 /*! This will recycle any items previously read, and block until at
+                  * least one item is available. Returns the number of items read,
+                  * which will be zero once the queue is finished. */
+                 FORCE_INLINE size_t read () {
+                   num = Q.pop (p.data(), num, p.size());
+                   return num;
+                 }
+                 FORCE_INLINE size_t size () const { return num; }
+                 FORCE_INLINE T& operator[] (size_t n) const { return *p[n]; }
+               private:
+                 Queue<T>& Q;
+                 vector<T*> p;
+                 size_t num;
+             };
+
            private:
              Queue<T>& Q;
          };
@@ -517,7 +734,8 @@ namespace MR
            std::lock_guard<std::mutex> lock (mutex);
            std::cerr << "Thread::Queue \"" + name + "\": "
              << writer_count << " writer" << (writer_count > 1 ? "s" : "") << ", "
-             << reader_count << " reader" << (reader_count > 1 ? "s" : "") << ", items waiting: " << size() << "\n";
+             << reader_count << " reader" << (reader_count > 1 ? "s" : "") << ", items waiting: "
+             << (ring ? (ring->empty() ? "none" : "some") : str(size())) << "\n";
          }
 
 
@@ -528,9 +746,11 @@ namespace MR
          T** front;
          T** back;
          size_t capacity;
-         size_t writer_count, reader_count;
+         std::atomic<size_t> writer_count, reader_count;
+         std::atomic<size_t> readers_waiting, writers_waiting;
          std::stack<T*,vector<T*> > item_stack;
          vector<std::unique_ptr<T>> items;
+         std::unique_ptr<__LockFreeRing<T>> ring, spare;
          std::string name;
 
          void register_writer ()   {
@@ -570,49 +790,158 @@ namespace MR
            return ( (back < front ? back+capacity : back) - front);
          }
 
-         FORCE_INLINE T* get_item () {
-           std::lock_guard<std::mutex> lock (mutex);
-           T* item (new T);
+         // obtain a fresh item, recycling previously used items if possible:
+         FORCE_INLINE T* new_item () {
+           T* item;
+           if (spare && spare->pop (&item, 1))
+             return item;
+           if (!item_stack.empty()) {
+             item = item_stack.top();
+             item_stack.pop();
+             return item;
+           }
+           item = new T;
            items.push_back (std::unique_ptr<T> (item));
            return item;
          }
 
+         FORCE_INLINE void recycle_item (T* item) {
+           if (spare && spare->push (&item, 1))
+             return;
+           item_stack.push (item);
+         }
+
+         FORCE_INLINE T* get_item () {
+           std::lock_guard<std::mutex> lock (mutex);
+           return new_item();
+         }
+
          FORCE_INLINE bool push (T*& item) {
+           return push (&item, 1);
+         }
+
+         FORCE_INLINE bool pop (T*& item) {
+           return pop (&item, item ? 1 : 0, 1);
+         }
+
+         FORCE_INLINE void recycle (T*& item) {
+           if (!item)
+             return;
+           if (spare && spare->push (&item, 1))
+             return;
+           std::lock_guard<std::mutex> lock (mutex);
+           item_stack.push (item);
+         }
+
+         // push the first num items, replacing them with fresh ones:
+         bool push (T** item, size_t num) {
+           if (ring)
+             return push_lock_free (item, num);
+
            std::unique_lock<std::mutex> lock (mutex);
-           more_space.wait (lock, [this]{ return !(full() && reader_count); });
-           if (!reader_count) return false;
-           *back = item;
-           back = inc (back);
-           if (item_stack.empty()) {
-             item = new T;
-             items.push_back (std::unique_ptr<T> (item));
-           }
-           else {
-             item = item_stack.top();
-             item_stack.pop();
+           for (size_t n = 0; n < num; ++n) {
+             more_space.wait (lock, [this]{ return !(full() && reader_count); });
+             if (!reader_count) return false;
+             *back = item[n];
+             back = inc (back);
+             item[n] = new_item();
+             if (num > 1)
+               more_data.notify_all();
+             else
+               more_data.notify_one();
            }
-           more_data.notify_one();
            return true;
          }
 
-         FORCE_INLINE bool pop (T*& item) {
+         // recycle the first num_recycle items, then pop up to max_num items:
+         size_t pop (T** item, size_t num_recycle, size_t max_num) {
+           if (ring)
+             return pop_lock_free (item, num_recycle, max_num);
+
            std::unique_lock<std::mutex> lock (mutex);
-           if (item)
-             item_stack.push (item);
-           item = nullptr;
+           for (size_t n = 0; n < num_recycle; ++n)
+             if (item[n])
+               item_stack.push (item[n]);
+           item[0] = nullptr;
            more_data.wait (lock, [this]{ return !(empty() && writer_count); });
-           if (empty() && !writer_count)
-             return false;
-           item = *front;
-           front = inc (front);
-           more_space.notify_one();
+           size_t n = 0;
+           while (n < max_num && !empty()) {
+             item[n++] = *front;
+             front = inc (front);
+           }
+           if (n > 1)
+             more_space.notify_all();
+           else if (n)
+             more_space.notify_one();
+           return n;
+         }
+
+         bool push_lock_free (T** item, size_t num) {
+           size_t n = 0;
+           while (n < num) {
+             if (!reader_count)
+               return false;
+             const size_t pushed = ring->push (item+n, num-n);
+             if (pushed) {
+               for (size_t i = n; i < n+pushed; ++i) {
+                 if (!spare->pop (item+i, 1)) {
+                   std::lock_guard<std::mutex> lock (mutex);
+                   item[i] = new_item();
+                 }
+               }
+               n += pushed;
+               notify (more_data, readers_waiting);
+             }
+             else
+               wait (more_space, writers_waiting, [this]{ return !ring->full() || !reader_count; });
+           }
            return true;
          }
 
-         FORCE_INLINE void recycle (T*& item) {
-           std::unique_lock<std::mutex> lock (mutex);
-           if (item)
-             item_stack.push (item);
+         size_t pop_lock_free (T** item, size_t num_recycle, size_t max_num) {
+           for (size_t n = 0; n < num_recycle; ++n)
+             if (item[n])
+               recycle (item[n]);
+           item[0] = nullptr;
+           while (true) {
+             const size_t popped = ring->pop (item, max_num);
+             if (popped) {
+               notify (more_space, writers_waiting);
+               return popped;
+             }
+             if (!writer_count) {
+               // writers may have pushed before unregistering:
+               std::atomic_thread_fence (std::memory_order_seq_cst);
+               if (ring->empty())
+                 return 0;
+             }
+             else
+               wait (more_data, readers_waiting, [this]{ return !ring->empty() || !writer_count; });
+           }
+         }
+
+         // only block once a brief spin has failed to make progress; the
+         // fences pair with those in notify() to avoid lost wake-ups:
+         template <class Condition>
+           void wait (std::condition_variable& condition, std::atomic<size_t>& waiting, Condition&& ready) {
+             for (size_t n = 0; n < 64; ++n) {
+               if (ready())
+                 return;
+               std::this_thread::yield();
+             }
+             std::unique_lock<std::mutex> lock (mutex);
+             ++waiting;
+             std::atomic_thread_fence (std::memory_order_seq_cst);
+             condition.wait (lock, ready);
+             --waiting;
+           }
+
+         FORCE_INLINE void notify (std::condition_variable& condition, std::atomic<size_t>& waiting) {
+           std::atomic_thread_fence (std::memory_order_seq_cst);
+           if (waiting.load (std::memory_order_relaxed)) {
+             std::lock_guard<std::mutex> lock (mutex);
+             condition.notify_all();
+           }
          }
 
          FORCE_INLINE T** inc (T** p) const {
@@ -676,54 +1005,157 @@ namespace MR
 
 
 
+       // per-stage counters, accumulated over all threads of the stage:
+       struct __StageStats { NOMEMALIGN
+         __StageStats (const std::string& name) : name (name), items_in (0), items_out (0), transfers (0) { }
+
+         void report (double elapsed) const {
+           std::string msg = "queue stage \"" + name + "\": ";
+           if (items_in)
+             msg += str(size_t(items_in)) + " items in, ";
+           if (items_out)
+             msg += str(size_t(items_out)) + " items out, ";
+           msg += str(size_t(transfers)) + " queue transfers";
+           if (elapsed > 0.0)
+             msg += " (" + str(std::max (items_in, items_out) / elapsed, 4) + " items/s)";
+           INFO (msg);
+         }
+
+         const std::string name;
+         std::atomic<size_t> items_in, items_out, transfers;
+
+         // thread-local counts, added to the totals on destruction:
+         struct Counts { NOMEMALIGN
+           Counts (__StageStats& stats) : items_in (0), items_out (0), transfers (0), stats (stats) { }
+           Counts (const Counts&) = delete;
+           ~Counts () {
+             stats.items_in += items_in;
+             stats.items_out += items_out;
+             stats.transfers += transfers;
+           }
+           size_t items_in, items_out, transfers;
+           __StageStats& stats;
+         };
+       };
+
+
+
+       // reads items from the queue several at a time, as configured via
+       // ThreadQueueBatchSize, and hands them out one by one:
        template <class Item>
          struct FetchItem { NOMEMALIGN
-           FetchItem (typename Type<Item>::reader& item) : in (item.placeholder()) { }
-           bool read () { return in.read(); }
-           Item& value () { return (*in); }
-           typename Type<Item>::read_item in;
+           FetchItem (typename Type<Item>::reader& reader, __StageStats& stats) :
+             in (reader, queue_batch_size()), n (0), num (0), counts (stats) { }
+           bool read () {
+             if (++n < num)
+               return true;
+             n = 0;
+             num = in.read();
+             counts.items_in += num;
+             ++counts.transfers;
+             return num;
+           }
+           //! whether the next call to read() will need to access the queue
+           bool exhausted () const { return n+1 >= num; }
+           Item& value () { return in[n]; }
+           typename Type<Item>::reader::Items in;
+           size_t n, num;
+           __StageStats::Counts counts;
          };
 
        template <class Item>
          struct FetchItem<__Batch<Item>> { NOMEMALIGN
-           FetchItem (typename Type<__Batch<Item>>::reader& in) : in (in.placeholder()), n (0) { }
+           FetchItem (typename Type<__Batch<Item>>::reader& in, __StageStats& stats) :
+             in (in.placeholder()), n (0), counts (stats) { }
            bool read () {
              if (!in)
-               return in.read();
+               return next();
              ++n;
              if (n >= in->size()) {
-               if (!in.read())
+               if (!next())
                  return false;
                n = 0;
              }
              return true;
            }
+           bool exhausted () const { return !in || n+1 >= in->size(); }
            Item& value () { return (*in)[n]; }
            typename Type<__Batch<Item>>::read_item in;
            size_t n;
+           __StageStats::Counts counts;
+
+           bool next () {
+             if (!in.read())
+               return false;
+             counts.items_in += in->size();
+             ++counts.transfers;
+             return true;
+           }
          };
 
 
 
 
 
+       // coalesces items into batches of up to ThreadQueueBatchSize items.
+       // A partial batch can only be sent from the thread that fills it, so
+       // it is flushed early when a further item arrives after the first
+       // has been held for longer than ThreadQueueBatchTimeout. To avoid
+       // holding on to items while a slow functor produces the next one,
+       // the batch limit drops to a single item as soon as the interval
+       // between consecutive items exceeds the timeout, and grows back
+       // (doubling with each batch filled in time) once items arrive
+       // quickly again:
        template <class Item>
          struct StoreItem { NOMEMALIGN
-           StoreItem (size_t, typename Type<Item>::writer& item) : out (item.placeholder()) { }
-           bool write () { return out.write(); }
-           Item& value () { return (*out); }
-           bool flush () { return true; }
-           typename Type<Item>::write_item out;
+           StoreItem (size_t, typename Type<Item>::writer& writer, __StageStats& stats) :
+             out (writer, queue_batch_size()), n (0), limit (out.size()), counts (stats),
+             last (std::chrono::steady_clock::now()) { }
+           bool write () {
+             const auto now = std::chrono::steady_clock::now();
+             const bool slow = now - last >= queue_batch_timeout();
+             last = now;
+             if (slow)
+               limit = 1;
+             if (++n >= limit) {
+               if (!slow)
+                 limit = std::min (2*limit, out.size());
+               return flush();
+             }
+             if (n == 1)
+               start = now;
+             else if (now - start >= queue_batch_timeout())
+               return flush();
+             return true;
+           }
+           Item& value () { return out[n]; }
+           // called before the stage waits for further input:
+           bool flush_before_wait () { return flush(); }
+           bool flush () {
+             if (!n)
+               return true;
+             counts.items_out += n;
+             ++counts.transfers;
+             const size_t num = n;
+             n = 0;
+             return out.write (num);
+           }
+           typename Type<Item>::writer::Items out;
+           size_t n, limit;
+           __StageStats::Counts counts;
+           std::chrono::steady_clock::time_point start, last;
          };
 
        template <class Item>
          struct StoreItem<__Batch<Item>> { NOMEMALIGN
-           StoreItem (size_t batch_size, typename Type<__Batch<Item>>::writer& item) :
-             out (item.placeholder()), batch_size (batch_size), n(0) { out->resize (batch_size); }
+           StoreItem (size_t batch_size, typename Type<__Batch<Item>>::writer& item, __StageStats& stats) :
+             out (item.placeholder()), batch_size (batch_size), n(0), counts (stats) { out->resize (batch_size); }
            bool write () {
              ++n;
              if (n >= batch_size) {
                n = 0;
+               counts.items_out += batch_size;
+               ++counts.transfers;
                if (!out.write())
                  return false;
                out->resize (batch_size);
@@ -731,10 +1163,24 @@ namespace MR
              return true;
            }
            Item& value () { return (*out)[n]; }
-           void flush () { if (n) { out->resize (n); out.write(); } }
+           // explicit batches are only sent once full:
+           bool flush_before_wait () { return true; }
+           bool flush () {
+             if (!n)
+               return true;
+             out->resize (n);
+             counts.items_out += n;
+             ++counts.transfers;
+             n = 0;
+             if (!out.write())
+               return false;
+             out->resize (batch_size);
+             return true;
+           }
            typename Type<__Batch<Item>>::write_item out;
            const size_t batch_size;
            size_t n;
+           __StageStats::Counts counts;
          };
 
 
@@ -750,14 +1196,16 @@ namespace MR
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           __StageStats& stats;
 
-           __Source (queue_t& queue, Functor& functor, const Item& item) :
+           __Source (queue_t& queue, Functor& functor, const Item& item, __StageStats& stats) :
              writer (queue),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<Item> (item)) { }
+             batch_size (__batch_size<Item> (item)),
+             stats (stats) { }
 
            void execute () {
-             auto out = StoreItem<Item> (batch_size, writer);
+             StoreItem<Item> out (batch_size, writer, stats);
              do {
                if (!func (out.value()))
                  break;
@@ -786,17 +1234,24 @@ namespace MR
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           __StageStats& stats;
 
-           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const Item2& item2) :
+           __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const Item2& item2, __StageStats& stats) :
              reader (queue_in),
              writer (queue_out),
              func (__job<Functor>::functor (functor)),
-             batch_size (__batch_size<Item2> (item2)) { }
+             batch_size (__batch_size<Item2> (item2)),
+             stats (stats) { }
 
            void execute () {
-             auto in = FetchItem<Item1> (reader);
-             auto out = StoreItem<Item2> (batch_size, writer);
-             while (in.read()) {
+             FetchItem<Item1> in (reader, stats);
+             StoreItem<Item2> out (batch_size, writer, stats);
+             while (true) {
+               // don't hold on to processed items while waiting for more input:
+               if (in.exhausted() && !out.flush_before_wait())
+                 break;
+               if (!in.read())
+                 break;
                if (func (in.value(), out.value())) {
                  if (!out.write())
                    break;
@@ -821,13 +1276,15 @@ namespace MR
 
            reader_t reader;
            functor_t func;
+           __StageStats& stats;
 
-           __Sink (queue_t& queue, Functor& functor) :
+           __Sink (queue_t& queue, Functor& functor, __StageStats& stats) :
              reader (queue),
-             func (__job<Functor>::functor (functor)) { }
+             func (__job<Functor>::functor (functor)),
+             stats (stats) { }
 
            void execute () {
-             auto in = FetchItem<Item> (reader);
+             FetchItem<Item> in (reader, stats);
              while (in.read()) {
                if (!func (in.value()))
                  return;
@@ -1044,6 +1501,31 @@ namespace MR
        *
        * Obviously, Thread::multi() and Thread::batch() can be used in any
        * combination to perform the operations required.
+       *
+       * Even when Thread::batch() is not used, items are not sent through the
+       * queues one by one: each thread coalesces the items it produces into
+       * transfers of up to ThreadQueueBatchSize items (16 by default), and
+       * reads up to that many items per transfer. This is transparent to the
+       * functors, which still process one item per call. Items are held
+       * back only while their thread is running the functor, since a partial
+       * batch can only be sent by the thread that fills it: Pipe stages send
+       * any items they hold before waiting for further input, and all stages
+       * send their remaining items when they finish. A partially filled
+       * batch is sent when a further item is produced more than
+       * ThreadQueueBatchTimeout milliseconds (10 by default) after its first
+       * item, and a stage whose functor takes longer than that to produce
+       * each item reverts to sending items one at a time, so that consumers
+       * are not kept waiting on a slow producer. Setting ThreadQueueBatchSize
+       * to 1 in the MRtrix configuration file restores item-by-item
+       * transfers throughout.
+       *
+       * Thread::run_ordered_queue() does not coalesce items in this way:
+       * each item there carries its own sequence index through the queue,
+       * and the sink reorders items individually as they arrive.
+       *
+       * The number of items and queue transfers handled by each stage of the
+       * pipeline, along with its throughput, are reported at the end of
+       * processing when running with the -info option.
        */
 
        template <class Source, class Item, class Sink>
@@ -1061,15 +1543,23 @@ namespace MR
            return;
          }
 
+         Timer timer;
+         __StageStats source_stats ("source"), sink_stats ("sink");
+
          typename Type<Item>::queue queue ("source->sink", capacity);
-         __Source<Item,Source> source_functor (queue, source, item);
-         __Sink<Item,Sink> sink_functor (queue, sink);
+         __Source<Item,Source> source_functor (queue, source, item, source_stats);
+         __Sink<Item,Sink> sink_functor (queue, sink, sink_stats);
+
+         {
+           auto t1 = run (__job<Source>::get (source, source_functor), "source");
+           auto t2 = run (__job<Sink>::get (sink, sink_functor), "sink");
 
-         auto t1 = run (__job<Source>::get (source, source_functor), "source");
-         auto t2 = run (__job<Sink>::get (sink, sink_functor), "sink");
+           t1.wait();
+           t2.wait();
+         }
 
-         t1.wait();
-         t2.wait();
+         source_stats.report (timer.elapsed());
+         sink_stats.report (timer.elapsed());
 
          check_app_exit_code();
        }
@@ -1141,20 +1631,29 @@ namespace MR
            }
 
 
+           Timer timer;
+           __StageStats source_stats ("source"), pipe_stats ("pipe"), sink_stats ("sink");
+
            typename Type<Item1>::queue queue1 ("source->pipe", capacity);
            typename Type<Item2>::queue queue2 ("pipe->sink", capacity);
 
-           __Source<Item1,Source> source_functor (queue1, source, item1);
-           __Pipe<Item1,Pipe,Item2> pipe_functor (queue1, pipe, queue2, item2);
-           __Sink<Item2,Sink> sink_functor (queue2, sink);
+           __Source<Item1,Source> source_functor (queue1, source, item1, source_stats);
+           __Pipe<Item1,Pipe,Item2> pipe_functor (queue1, pipe, queue2, item2, pipe_stats);
+           __Sink<Item2,Sink> sink_functor (queue2, sink, sink_stats);
 
-           auto t1 = run (__job<Source>::get (source, source_functor), "source");
-           auto t2 = run (__job<Pipe>::get (pipe, pipe_functor), "pipe");
-           auto t3 = run (__job<Sink>::get (sink, sink_functor), "sink");
+           {
+             auto t1 = run (__job<Source>::get (source, source_functor), "source");
+             auto t2 = run (__job<Pipe>::get (pipe, pipe_functor), "pipe");
+             auto t3 = run (__job<Sink>::get (sink, sink_functor), "sink");
 
-           t1.wait();
-           t2.wait();
-           t3.wait();
+             t1.wait();
+             t2.wait();
+             t3.wait();
+           }
+
+           source_stats.report (timer.elapsed());
+           pipe_stats.report (timer.elapsed());
+           sink_stats.report (timer.elapsed());
 
            check_app_exit_code();
          }
@@ -1189,24 +1688,34 @@ namespace MR
            }
 
 
+           Timer timer;
+           __StageStats source_stats ("source"), pipe1_stats ("pipe1"), pipe2_stats ("pipe2"), sink_stats ("sink");
+
            typename Type<Item1>::queue queue1 ("source->pipe", capacity);
            typename Type<Item2>::queue queue2 ("pipe->pipe", capacity);
            typename Type<Item3>::queue queue3 ("pipe->sink", capacity);
 
-           __Source<Item1,Source> source_functor (queue1, source, item1);
-           __Pipe<Item1,Pipe1,Item2> pipe1_functor (queue1, pipe1, queue2, item2);
-           __Pipe<Item2,Pipe2,Item3> pipe2_functor (queue2, pipe2, queue3, item3);
-           __Sink<Item3,Sink> sink_functor (queue3, sink);
-
-           auto t1 = run (__job<Source>::get (source, source_functor), "source");
-           auto t2 = run (__job<Pipe1>::get (pipe1, pipe1_functor), "pipe1");
-           auto t3 = run (__job<Pipe2>::get (pipe2, pipe2_functor), "pipe2");
-           auto t4 = run (__job<Sink>::get (sink, sink_functor), "sink");
+           __Source<Item1,Source> source_functor (queue1, source, item1, source_stats);
+           __Pipe<Item1,Pipe1,Item2> pipe1_functor (queue1, pipe1, queue2, item2, pipe1_stats);
+           __Pipe<Item2,Pipe2,Item3> pipe2_functor (queue2, pipe2, queue3, item3, pipe2_stats);
+           __Sink<Item3,Sink> sink_functor (queue3, sink, sink_stats);
+
+           {
+             auto t1 = run (__job<Source>::get (source, source_functor), "source");
+             auto t2 = run (__job<Pipe1>::get (pipe1, pipe1_functor), "pipe1");
+             auto t3 = run (__job<Pipe2>::get (pipe2, pipe2_functor), "pipe2");
+             auto t4 = run (__job<Sink>::get (sink, sink_functor), "sink");
+
+             t1.wait();
+             t2.wait();
+             t3.wait();
+             t4.wait();
+           }
 
-           t1.wait();
-           t2.wait();
-           t3.wait();
-           t4.wait();
+           source_stats.report (timer.elapsed());
+           pipe1_stats.report (timer.elapsed());
+           pipe2_stats.report (timer.elapsed());
+           sink_stats.report (timer.elapsed());
 
            check_app_exit_code();
          }
@@ -217,66 +217,150 @@ namespace MR
 
 
 
+        // Voxels are processed in batches, with the DW signals of each voxel
+        //   in one column, such that all FODs are sampled on the high-resolution
+        //   directions at once. The normal-equation matrix of each voxel and its
+        //   Cholesky factorisation are retained between iterations, and updated
+        //   only for those directions entering or leaving its set of negative
+        //   directions.
         CSD (const Shared& shared_data) :
           shared (shared_data),
-          work (shared.Mt_M.rows(), shared.Mt_M.cols()),
-          HR_T (shared.HR_trans.rows(), shared.HR_trans.cols()),
-          F (shared.HR_trans.cols()),
-          init_F (shared.rconv.rows()),
-          HR_amps (shared.HR_trans.rows()),
-          Mt_b (shared.HR_trans.cols()),
-          llt (work.rows()),
-          old_neg (shared.HR_trans.rows()) { }
+          HR_T (shared.HR_trans.rows(), shared.HR_trans.cols()) { }
 
-        CSD (const CSD&) = default;
+        CSD (const CSD& that) :
+          shared (that.shared),
+          HR_T (that.HR_T.rows(), that.HR_T.cols()) { }
 
         ~CSD() { }
 
-        template <class VectorType>
-          void set (const VectorType& DW_signals) {
-            F.head (shared.rconv.rows()) = shared.rconv * DW_signals;
-            F.tail (F.size()-shared.rconv.rows()).setZero();
-            old_neg.assign (1, -1);
+        template <class MatrixType>
+          void set (const MatrixType& DW_signals) {
+            F.resize (shared.HR_trans.cols(), DW_signals.cols());
+            F.topRows (shared.rconv.rows()).noalias() = shared.rconv * DW_signals;
+            F.bottomRows (F.rows()-shared.rconv.rows()).setZero();
+            old_neg.resize (DW_signals.cols());
+            for (auto& n : old_neg)
+              n.assign (1, -1);
+            done.assign (DW_signals.cols(), false);
+            if (normal.size() < size_t(DW_signals.cols())) {
+              normal.resize (DW_signals.cols(), Eigen::MatrixXd (shared.Mt_M.rows(), shared.Mt_M.cols()));
+              llt.resize (DW_signals.cols(), Eigen::LLT<Eigen::MatrixXd> (shared.Mt_M.rows()));
+            }
 
-            Mt_b = shared.M.transpose() * DW_signals;
+            Mt_b.noalias() = shared.M.transpose() * DW_signals;
           }
 
+        // Returns true once all voxels in the batch have converged
         bool iterate() {
-          neg.clear();
-          HR_amps = shared.HR_trans * F;
-          for (ssize_t n = 0; n < HR_amps.size(); n++)
-            if (HR_amps[n] < shared.threshold)
-              neg.push_back (n);
-
-          if (old_neg == neg)
-            return true;
-
-          work.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
-
-          if (neg.size()) {
-            for (size_t i = 0; i < neg.size(); i++)
-              HR_T.row (i) = shared.HR_trans.row (neg[i]);
-            auto HR_T_view = HR_T.topRows (neg.size());
-            work.triangularView<Eigen::Lower>() += HR_T_view.transpose() * HR_T_view;
-          }
-
-          F.noalias() = llt.compute (work.triangularView<Eigen::Lower>()).solve (Mt_b);
+          active.clear();
+          for (size_t n = 0; n < done.size(); ++n)
+            if (!done[n])
+              active.push_back (n);
+
+          F_active.resize (F.rows(), active.size());
+          for (size_t i = 0; i < active.size(); ++i)
+            F_active.col (i) = F.col (active[i]);
+          HR_amps.noalias() = shared.HR_trans * F_active;
+
+          bool converged = true;
+          for (size_t i = 0; i < active.size(); ++i) {
+            const size_t voxel = active[i];
+            neg.clear();
+            for (ssize_t n = 0; n < HR_amps.rows(); n++)
+              if (HR_amps (n, i) < shared.threshold)
+                neg.push_back (n);
+
+            if (old_neg[voxel] == neg) {
+              done[voxel] = true;
+              continue;
+            }
 
-          old_neg = neg;
+            factorise (voxel);
+            F.col (voxel).noalias() = llt[voxel].solve (Mt_b.col (voxel));
+            std::swap (old_neg[voxel], neg);
+            converged = false;
+          }
 
-          return false;
+          return converged;
         }
 
-        const Eigen::VectorXd& FOD () const { return F; }
+        const Eigen::MatrixXd& FOD () const { return F; }
+        bool converged (const size_t voxel) const { return done[voxel]; }
 
 
         const Shared& shared;
 
       protected:
-        Eigen::MatrixXd work, HR_T;
-        Eigen::VectorXd F, init_F, HR_amps, Mt_b;
-        Eigen::LLT<Eigen::MatrixXd> llt;
-        vector<int> neg, old_neg;
+        // Beyond this, factorising anew is cheaper than successive rank-1 updates
+        static constexpr size_t max_rank1_updates = 8;
+
+        Eigen::MatrixXd HR_T, F, F_active, HR_amps, Mt_b;
+        Eigen::VectorXd HR_row;
+        vector<Eigen::MatrixXd> normal;
+        vector<Eigen::LLT<Eigen::MatrixXd>> llt;
+        vector<int> neg, added, removed;
+        vector<vector<int>> old_neg;
+        vector<bool> done;
+        vector<size_t> active;
+
+        // Update the normal-equation matrix of this voxel, and its Cholesky
+        //   factorisation, from the previous set of negative directions to
+        //   that in neg:
+        // - If only a few directions enter / leave the set, apply the
+        //   corresponding rank-1 updates / downdates to both directly;
+        // - Otherwise, add / subtract the outer products of those directions
+        //   to / from the matrix as rank-k updates and factorise it anew;
+        // - On the first iteration, or if the sets differ substantially,
+        //   compute the matrix from scratch.
+        void factorise (const size_t voxel)
+        {
+          Eigen::MatrixXd& A (normal[voxel]);
+          auto& L (llt[voxel]);
+          const vector<int>& previous (old_neg[voxel]);
+          bool update = previous.size() != 1 || previous[0] >= 0;
+          if (update) {
+            added.clear();
+            removed.clear();
+            std::set_difference (neg.begin(), neg.end(), previous.begin(), previous.end(), std::back_inserter (added));
+            std::set_difference (previous.begin(), previous.end(), neg.begin(), neg.end(), std::back_inserter (removed));
+            update = added.size() + removed.size() < neg.size();
+
+            if (added.size() + removed.size() <= max_rank1_updates) {
+              // additions first, so that the matrix remains positive definite throughout
+              for (auto n : added) {
+                HR_row = shared.HR_trans.row (n);
+                A.selfadjointView<Eigen::Lower>().rankUpdate (HR_row, 1.0);
+                L.rankUpdate (HR_row, 1.0);
+              }
+              for (auto n : removed) {
+                HR_row = shared.HR_trans.row (n);
+                A.selfadjointView<Eigen::Lower>().rankUpdate (HR_row, -1.0);
+                L.rankUpdate (HR_row, -1.0);
+              }
+              if (L.info() != Eigen::Success)
+                L.compute (A.selfadjointView<Eigen::Lower>());
+              return;
+            }
+          }
+
+          if (update) {
+            gather (added);
+            A.selfadjointView<Eigen::Lower>().rankUpdate (HR_T.topRows (added.size()).transpose(), 1.0);
+            gather (removed);
+            A.selfadjointView<Eigen::Lower>().rankUpdate (HR_T.topRows (removed.size()).transpose(), -1.0);
+          } else {
+            A.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
+            gather (neg);
+            A.selfadjointView<Eigen::Lower>().rankUpdate (HR_T.topRows (neg.size()).transpose(), 1.0);
+          }
+          L.compute (A.selfadjointView<Eigen::Lower>());
+        }
+
+        void gather (const vector<int>& directions)
+        {
+          for (size_t i = 0; i < directions.size(); i++)
+            HR_T.row (i) = shared.HR_trans.row (directions[i]);
+        }
     };
 
 
@@ -268,6 +268,13 @@ namespace MR
             niter = solver (output, data);
           }
 
+          // Start from the set of constraints active at the previous solution;
+          //   this is typically much closer to the final active set if the
+          //   previous voxel processed was adjacent to this one
+          void operator() (const Eigen::VectorXd& data, Eigen::VectorXd& output, bool warm_start) {
+            niter = warm_start ? solver (output, data, solver.active_set()) : solver (output, data);
+          }
+
           size_t niter;
           const Shared& shared;
 
@@ -49,7 +49,7 @@ namespace MR
                 sgm_depth (0),
                 seed_in_sgm (false),
                 sgm_seed_to_wm (false),
-                act_image (shared.act().voxel) { }
+                act_image (shared.act().voxel, Tracking::BrickedVolume::enabled() ? shared.act().bricks.get() : nullptr) { }
 
             ACT_Method_additions (const ACT_Method_additions& that) :
                 sgm_depth (0),
@@ -143,7 +143,8 @@ namespace MR
                 tissue_values.reset();
                 return false;
               }
-              return tissue_values.set (act_image);
+              act_image.row (tissue_buffer);
+              return tissue_values.set (tissue_buffer[0], tissue_buffer[1], tissue_buffer[2], tissue_buffer[3], tissue_buffer[4]);
             }
 
 
@@ -158,7 +159,8 @@ namespace MR
 
 
           private:
-            Interp::Masked<Interp::Linear<Image<float>>> act_image;
+            Tracking::VoxelCache<Image<float>> act_image;
+            Eigen::Matrix<float,5,1> tissue_buffer;
             Tissues tissue_values;
 
         };
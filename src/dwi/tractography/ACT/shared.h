@@ -19,6 +19,7 @@
 
 #include "memory.h"
 #include "dwi/tractography/ACT/gmwmi.h"
+#include "dwi/tractography/tracking/bricked_volume.h"
 
 
 namespace MR
@@ -36,6 +37,7 @@ namespace MR
           public:
             ACT_Shared_additions (const std::string& path, Properties& property_set) :
               voxel (Image<float>::open (path)),
+              bricks (voxel),
               bt (false)
             {
               verify_5TT_image (voxel);
@@ -57,6 +59,7 @@ namespace MR
 
           private:
             Image<float> voxel;
+            Tracking::BrickedVolume bricks;
             bool bt;
 
             std::unique_ptr<GMWMI_finder> gmwmi_finder;
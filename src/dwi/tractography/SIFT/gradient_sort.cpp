@@ -34,45 +34,49 @@ namespace MR
 
 
 
-      MT_gradient_vector_sorter::MT_gradient_vector_sorter (MT_gradient_vector_sorter::VecType& in, const track_t block_size) :
+      MT_gradient_vector_heap::MT_gradient_vector_heap (MT_gradient_vector_heap::VecType& in) :
           end (in.end())
       {
-        BlockSender source (in.size(), block_size);
-        Sorter      pipe   (in);
-        Thread::run_queue (source, TrackIndexRange(), Thread::multi (pipe), VecItType(), *this);
+        const size_t num_blocks = std::max<size_t> (Thread::number_of_threads(), 1);
+        const track_t block_size = std::max<track_t> ((in.size() + num_blocks - 1) / num_blocks, 1);
+        TrackIndexRangeWriter source (block_size, in.size());
+        Heapifier pipe (in);
+        Thread::run_queue (source, TrackIndexRange(), Thread::multi (pipe), Block(), *this);
+        // Blocks arrive in arbitrary order; restore it so that results do not depend on thread timing
+        std::sort (blocks.begin(), blocks.end(), [] (const Block& a, const Block& b) { return a.first < b.first; });
+        for (size_t i = 0; i != blocks.size(); ++i)
+          top.push_back (i);
+        std::make_heap (top.begin(), top.end(), [&] (const size_t a, const size_t b) { return block_compare (a, b); });
       }
 
 
 
 
-      MT_gradient_vector_sorter::VecItType MT_gradient_vector_sorter::get()
+      MT_gradient_vector_heap::VecItType MT_gradient_vector_heap::get()
       {
-        if (candidates.empty())
+        if (top.empty())
           return end;
-        VecItType return_iterator (*candidates.begin());
-        VecItType incremented (*candidates.begin());
-        ++incremented;
-        candidates.erase (candidates.begin());
-        if (incremented != end && initial_candidates.find(incremented) == initial_candidates.end())
-          candidates.insert (incremented);
+        auto compare = [&] (const size_t a, const size_t b) { return block_compare (a, b); };
+        std::pop_heap (top.begin(), top.end(), compare);
+        Block& block (blocks[top.back()]);
+        std::pop_heap (block.first, block.second, Comparator());
+        const VecItType return_iterator (--block.second);
+        if (block.first == block.second)
+          top.pop_back();
+        else
+          std::push_heap (top.begin(), top.end(), compare);
         return return_iterator;
       }
 
 
 
-      bool MT_gradient_vector_sorter::Sorter::operator() (const TrackIndexRange& in, VecItType& out) const
+      bool MT_gradient_vector_heap::Heapifier::operator() (const TrackIndexRange& in, Block& out) const
       {
-        VecItType start      (data.begin() + in.first);
-        VecItType from_end   (data.begin() + in.second);
-        VecItType from_start (start);
-        for (; from_start < from_end; ++from_start) {
-          if (from_start->get_gradient_per_unit_length() >= 0.0) {
-            for (--from_end; from_end > from_start && from_end->get_gradient_per_unit_length() >= 0.0; --from_end);
-            std::swap (*from_start, *from_end);
-          }
-        }
-        std::sort (start, from_start);
-        out = start;
+        const VecItType start (data.begin() + in.first);
+        const VecItType negative_end = std::partition (start, data.begin() + in.second,
+            [] (const Cost_fn_gradient_sort& i) { return i.get_gradient_per_unit_length() < 0.0; });
+        std::make_heap (start, negative_end, Comparator());
+        out = Block (start, negative_end);
         return true;
       }
 
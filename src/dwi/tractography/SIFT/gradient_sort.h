@@ -18,8 +18,6 @@
 #define __dwi_tractography_sift_sort_h__
 
 
-#include <set>
-
 #include "types.h"
 
 #include "dwi/tractography/SIFT/track_index_range.h"
@@ -68,84 +66,67 @@ namespace MR
 
 
 
-      // Sorting of the gradient vector in SIFT is done in a multi-threaded fashion, in a number of stages:
-      // * Gradient vector is split into blocks of equal size
+      // Selection of candidate streamlines for filtering, without sorting the gradient vector:
+      // * Gradient vector is split into one block per thread
       // * Within each block:
-      //     - Non-negative gradients are pushed to the end of the block (no need to sort these)
-      //     - Negative gradients within the block are sorted fully
-      //     - An iterator to the first entry in the sorted block is written to a set
-      // * For streamline filtering, the candidate streamline is chosen from the beginning of this set.
-      //     The entry in the set corresponding to the gradient vector is removed, but the iterator WITHIN THE BLOCK
-      //     is incremented and re-written to the set; this allows multiple streamlines from a single block to
-      //     be filtered in a single iteration, provided the gradient is less than that of the candidate streamline
-      //     from all other blocks
-      class MT_gradient_vector_sorter
-      { MEMALIGN(MT_gradient_vector_sorter)
+      //     - Non-negative gradients are pushed to the end of the block (no need to order these)
+      //     - Negative gradients within the block are arranged into a binary heap, in linear time
+      // * For streamline filtering, the candidate streamline is chosen from the block with the smallest
+      //     entry at the top of its heap, as determined by a second, small heap of block indices; that
+      //     entry is then popped from its block's heap, in logarithmic time
+      // Only a small fraction of streamlines is typically removed before the gradients must be
+      //   recalculated, so most of the work of a full sort would be wasted
+      class MT_gradient_vector_heap
+      { MEMALIGN(MT_gradient_vector_heap)
 
           using VecType = vector<Cost_fn_gradient_sort>;
           using VecItType = VecType::iterator;
 
+          // Orders entries such that the heap top has the most negative gradient per unit length;
+          //   ties are broken by streamline index, so that the result does not depend on the blocks
           class Comparator { NOMEMALIGN
             public:
-              bool operator() (const VecItType& a, const VecItType& b) const { return (a->get_gradient_per_unit_length() < b->get_gradient_per_unit_length()); }
+              bool operator() (const Cost_fn_gradient_sort& a, const Cost_fn_gradient_sort& b) const
+              {
+                if (a.get_gradient_per_unit_length() == b.get_gradient_per_unit_length())
+                  return a.get_tck_index() > b.get_tck_index();
+                return a.get_gradient_per_unit_length() > b.get_gradient_per_unit_length();
+              }
           };
-          using SetType = std::set<VecItType, Comparator>;
 
+          // Heap occupies [begin, end); entries already popped lie beyond end
+          using Block = std::pair<VecItType, VecItType>;
 
         public:
-          MT_gradient_vector_sorter (VecType& in, const track_t);
+          MT_gradient_vector_heap (VecType& in);
 
           VecItType get();
 
-          bool operator() (const VecItType& in)
+          bool operator() (const Block& in)
           {
-            candidates.insert (in);
-            initial_candidates.insert (in);
+            if (in.first != in.second)
+              blocks.push_back (in);
             return true;
           }
 
 
         private:
-          SetType candidates, initial_candidates;
+          vector<Block> blocks;
+          vector<size_t> top;
           VecItType end;
 
+          bool block_compare (const size_t a, const size_t b) const { return Comparator() (*blocks[a].first, *blocks[b].first); }
 
-          class BlockSender
-          { MEMALIGN(BlockSender)
-            public:
-              BlockSender (const track_t count, const track_t size) :
-                num_tracks (count),
-                block_size (size),
-                counter (0) { }
-              bool operator() (TrackIndexRange& out)
-              {
-                if (counter == num_tracks) {
-                  out.first = out.second = 0;
-                  return false;
-                }
-                out.first = counter;
-                counter = std::min (counter + block_size, num_tracks);
-                out.second = counter;
-                return true;
-              }
-            private:
-              const track_t num_tracks, block_size;
-              track_t counter;
-          };
-
-          class Sorter
-          { MEMALIGN(Sorter)
+          class Heapifier
+          { MEMALIGN(Heapifier)
             public:
-              Sorter (VecType& in) :
+              Heapifier (VecType& in) :
                 data  (in) { }
-              Sorter (const Sorter& that) :
-                data  (that.data) { }
-              bool operator() (const TrackIndexRange&, VecItType&) const;
+              bool operator() (const TrackIndexRange&, Block&) const;
             private:
               VecType& data;
           };
 
-
       };
 
 
@@ -71,7 +71,7 @@ namespace MR
           }
           Model (const Model& that) = delete;
 
-          virtual ~Model ();
+          virtual ~Model () { }
 
 
           // Over-rides the function defined in ModelBase; need to build contributions member also
@@ -79,6 +79,9 @@ namespace MR
 
           void remove_excluded_fixels ();
 
+          // Memory in which to hold streamline-fixel contributions; any in excess are held in a temporary file
+          void set_contribution_memory_budget (const size_t bytes) { contribution_store.set_memory_budget (bytes); }
+
           // For debugging purposes - make sure the sum of TD in the fixels is equal to the sum of TD in the streamlines
           void check_TD();
 
@@ -93,6 +96,7 @@ namespace MR
         protected:
           std::string tck_file_path;
           vector<TrackContribution*> contributions;
+          TrackContributionStore contribution_store;
 
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
@@ -137,13 +141,15 @@ namespace MR
           class FixelRemapper
           { MEMALIGN(FixelRemapper)
             public:
-              FixelRemapper (Model& i, vector<size_t>& r) :
+              FixelRemapper (Model& i, vector<size_t>& r, TrackContributionStore& s) :
                 master   (i),
-                remapper (r) { }
+                remapper (r),
+                store    (s) { }
               bool operator() (const TrackIndexRange&);
             private:
               Model& master;
               vector<size_t>& remapper;
+              TrackContributionStore& store;
           };
 
       };
@@ -152,20 +158,6 @@ namespace MR
 
 
 
-      template <class Fixel>
-      Model<Fixel>::~Model ()
-      {
-        for (vector<TrackContribution*>::iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i) {
-            delete *i;
-            *i = nullptr;
-          }
-        }
-      }
-
-
-
-
       template <class Fixel>
       void Model<Fixel>::map_streamlines (const std::string& path)
       {
@@ -185,6 +177,7 @@ namespace MR
                              Thread::batch (Tractography::Streamline<>()),
                              Thread::multi (worker));
         }
+        contribution_store.finalise();
 
         if (!contributions.back()) {
           track_t num_tracks = 0, max_index = 0;
@@ -200,6 +193,9 @@ namespace MR
 
         tck_file_path = path;
 
+        INFO ("Streamline-fixel contributions occupy " + str (contribution_store.bytes() / (1024.0*1024.0), 3) + " MB"
+              + (contribution_store.bytes_on_disk() ? " in RAM and " + str (contribution_store.bytes_on_disk() / (1024.0*1024.0), 3) + " MB on disk" : std::string())
+              + " (approximately " + str (contribution_store.bytes_uncompressed() / (1024.0*1024.0), 3) + " MB if stored uncompressed)");
         INFO ("Proportionality coefficient after streamline mapping is " + str (mu()));
       }
 
@@ -252,9 +248,14 @@ namespace MR
 
         fixels.swap (new_fixels);
 
+        // Re-encode the contributions into a new store, so that memory used by the old one is released
+        TrackContributionStore new_store;
+        new_store.set_memory_budget (contribution_store.get_memory_budget());
         TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
-        FixelRemapper remapper (*this, fixel_index_mapping);
+        FixelRemapper remapper (*this, fixel_index_mapping, new_store);
         Thread::run_queue (writer, TrackIndexRange(), Thread::multi (remapper));
+        new_store.finalise();
+        contribution_store = std::move (new_store);
 
         TD_sum = 0.0;
         for (typename vector<Fixel>::const_iterator i = fixels.begin(); i != fixels.end(); ++i)
@@ -359,7 +360,7 @@ namespace MR
             }
           }
 
-          master.contributions[in.get_index()] = new TrackContribution (masked_contributions, total_contribution, total_length);
+          master.contribution_store.create (master.contributions[in.get_index()], masked_contributions, total_contribution, total_length);
 
           TD_sum += total_contribution;
           for (vector<Track_fixel_contribution>::const_iterator i = masked_contributions.begin(); i != masked_contributions.end(); ++i)
@@ -382,19 +383,17 @@ namespace MR
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
           if (master.contributions[track_index]) {
-            TrackContribution& this_cont (*master.contributions[track_index]);
+            const TrackContribution& this_cont (*master.contributions[track_index]);
             vector<Track_fixel_contribution> new_cont;
             double total_contribution = 0.0;
-            for (size_t i = 0; i != this_cont.dim(); ++i) {
-              const size_t new_index = remapper[this_cont[i].get_fixel_index()];
+            for (const auto& i : this_cont) {
+              const size_t new_index = remapper[i.get_fixel_index()];
               if (new_index) {
-                new_cont.push_back (Track_fixel_contribution (new_index, this_cont[i].get_length()));
-                total_contribution += this_cont[i].get_length() * master[new_index].get_weight();
+                new_cont.push_back (Track_fixel_contribution::from_quantised (new_index, i.get_quantised_length()));
+                total_contribution += i.get_length() * master[new_index].get_weight();
               }
             }
-            TrackContribution* new_contribution = new TrackContribution (new_cont, total_contribution, this_cont.get_total_length());
-            delete master.contributions[track_index];
-            master.contributions[track_index] = new_contribution;
+            store.create (master.contributions[track_index], new_cont, total_contribution, this_cont.get_total_length());
           }
         }
         return true;
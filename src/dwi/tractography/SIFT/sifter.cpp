@@ -117,22 +117,9 @@ namespace MR
           Thread::run_queue (range_writer, TrackIndexRange(), Thread::multi (gradient_calculator));
 
 
-          // Theoretically possible to optimise the sorting block size at execution time
-          // * Estimate the smallest possible block size that will not overload the std::set
-          // * Simulate a gradient vector using a Gaussian distribution of gradients (ignore length dependence)
-          // * Simulate sorting this gradient vector; need to simulate both the sort, and some number of get() calls
-          // * Perform a golden section search to find the optimal block size
-          // This wasn't implemented as the optimal block size seems pretty stable regardless of gradient vector size
-
-          // Ideally the sorting block size should change dynamically as streamlines are filtered
-          // This is to reduce the load on the single-threaded section as the multi-threaded sorting complexity declines
-          //   (as more streamlines are no longer present, hence have a null gradient and are excluded from the full sort)
-          // Tried for an algebraic solution but the numbers didn't line up with my experiments
-          // Trying a heuristic for now; go for a sort size of 1000 following initial sort, assuming half of all
-          //   remaining streamlines have a negative gradient
-
-          const track_t sort_size = std::min (std::ceil(num_tracks() / double(Thread::number_of_threads())), std::round (2000.0 * double(num_tracks()) / double(tracks_remaining)));
-          MT_gradient_vector_sorter sorter (gradient_vector, sort_size);
+          // Only as many candidates as are removed in this iteration are ever ordered,
+          //   so the gradient vector is arranged into heaps rather than sorted
+          MT_gradient_vector_heap candidates (gradient_vector);
 
           // Remove candidate streamlines one at a time, and correspondingly modify the fixels to which they were attributed
           removed_this_iteration = 0;
@@ -171,14 +158,13 @@ namespace MR
 
               // Remove this streamline, and adjust all of the relevant quantities
               noncontributing_length_removed += contributions[to_remove]->get_total_length();
-              delete contributions[to_remove];
               contributions[to_remove] = nullptr;
               ++removed_this_iteration;
               --tracks_remaining;
 
             } else { // Proceed as normal
 
-              const vector<Cost_fn_gradient_sort>::iterator candidate = sorter.get();
+              const vector<Cost_fn_gradient_sort>::iterator candidate = candidates.get();
               if (candidate == gradient_vector.end()) {
                 recalculate = POS_GRADIENT;
                 if (!removed_this_iteration)
@@ -210,8 +196,7 @@ namespace MR
               double this_actual_cf_change = current_roc_cf * mu_change;
               double quantisation = 0.0;
 
-              for (size_t f = 0; f != candidate_contribution.dim(); ++f) {
-                const Track_fixel_contribution& fixel_cont = candidate_contribution[f];
+              for (const auto& fixel_cont : candidate_contribution) {
                 const float length = fixel_cont.get_length();
                 Fixel& this_fixel = fixels[fixel_cont.get_fixel_index()];
                 quantisation += this_fixel.calc_quantisation (old_mu, length);
@@ -226,13 +211,10 @@ namespace MR
               if (this_actual_cf_change < std::min ( {required_cf_change_ratio, required_cf_change_quantisation, this_nonlinearity })) {
 
                 // Candidate streamline removal meets all criteria; remove from reconstruction
-                for (size_t f = 0; f != candidate_contribution.dim(); ++f) {
-                  const Track_fixel_contribution& fixel_cont = candidate_contribution[f];
+                for (const auto& fixel_cont : candidate_contribution)
                   fixels[fixel_cont.get_fixel_index()] -= fixel_cont.get_length();
-                }
                 TD_sum -= candidate_contribution.get_total_contribution();
                 contributing_length_removed += candidate_contribution.get_total_length();
-                delete contributions[candidate_index];
                 contributions[candidate_index] = nullptr;
                 ++removed_this_iteration;
                 --tracks_remaining;
@@ -372,52 +354,6 @@ namespace MR
 
 
 
-      void SIFTer::test_sorting_block_size (const size_t num_tracks) const
-      {
-
-        Math::RNG::Normal<float> rng;
-
-        vector<Cost_fn_gradient_sort> gradient_vector;
-        gradient_vector.assign (num_tracks, Cost_fn_gradient_sort (num_tracks, 0.0, 0.0));
-        // Fill the gradient vector with random Gaussian data
-        for (track_t index = 0; index != num_tracks; ++index) {
-          const float value = rng();
-          gradient_vector[index].set (index, value, value);
-        }
-
-        vector<size_t> block_sizes;
-        for (size_t i = 16; i < num_tracks; i *= 2)
-          block_sizes.push_back (i);
-        block_sizes.push_back (num_tracks);
-
-        for (vector<size_t>::const_iterator i = block_sizes.begin(); i != block_sizes.end(); ++i) {
-          const size_t block_size = *i;
-
-          // Make a copy of the gradient vector, so the same data is sorted each time
-          vector<Cost_fn_gradient_sort> temp_gv (gradient_vector);
-
-          Timer timer;
-          // Simulate sorting and filtering
-          try {
-            MT_gradient_vector_sorter sorter (temp_gv, block_size);
-            for (size_t candidate_count = 0; candidate_count < num_tracks / 1000; ++candidate_count)
-              sorter.get();
-            std::cerr << "Time required for sorting " << num_tracks << " tracks, block size " << block_size << " = " << timer.elapsed() * 1000.0 << "ms\n";
-          } catch (...) {
-            std::cerr << "Could not sort " << num_tracks << "tracks with block size " << block_size << "\n";
-          }
-
-
-
-        }
-
-      }
-
-
-
-
-
-
       // Convenience functions
 
       double SIFTer::calc_roc_cost_function() const
@@ -439,10 +375,10 @@ namespace MR
         const double mu_if_removed = FOD_sum / TD_sum_if_removed;
         const double mu_change_if_removed = mu_if_removed - current_mu;
         double gradient = current_roc_cost * mu_change_if_removed;
-        for (size_t f = 0; f != tck_cont.dim(); ++f) {
-          const Fixel& fixel = fixels[tck_cont[f].get_fixel_index()];
+        for (const auto& c : tck_cont) {
+          const Fixel& fixel = fixels[c.get_fixel_index()];
           const double undo_gradient_mu_only = fixel.get_d_cost_d_mu (current_mu) * mu_change_if_removed;
-          const double gradient_remove_tck = fixel.get_cost_wo_track (mu_if_removed, tck_cont[f].get_length()) - fixel.get_cost (current_mu);
+          const double gradient_remove_tck = fixel.get_cost_wo_track (mu_if_removed, c.get_length()) - fixel.get_cost (current_mu);
           gradient = gradient - undo_gradient_mu_only + gradient_remove_tck;
         }
         return gradient;
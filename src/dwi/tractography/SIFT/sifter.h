@@ -82,10 +82,6 @@ namespace MR
         void set_regular_outputs (const vector<uint32_t>&, const bool);
 
 
-        // DEBUGGING
-        void test_sorting_block_size (const size_t) const;
-
-
         protected:
         using Fixel_map<Fixel>::accessor;
         using Fixel_map<Fixel>::fixels;
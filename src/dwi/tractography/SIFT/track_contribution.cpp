@@ -16,6 +16,10 @@
 
 #include "dwi/tractography/SIFT/track_contribution.h"
 
+#include <new>
+
+#include "file/utils.h"
+
 namespace MR
 {
   namespace DWI
@@ -31,6 +35,184 @@ namespace MR
         float Track_fixel_contribution::min_length_for_storage = 0.0;
 
 
+
+
+        size_t TrackContribution::encoded_size (const vector<Track_fixel_contribution>& in)
+        {
+          size_t size = 0;
+          uint32_t previous = 0;
+          for (const auto& i : in) {
+            const int32_t delta = int32_t (i.get_fixel_index()) - int32_t (previous);
+            uint32_t zigzag = (uint32_t (delta) << 1) ^ uint32_t (delta >> 31);
+            do {
+              ++size;
+              zigzag >>= 7;
+            } while (zigzag);
+            ++size;
+            previous = i.get_fixel_index();
+          }
+          return size;
+        }
+
+
+
+        void TrackContribution::encode (const vector<Track_fixel_contribution>& in)
+        {
+          uint8_t* p = reinterpret_cast<uint8_t*> (this + 1);
+          uint32_t previous = 0;
+          for (const auto& i : in) {
+            const int32_t delta = int32_t (i.get_fixel_index()) - int32_t (previous);
+            uint32_t zigzag = (uint32_t (delta) << 1) ^ uint32_t (delta >> 31);
+            while (zigzag >= 0x80) {
+              *p++ = uint8_t (zigzag | 0x80);
+              zigzag >>= 7;
+            }
+            *p++ = uint8_t (zigzag);
+            *p++ = uint8_t (i.get_quantised_length());
+            previous = i.get_fixel_index();
+          }
+        }
+
+
+
+
+        void TrackContributionStore::create (TrackContribution*& target, const vector<Track_fixel_contribution>& in, const float total_contribution, const float total_length)
+        {
+          // Keep instances 4-byte aligned
+          const size_t size = (sizeof (TrackContribution) + TrackContribution::encoded_size (in) + 3) & ~size_t(3);
+          uint8_t* ptr = nullptr;
+          {
+            std::lock_guard<std::mutex> lock (*mutex);
+            ++num_tracks;
+            num_contributions += in.size();
+            const bool new_block = size > block_size || blocks.empty() || used + size > block_size;
+            if (spill || (new_block && allocated + std::max (size, block_size) > budget)) {
+              // Over budget: encode into the write buffer for the temporary file; this is
+              //   done while holding the lock, as the buffer is shared between threads
+              if (!spill)
+                spill.reset (new Spill);
+              if (spill->used + size > spill->block.size()) {
+                spill->flush();
+                if (size > spill->block.size())
+                  spill->block.resize (size);
+              }
+              TrackContribution* result = new (spill->block.data() + spill->used) TrackContribution (total_contribution, total_length, in.size());
+              result->encode (in);
+              spill->relocations.push_back (std::make_pair (&target, spill->size + spill->used));
+              spill->used += size;
+              target = nullptr;
+              return;
+            }
+            if (size > block_size) {
+              // Not expected in practice; give this streamline a dedicated block,
+              //   placed at the front so that the current block continues to be filled
+              blocks.insert (blocks.begin(), std::unique_ptr<uint8_t[]> (new uint8_t[size]));
+              allocated += size;
+              ptr = blocks.front().get();
+            } else {
+              if (new_block) {
+                blocks.push_back (std::unique_ptr<uint8_t[]> (new uint8_t[block_size]));
+                allocated += block_size;
+                used = 0;
+              }
+              ptr = blocks.back().get() + used;
+              used += size;
+            }
+          }
+          TrackContribution* result = new (ptr) TrackContribution (total_contribution, total_length, in.size());
+          result->encode (in);
+          target = result;
+        }
+
+
+
+        void TrackContributionStore::finalise ()
+        {
+          if (!spill || spill->mmap)
+            return;
+          spill->flush();
+          spill->out.close();
+          if (!spill->out)
+            throw Exception ("error writing streamline-fixel contributions to temporary file \"" + spill->path + "\"");
+          vector<uint8_t>().swap (spill->block);
+          spill->mmap.reset (new File::MMap (File::Entry (spill->path)));
+          for (const auto& r : spill->relocations)
+            *r.first = reinterpret_cast<TrackContribution*> (spill->mmap->address() + r.second);
+          vector<std::pair<TrackContribution**, size_t>>().swap (spill->relocations);
+          DEBUG ("Streamline-fixel contributions exceeding memory budget written to temporary file \"" + spill->path + "\" "
+                "(" + str (spill->size / (1024.0*1024.0), 3) + " MB)");
+        }
+
+
+
+        void TrackContributionStore::read_ahead (const TrackContribution* const* first, const TrackContribution* const* last) const
+        {
+          if (!spill || !spill->mmap)
+            return;
+          const uint8_t* const begin = spill->mmap->address();
+          const uint8_t* const end = begin + spill->mmap->size();
+          const uint8_t* lower = end;
+          const uint8_t* upper = begin;
+          for (; first != last; ++first) {
+            const uint8_t* p = reinterpret_cast<const uint8_t*> (*first);
+            if (p >= begin && p < end) {
+              lower = std::min (lower, p);
+              upper = std::max (upper, p);
+            }
+          }
+          // The size of the last instance is not known; a page is sufficient for any typical streamline
+          if (lower < end)
+            spill->mmap->prefetch (lower - begin, std::min<int64_t> (upper - lower + 4096, end - lower));
+        }
+
+
+
+        TrackContributionStore::Spill::Spill () :
+            path (File::create_tempfile (0, "dat")),
+            out (path, std::ios::out | std::ios::binary | std::ios::trunc),
+            size (0),
+            used (0),
+            block (block_size)
+        {
+          if (!out)
+            throw Exception ("error opening temporary file \"" + path + "\" for streamline-fixel contributions");
+        }
+
+
+
+        TrackContributionStore::Spill::~Spill ()
+        {
+          mmap.reset();
+          if (out.is_open())
+            out.close();
+          try {
+            File::remove (path);
+          } catch (...) { }
+        }
+
+
+
+        void TrackContributionStore::Spill::flush ()
+        {
+          if (!used)
+            return;
+          out.write (reinterpret_cast<const char*> (block.data()), used);
+          size += used;
+          used = 0;
+        }
+
+
+
+        size_t TrackContributionStore::bytes_uncompressed () const
+        {
+          // Per streamline: an object holding the total contribution & length, derived from
+          //   Min_mem_array (a vtable pointer, a size, and a pointer to a heap-allocated array);
+          //   this ignores the overhead of the two heap allocations themselves
+          return num_tracks * (2 * sizeof(float) + sizeof(void*) + sizeof(size_t) + sizeof(void*))
+              + num_contributions * sizeof (Track_fixel_contribution);
+        }
+
+
       }
     }
   }
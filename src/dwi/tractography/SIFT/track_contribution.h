@@ -19,9 +19,12 @@
 
 
 #include <cstdint>
+#include <fstream>
+#include <limits>
+#include <mutex>
 
 #include "header.h"
-#include "min_mem_array.h"
+#include "file/mmap.h"
 
 #include "math/math.h"
 
@@ -53,6 +56,15 @@ namespace MR
           uint32_t get_fixel_index() const { return (data & 0x00FFFFFF); }
           float    get_length()      const { return (uint32_t((data & 0xFF000000) >> 24) * scale_from_storage); }
 
+          // Direct access to the length as stored, for TrackContribution encoding
+          uint32_t get_quantised_length() const { return (data & 0xFF000000) >> 24; }
+          static Track_fixel_contribution from_quantised (const uint32_t fixel_index, const uint32_t quantised_length)
+          {
+            Track_fixel_contribution result;
+            result.data = (fixel_index & 0x00FFFFFF) | (quantised_length << 24);
+            return result;
+          }
+
 
           bool add (const float length)
           {
@@ -128,27 +140,140 @@ class Track_fixel_contribution
 
 
 
-      class TrackContribution : public Min_mem_array<Track_fixel_contribution>
-      { MEMALIGN(TrackContribution)
+      // The fixels traversed by a streamline, and the length of the streamline within each
+      // The contributions are encoded as a byte stream immediately following this object in
+      //   memory: for each fixel, the difference in fixel index from the previous entry
+      //   (zig-zag & variable-length encoded), followed by the 8-bit quantised length.
+      //   Instances can therefore only be created by a TrackContributionStore, and
+      //   contributions can only be read sequentially, using begin() / end().
+      class TrackContribution
+      { NOMEMALIGN
 
         public:
-        TrackContribution (const vector<Track_fixel_contribution>& in, const float c, const float l) :
-            Min_mem_array<Track_fixel_contribution> (in),
-            total_contribution (c),
-            total_length       (l) { }
+          class const_iterator
+          { NOMEMALIGN
+            public:
+              const_iterator (const uint8_t* p, const uint32_t remaining) :
+                  p (p),
+                  remaining (remaining),
+                  fixel_index (0) { if (remaining) decode(); }
+              const_iterator& operator++ () { if (--remaining) decode(); return *this; }
+              bool operator!= (const const_iterator& that) const { return remaining != that.remaining; }
+              const Track_fixel_contribution& operator* () const { return value; }
+              const Track_fixel_contribution* operator-> () const { return &value; }
+            private:
+              const uint8_t* p;
+              uint32_t remaining, fixel_index;
+              Track_fixel_contribution value;
+              void decode ()
+              {
+                uint32_t zigzag = 0;
+                for (uint32_t shift = 0; ; shift += 7) {
+                  const uint8_t byte = *p++;
+                  zigzag |= uint32_t (byte & 0x7F) << shift;
+                  if (!(byte & 0x80))
+                    break;
+                }
+                fixel_index += (zigzag >> 1) ^ (0U - (zigzag & 1));
+                value = Track_fixel_contribution::from_quantised (fixel_index, *p++);
+              }
+          };
+
+          TrackContribution (const TrackContribution&) = delete;
+
+          const_iterator begin () const { return const_iterator (reinterpret_cast<const uint8_t*> (this + 1), num_contributions); }
+          const_iterator end   () const { return const_iterator (nullptr, 0); }
+          size_t dim () const { return num_contributions; }
+
+          float get_total_contribution() const { return total_contribution; }
+          float get_total_length      () const { return total_length; }
+
+        private:
+          const float total_contribution, total_length;
+          const uint32_t num_contributions;
 
-        TrackContribution () :
-            Min_mem_array<Track_fixel_contribution> (),
-            total_contribution (0.0),
-            total_length       (0.0) { }
+          TrackContribution (const float c, const float l, const uint32_t n) :
+              total_contribution (c),
+              total_length       (l),
+              num_contributions  (n) { }
 
-        ~TrackContribution() { }
+          static size_t encoded_size (const vector<Track_fixel_contribution>&);
+          void encode (const vector<Track_fixel_contribution>&);
 
-        float get_total_contribution() const { return total_contribution; }
-        float get_total_length      () const { return total_length; }
+          friend class TrackContributionStore;
+
+      };
+
+
+
+
+      // Memory arena holding TrackContribution instances contiguously in large blocks,
+      //   rather than performing two heap allocations per streamline
+      // Individual instances are never freed; all memory is released upon destruction
+      //   of the store. create() may be called from multiple threads concurrently.
+      // If a memory budget is set, once the blocks held in RAM reach that budget, any further
+      //   instances are instead written sequentially to a temporary file; this file is
+      //   memory-mapped read-only by finalise(), at which point the pointers to those
+      //   instances become valid, and the OS pages them in (and out) on demand.
+      class TrackContributionStore
+      { NOMEMALIGN
+
+        public:
+          TrackContributionStore () :
+              allocated (0),
+              used (0),
+              num_tracks (0),
+              num_contributions (0),
+              budget (std::numeric_limits<size_t>::max()),
+              mutex (new std::mutex) { }
+          TrackContributionStore (const TrackContributionStore&) = delete;
+          TrackContributionStore (TrackContributionStore&&) = default;
+          TrackContributionStore& operator= (TrackContributionStore&&) = default;
+
+          // Limit the RAM used to hold contributions to (approximately) this many bytes
+          void set_memory_budget (const size_t bytes) { budget = bytes; }
+          size_t get_memory_budget () const { return budget; }
+
+          // The new instance is written to target; if it has been written to file, target
+          //   is set to nullptr, and only set to the final location by finalise()
+          void create (TrackContribution*& target, const vector<Track_fixel_contribution>&, const float total_contribution, const float total_length);
+
+          // Must be called once all instances have been created, before any are accessed
+          void finalise ();
+
+          // Request asynchronous read-ahead of any file-backed instances within this list
+          //   (the list need not be contiguous, but should be compact, as the whole span
+          //   between the lowest and highest addresses is requested)
+          void read_ahead (const TrackContribution* const* first, const TrackContribution* const* last) const;
+
+          // Memory currently allocated, and the (approximate) memory that the same contributions
+          //   would require if stored as a separately-allocated array per streamline
+          size_t bytes () const { return allocated; }
+          size_t bytes_uncompressed () const;
+          // Size of the temporary file holding those instances that exceeded the budget
+          size_t bytes_on_disk () const { return spill ? spill->size : 0; }
 
         private:
-          const float total_contribution, total_length;
+          static constexpr size_t block_size = 1024 * 1024;
+
+          class Spill
+          { NOMEMALIGN
+            public:
+              Spill ();
+              ~Spill ();
+              std::string path;
+              std::ofstream out;
+              size_t size, used;
+              vector<uint8_t> block;
+              vector<std::pair<TrackContribution**, size_t>> relocations;
+              std::unique_ptr<File::MMap> mmap;
+              void flush ();
+          };
+
+          vector<std::unique_ptr<uint8_t[]>> blocks;
+          size_t allocated, used, num_tracks, num_contributions, budget;
+          std::unique_ptr<Spill> spill;
+          std::unique_ptr<std::mutex> mutex;
 
       };
 
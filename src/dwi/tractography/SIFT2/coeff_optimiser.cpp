@@ -178,9 +178,9 @@ namespace MR {
         size_t index_to_exclude = 0.0;
         float cost_to_exclude = 0.0;
 
-        for (size_t j = 0; j != this_contribution.dim(); ++j) {
-          const size_t fixel_index = this_contribution[j].get_fixel_index();
-          const float length = this_contribution[j].get_length();
+        for (const auto& c : this_contribution) {
+          const size_t fixel_index = c.get_fixel_index();
+          const float length = c.get_length();
           const Fixel& fixel = master.fixels[fixel_index];
           if (!fixel.is_excluded() && (fixel.get_diff (mu) < 0.0)) {
 
@@ -201,9 +201,9 @@ namespace MR {
         // Task 2: Calculate a new coefficient for this streamline
         double weighted_sum = 0.0, sum_weights = 0.0;
 
-        for (size_t j = 0; j != this_contribution.dim(); ++j) {
-          const size_t fixel_index = this_contribution[j].get_fixel_index();
-          const float length = this_contribution[j].get_length();
+        for (const auto& c : this_contribution) {
+          const size_t fixel_index = c.get_fixel_index();
+          const float length = c.get_length();
           const Fixel& fixel = master.fixels[fixel_index];
           if (!fixel.is_excluded() && (fixel_index != index_to_exclude)) {
 
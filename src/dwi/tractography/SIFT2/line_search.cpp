@@ -38,10 +38,10 @@ namespace MR {
         reg_tv  (tckfactor.reg_multiplier_tv / tckfactor.contributions[track_index]->get_total_contribution())
       {
         const SIFT::TrackContribution& track_contribution = *tckfactor.contributions[track_index];
-        for (size_t i = 0; i != track_contribution.dim(); ++i) {
-          const SIFT2::Fixel& fixel (tckfactor.fixels[track_contribution[i].get_fixel_index()]);
+        for (const auto& c : track_contribution) {
+          const SIFT2::Fixel& fixel (tckfactor.fixels[c.get_fixel_index()]);
           if (!fixel.is_excluded())
-            fixels.push_back (Fixel (track_contribution[i], tckfactor, Fs, fixel.get_mean_coeff()));
+            fixels.push_back (Fixel (c, tckfactor, Fs, fixel.get_mean_coeff()));
         }
       }
 
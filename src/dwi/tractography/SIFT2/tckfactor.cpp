@@ -118,8 +118,8 @@ namespace MR {
           const SIFT::TrackContribution& tck_cont (*contributions[track_index]);
           const double weight = 1.0 / tck_cont.get_total_length();
           coefficients[track_index] = std::log (weight);
-          for (size_t i = 0; i != tck_cont.dim(); ++i)
-            fixels[tck_cont[i].get_fixel_index()] += weight * tck_cont[i].get_length();
+          for (const auto& c : tck_cont)
+            fixels[c.get_fixel_index()] += weight * c.get_length();
           TD_sum += weight * tck_cont.get_total_contribution();
         }
 
@@ -163,10 +163,10 @@ namespace MR {
               for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
                 const SIFT::TrackContribution& tckcont = *master.contributions[track_index];
                 double sum_afd = 0.0;
-                for (size_t f = 0; f != tckcont.dim(); ++f) {
-                  const size_t fixel_index = tckcont[f].get_fixel_index();
+                for (const auto& c : tckcont) {
+                  const size_t fixel_index = c.get_fixel_index();
                   const Fixel& fixel = master.fixels[fixel_index];
-                  const float length = tckcont[f].get_length();
+                  const float length = c.get_length();
                   sum_afd += fixel.get_weight() * fixel.get_FOD() * (length / fixel.get_orig_TD());
                 }
                 if (sum_afd && tckcont.get_total_contribution()) {
@@ -269,7 +269,7 @@ namespace MR {
           fixels_to_exclude.clear();
           double sum_costs = 0.0;
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            IndexRangeWriter writer (*this);
             //CoefficientOptimiserGSS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             //CoefficientOptimiserQLS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             CoefficientOptimiserIterative worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
@@ -296,7 +296,7 @@ namespace MR {
             i->clear_mean_coeff();
           }
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            IndexRangeWriter writer (*this);
             FixelUpdater worker (*this);
             Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
           }
@@ -312,7 +312,7 @@ namespace MR {
           // Log different regularisation costs separately
           double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            IndexRangeWriter writer (*this);
             RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
             Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
           }
@@ -387,16 +387,16 @@ namespace MR {
             const double coeff = coefficients[i];
             const SIFT::TrackContribution& this_contribution (*contributions[i]);
             if (coeff > min_coeff) {
-              for (size_t j = 0; j != this_contribution.dim(); ++j) {
-                const size_t fixel_index = this_contribution[j].get_fixel_index();
+              for (const auto& c : this_contribution) {
+                const size_t fixel_index = c.get_fixel_index();
                 const double mean_coeff = fixels[fixel_index].get_mean_coeff();
                 mins  [fixel_index] = std::min (mins[fixel_index], coeff);
                 stdevs[fixel_index] += Math::pow2 (coeff - mean_coeff);
                 maxs  [fixel_index] = std::max (maxs[fixel_index], coeff);
               }
             } else {
-              for (size_t j = 0; j != this_contribution.dim(); ++j)
-                ++zeroed[this_contribution[j].get_fixel_index()];
+              for (const auto& c : this_contribution)
+                ++zeroed[c.get_fixel_index()];
             }
             ++progress;
           }
@@ -131,6 +131,29 @@ namespace MR {
           // For when multiple threads are trying to write their final information back
           std::mutex mutex;
 
+          // Provides ranges of streamline indices as SIFT::TrackIndexRangeWriter, while also
+          //   requesting read-ahead of the contributions of the subsequent range, in case
+          //   these are held in a temporary file rather than in RAM
+          class IndexRangeWriter : public SIFT::TrackIndexRangeWriter
+          { MEMALIGN(IndexRangeWriter)
+            public:
+              IndexRangeWriter (const TckFactor& master) :
+                  SIFT::TrackIndexRangeWriter (SIFT_TRACK_INDEX_BUFFER_SIZE, master.num_tracks()),
+                  master (master) { }
+              bool operator() (SIFT::TrackIndexRange& out)
+              {
+                if (!SIFT::TrackIndexRangeWriter::operator() (out))
+                  return false;
+                const SIFT::track_t from = out.first ? out.second : out.first;
+                const SIFT::track_t to = std::min<SIFT::track_t> (out.second + SIFT_TRACK_INDEX_BUFFER_SIZE, master.num_tracks());
+                if (from < to)
+                  master.contribution_store.read_ahead (master.contributions.data() + from, master.contributions.data() + to);
+                return true;
+              }
+            private:
+              const TckFactor& master;
+          };
+
           void indicate_progress() { if (App::log_level) fprintf (stderr, "."); }
 
       };
@@ -127,11 +127,12 @@ namespace MR
       iFOD1 (const Shared& shared) :
         MethodBase (shared),
         S (shared),
-        source (S.source),
+        source (S.source, S.bricks()),
         mean_sample_num (0),
         num_sample_runs (0),
         num_truncations (0),
-        max_truncation (0.0) {
+        max_truncation (0.0),
+        batch (S.lmax, &S.precomputer) {
         calibrate (*this);
       }
 
@@ -182,9 +183,15 @@ namespace MR
         if (!get_data (source))
           return EXIT_IMAGE;
 
+        calibrate_dirs.resize (calibrate_list.size());
+        for (size_t i = 0; i < calibrate_list.size(); ++i)
+          calibrate_dirs[i] = rotate_direction (dir, calibrate_list[i]);
+        batch.set (calibrate_dirs);
+        const Eigen::VectorXf calibrate_vals = batch.values (values);
+
         float max_val = 0.0;
         for (size_t i = 0; i < calibrate_list.size(); ++i) {
-          float val = FOD (rotate_direction (dir, calibrate_list[i]));
+          const float val = calibrate_vals[i];
           if (std::isnan (val))
             return EXIT_IMAGE;
           else if (val > max_val)
@@ -241,7 +248,8 @@ namespace MR
       float calibrate_ratio;
       size_t mean_sample_num, num_sample_runs, num_truncations;
       float max_truncation;
-      vector< Eigen::Vector3f > calibrate_list;
+      vector< Eigen::Vector3f > calibrate_list, calibrate_dirs;
+      Math::SH::Batch<float> batch;
 
       float FOD (const Eigen::Vector3f& d) const
       {
@@ -149,7 +149,7 @@ namespace MR
             iFOD2 (const Shared& shared) :
               MethodBase (shared),
               S (shared),
-              source (S.source),
+              source (S.source, S.bricks()),
               mean_sample_num (0),
               num_sample_runs (0),
               num_truncations (0),
@@ -158,7 +158,8 @@ namespace MR
               calib_positions (S.num_samples),
               tangents (S.num_samples),
               calib_tangents (S.num_samples),
-              sample_idx (S.num_samples)
+              sample_idx (S.num_samples),
+              batch (S.lmax, &S.precomputer)
           {
             calibrate (*this);
           }
@@ -166,7 +167,7 @@ namespace MR
             iFOD2 (const iFOD2& that) :
               MethodBase (that.S),
               S (that.S),
-              source (S.source),
+              source (S.source, S.bricks()),
               calibrate_ratio (that.calibrate_ratio),
               mean_sample_num (0),
               num_sample_runs (0),
@@ -177,7 +178,8 @@ namespace MR
               calib_positions (S.num_samples),
               tangents (S.num_samples),
               calib_tangents (S.num_samples),
-              sample_idx (S.num_samples)
+              sample_idx (S.num_samples),
+              batch (S.lmax, &S.precomputer)
           {
           }
 
@@ -351,6 +353,9 @@ namespace MR
             //   in the arc - more dense structural image sampling
             size_t sample_idx;
 
+            // SH basis along the tangents of the current path
+            Math::SH::Batch<float> batch;
+
 
 
             FORCE_INLINE float FOD (const Eigen::Vector3f& direction) const
@@ -361,13 +366,6 @@ namespace MR
                   );
             }
 
-            FORCE_INLINE float FOD (const Eigen::Vector3f& position, const Eigen::Vector3f& direction)
-            {
-              if (!get_data (source, position))
-                return NaN;
-              return FOD (direction);
-            }
-
 
 
 
@@ -390,10 +388,16 @@ namespace MR
                   return 0.0;
               }
 
+              // the basis for all tangents is computed in one pass; the FOD
+              // itself differs at each sample, and is only fetched once that
+              // sample is reached, since most candidate paths are rejected
+              // before their end
+              batch.set (tangents);
               float log_prob = half_log_prob0;
               for (size_t i = 0; i < S.num_samples; ++i) {
-
-                float fod_amp = FOD (positions[i], tangents[i]);
+                if (!get_data (source, positions[i]))
+                  return NaN;
+                float fod_amp = batch.value (values, i);
                 if (std::isnan (fod_amp))
                   return NaN;
                 if (fod_amp < S.threshold)
@@ -460,7 +464,8 @@ namespace MR
                   fod (P.values),
                   vox (P.S.vox()),
                   positions (P.S.num_samples),
-                  tangents (P.S.num_samples) {
+                  tangents (P.S.num_samples),
+                  batch (P.S.lmax) {
                     Math::SH::delta (fod, Eigen::Vector3f (0.0, 0.0, 1.0), P.S.lmax);
                     init_log_prob = 0.5 * std::log (Math::SH::value (P.values, Eigen::Vector3f (0.0, 0.0, 1.0), P.S.lmax));
                   }
@@ -470,9 +475,12 @@ namespace MR
                   P.pos = { 0.0f, 0.0f, 0.0f };
                   P.get_path (positions, tangents, Eigen::Vector3f (std::sin (el), 0.0, std::cos(el)));
 
+                  batch.set (tangents);
+                  const Eigen::VectorXf amplitudes = batch.values (P.values);
+
                   float log_prob = init_log_prob;
                   for (size_t i = 0; i < P.S.num_samples; ++i) {
-                    float prob = Math::SH::value (P.values, tangents[i], P.S.lmax) * (1.0 - (positions[i][0] / vox));
+                    float prob = amplitudes[i] * (1.0 - (positions[i][0] / vox));
                     if (prob <= 0.0)
                       return 0.0;
                     prob = std::log (prob);
@@ -491,6 +499,7 @@ namespace MR
                 const float vox;
                 float init_log_prob;
                 vector<Eigen::Vector3f> positions, tangents;
+                Math::SH::Batch<float> batch;
             };
 
             friend void calibrate<iFOD2> (iFOD2& method);
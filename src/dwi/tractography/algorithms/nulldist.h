@@ -57,7 +57,7 @@ namespace MR
       NullDist1 (const Shared& shared) :
         MethodBase (shared),
         S (shared),
-        source (S.source) { }
+        source (S.source, S.bricks()) { }
 
 
       bool init() override {
@@ -103,7 +103,7 @@ namespace MR
       NullDist2 (const Shared& shared) :
         iFOD2 (shared),
         S (shared),
-        source (S.source),
+        source (S.source, S.bricks()),
         positions (S.num_samples),
         tangents (S.num_samples),
         sample_idx (S.num_samples) { }
@@ -111,7 +111,7 @@ namespace MR
       NullDist2 (const NullDist2& that) :
         iFOD2 (that),
         S (that.S),
-        source (S.source),
+        source (S.source, S.bricks()),
         positions (S.num_samples),
         tangents (S.num_samples),
         sample_idx (S.num_samples) { }
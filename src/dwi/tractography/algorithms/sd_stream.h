@@ -83,12 +83,12 @@ class SDStream : public MethodBase { MEMALIGN(SDStream)
     SDStream (const Shared& shared) :
       MethodBase (shared),
       S (shared),
-      source (S.source) { }
+      source (S.source, S.bricks()) { }
 
     SDStream (const SDStream& that) :
       MethodBase (that.S),
       S (that.S),
-      source (S.source) { }
+      source (S.source, S.bricks()) { }
 
 
     ~SDStream () { }
@@ -86,7 +86,7 @@ namespace MR
       Tensor_Det (const Shared& shared) :
         MethodBase (shared),
         S (shared),
-        source (S.source),
+        source (S.source, S.bricks()),
         eig (3),
         M (3,3),
         dt (6) { }
@@ -48,6 +48,15 @@ namespace MR {
 
             bool operator() (Streamline<>&);
 
+            //! whether the first input file can be skipped through without reading it
+            bool can_seek () { return reader->has_index(); }
+
+            //! skip directly past the first \a n non-empty streamlines of the first input file
+            /*! This requires can_seek() to be true. \returns the number of
+             * streamlines skipped, and sets \a num_empty to the number of
+             * those that were empty. */
+            size_t seek (size_t n, size_t& num_empty);
+
 
           private:
             const vector<std::string>& file_list;
@@ -59,6 +68,24 @@ namespace MR {
 
 
 
+        size_t Loader::seek (size_t n, size_t& num_empty)
+        {
+          assert (!file_index);
+          const size_t num_tracks = reader->num_tracks();
+          size_t target = 0;
+          num_empty = 0;
+          for (; target < num_tracks && n; ++target) {
+            if (reader->num_points (target))
+              --n;
+            else
+              ++num_empty;
+          }
+          reader->seek (target);
+          return target;
+        }
+
+
+
         bool Loader::operator() (Streamline<>& out)
         {
           out.clear();
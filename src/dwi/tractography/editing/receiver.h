@@ -63,6 +63,17 @@ namespace MR {
 
             bool operator() (const Streamline<>&);
 
+            //! account for streamlines that were skipped without being read
+            /*! \a num_empty of the \a num_tracks streamlines skipped were
+             * empty; the remainder count towards the number to be skipped. */
+            void skipped (size_t num_tracks, size_t num_empty) {
+              assert (num_empty <= num_tracks);
+              total_count += num_tracks;
+              skip -= std::min<uint64_t> (skip, num_tracks - num_empty);
+              for (size_t n = 0; n < num_empty; ++n)
+                writer.skip();
+            }
+
 
           private:
 
@@ -17,15 +17,26 @@
 #ifndef __dwi_tractography_file_h__
 #define __dwi_tractography_file_h__
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 
 #include "app.h"
+#include "thread.h"
 #include "types.h"
 #include "memory.h"
+#include "raw.h"
 #include "file/config.h"
+#include "file/entry.h"
 #include "file/key_value.h"
+#include "file/mmap.h"
 #include "file/ofstream.h"
+#include "file/utils.h"
 #include "dwi/tractography/file_base.h"
+#include "dwi/tractography/file_compressed.h"
+#include "dwi/tractography/file_index.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
@@ -58,18 +69,53 @@ namespace MR
 
 
       //! A class to read streamlines data
+      /*! By default, the track data are memory-mapped (see the
+       * TrackReaderMemoryMap config file option). In this case, streamlines
+       * can be read as a StreamlineView, which refers directly to the vertices
+       * within the mapping whenever the data on file are stored with native
+       * byte order and precision, avoiding any allocation or copying. Reading
+       * into a Streamline copies the vertices from the mapping in one go.
+       *
+       * Compressed track files (.tckz; see Compressed) are read
+       * transparently, with their blocks decompressed concurrently. */
       template <class ValueType = float>
       class Reader : public __ReaderBase__, public ReaderInterface<ValueType>
       { NOMEMALIGN
         public:
+          using point_type = Eigen::Matrix<ValueType,3,1>;
 
           //! open the \c file for reading and load header into \c properties
-          Reader (const std::string& file, Properties& properties)
+          Reader (const std::string& file, Properties& properties) :
+              random_access (false),
+              is_compressed (Path::has_suffix (file, ".tckz")),
+              position (0),
+              prefetched (0)
           {
-            open (file, "tracks", properties);
+            open (file, is_compressed ? "tracks compressed" : "tracks", properties);
             auto opt = App::get_options ("tck_weights_in");
             if (opt.size())
               weights = load_vector<ValueType> (opt[0][0]);
+
+            //CONF option: TrackReaderMemoryMap
+            //CONF default: 1 (true)
+            //CONF Whether to memory-map track files for reading. If disabled,
+            //CONF track files are instead read through a regular file stream.
+            use_mmap = File::Config::get_bool ("TrackReaderMemoryMap", true);
+            if (is_compressed) {
+              open_compressed();
+              in.close();
+              use_mmap = true;
+            }
+            else if (use_mmap) {
+              try {
+                map();
+                in.close();
+              }
+              catch (Exception&) {
+                DEBUG ("unable to memory-map track file \"" + data_path + "\"; reading as stream");
+                use_mmap = false;
+              }
+            }
           }
 
 
@@ -77,6 +123,15 @@ namespace MR
             bool operator() (Streamline<ValueType>& tck) {
               tck.clear();
 
+              if (use_mmap) {
+                if (!(*this) (view))
+                  return false;
+                tck.assign (view.begin(), view.end());
+                tck.set_index (view.get_index());
+                tck.weight = view.weight;
+                return true;
+              }
+
               if (!in.is_open())
                 return false;
 
@@ -94,24 +149,10 @@ namespace MR
                 }
 
                 if (std::isnan (p[0])) {
-                  tck.set_index (current_index++);
-
-                  if (weights.size()) {
-
-                    if (tck.get_index() < size_t(weights.size())) {
-                      tck.weight = weights[tck.get_index()];
-                    } else {
-                      WARN ("Streamline weights file contains less entries (" + str(weights.size()) + ") than .tck file; "
-                            "ceasing reading of streamline data");
-                      in.close();
-                      tck.clear();
-                      return false;
-                    }
-
-                  } else {
-                    tck.weight = 1.0;
+                  if (!set_index_and_weight (tck)) {
+                    tck.clear();
+                    return false;
                   }
-
                   return true;
                 }
 
@@ -123,13 +164,253 @@ namespace MR
             }
 
 
+            //! fetch next track from file, without copying its vertices
+            /*! The vertices referred to by \a tck remain valid until the next
+             * streamline is read, or the Reader is closed or destroyed. */
+            bool operator() (StreamlineView<ValueType>& tck) {
+              tck.clear();
+
+              if (!use_mmap) {
+                if (!(*this) (buffer_tck))
+                  return false;
+                tck.set (buffer_tck.data(), buffer_tck.size());
+                tck.set_index (buffer_tck.get_index());
+                tck.weight = buffer_tck.weight;
+                return true;
+              }
+
+              if (!mmap && !compressed)
+                return false;
+
+              if (!(compressed ? (*compressed) (tck) : next_mapped (tck))) {
+                check_excess_weights();
+                close();
+                return false;
+              }
+
+              if (!set_index_and_weight (tck)) {
+                tck.clear();
+                return false;
+              }
+              return true;
+            }
+
+
+            void close () {
+              mmap.reset();
+              compressed.reset();
+              in.close();
+            }
+
+
+
+            //! the number of streamlines in the file
+            /*! This requires the streamline index (see seek()). */
+            size_t num_tracks () {
+              if (is_compressed) {
+                open_compressed();
+                return compressed->num_tracks();
+              }
+              load_index();
+              return index.size();
+            }
+
+            //! whether a valid sidecar index is available for this file
+            /*! If so, num_tracks(), num_points() and seek() can be used
+             * without scanning through the track data. This is never the
+             * case for compressed track files. */
+            bool has_index () {
+              if (is_compressed)
+                return false;
+              return !index.empty() || index.load (data_path, data_offset);
+            }
+
+            //! the number of vertices in streamline \a n
+            /*! This requires the streamline index (see seek()), and is not
+             * available for compressed track files. */
+            size_t num_points (size_t n) {
+              assert (!is_compressed);
+              load_index();
+              assert (n < index.size());
+              return (index[n+1] - index[n]) / (3 * dtype.bytes()) - 1;
+            }
+
+            //! position the reader so that the next streamline read is streamline \a n
+            /*! The byte offset of each streamline is obtained from the
+             * sidecar index file written alongside the track file (see the
+             * TrackWriterIndex config file option) if present and valid;
+             * otherwise, the index is built by scanning through the track
+             * data once. Subsequent calls do not need to re-read the track
+             * data. For compressed track files, the block headers serve as
+             * the index. */
+            void seek (size_t n) {
+              if (is_compressed) {
+                if (n > num_tracks())
+                  throw Exception ("cannot seek to streamline " + str(n) + " in track file \"" + data_path + "\" (contains " + str(num_tracks()) + " streamlines)");
+                compressed->seek (n);
+                current_index = n;
+                random_access = true;
+                return;
+              }
+              load_index();
+              if (n > index.size())
+                throw Exception ("cannot seek to streamline " + str(n) + " in track file \"" + data_path + "\" (contains " + str(index.size()) + " streamlines)");
+              if (use_mmap) {
+                if (!mmap)
+                  map();
+                position = index[n] - data_offset;
+              }
+              else {
+                if (!in.is_open()) {
+                  in.open (data_path.c_str(), std::ios::in | std::ios::binary);
+                  if (!in)
+                    throw Exception ("error re-opening track data file \"" + data_path + "\": " + strerror(errno));
+                }
+                in.clear();
+                in.seekg (index[n]);
+              }
+              current_index = n;
+              random_access = true;
+            }
+
+
 
         protected:
           using __ReaderBase__::in;
           using __ReaderBase__::dtype;
+          using __ReaderBase__::data_path;
+          using __ReaderBase__::data_offset;
           using __ReaderBase__::current_index;
 
           Eigen::Matrix<ValueType, Eigen::Dynamic, 1> weights;
+          FileIndex index;
+          bool random_access;
+
+          const bool is_compressed;
+          bool use_mmap;
+          std::unique_ptr<File::MMap> mmap;
+          std::unique_ptr<Compressed::Reader<ValueType>> compressed;
+          int64_t position, prefetched;
+          StreamlineView<ValueType> view;
+          Streamline<ValueType> buffer_tck;
+          vector<point_type> buffer;
+
+          void load_index () {
+            if (!index.empty())
+              return;
+            if (!index.load (data_path, data_offset)) {
+              INFO ("no valid index found for track file \"" + data_path + "\"; indexing streamlines...");
+              index.build (data_path, data_offset, dtype);
+            }
+          }
+
+          void open_compressed () {
+            if (!compressed)
+              compressed.reset (new Compressed::Reader<ValueType> (data_path, data_offset));
+          }
+
+          void map () {
+            mmap.reset (new File::MMap (File::Entry (data_path, data_offset)));
+            position = prefetched = 0;
+          }
+
+          template <class StreamlineType>
+            bool set_index_and_weight (StreamlineType& tck) {
+              tck.set_index (current_index++);
+              if (weights.size()) {
+                if (tck.get_index() < size_t(weights.size())) {
+                  tck.weight = weights[tck.get_index()];
+                } else {
+                  WARN ("Streamline weights file contains less entries (" + str(weights.size()) + ") than .tck file; "
+                        "ceasing reading of streamline data");
+                  close();
+                  return false;
+                }
+              } else {
+                tck.weight = 1.0;
+              }
+              return true;
+            }
+
+
+          //! locate the next streamline within the memory-mapped track data
+          /*! \returns false if the end of the data has been reached. */
+          bool next_mapped (StreamlineView<ValueType>& tck)
+          {
+            // ask for the data to be paged in ahead of time:
+            constexpr int64_t prefetch_size = 8388608;
+            if (position + prefetch_size/2 >= prefetched) {
+              prefetched = std::max (prefetched, position);
+              mmap->prefetch (prefetched, prefetch_size);
+              prefetched += prefetch_size;
+            }
+
+            const uint8_t* first = mmap->address() + position;
+            size_t num_points = 0;
+            bool found = false;
+            switch (dtype()) {
+              case DataType::Float32LE: found = find_delimiter<float,true> (num_points); break;
+              case DataType::Float32BE: found = find_delimiter<float,false> (num_points); break;
+              case DataType::Float64LE: found = find_delimiter<double,true> (num_points); break;
+              case DataType::Float64BE: found = find_delimiter<double,false> (num_points); break;
+              default: assert (0); break;
+            }
+            if (!found)
+              return false;
+
+            DataType native (DataType::from<ValueType>());
+            native.set_byte_order_native();
+            if (dtype == native && !(reinterpret_cast<size_t> (first) % alignof (point_type))) {
+              tck.set (reinterpret_cast<const point_type*> (first), num_points);
+            }
+            else {
+              buffer.resize (num_points);
+              for (size_t n = 0; n < num_points; ++n)
+                buffer[n] = get_point (first, n);
+              tck.set (buffer.data(), num_points);
+            }
+            return true;
+          }
+
+          //! advance past the next delimiter, counting the vertices in between
+          template <typename StoredType, bool little_endian>
+            bool find_delimiter (size_t& num_points)
+            {
+              constexpr int64_t point_size = 3 * sizeof (StoredType);
+              const uint8_t* data = mmap->address();
+              for (; position + point_size <= mmap->size(); position += point_size) {
+                const StoredType x = little_endian ?
+                  Raw::fetch_LE<StoredType> (data + position) :
+                  Raw::fetch_BE<StoredType> (data + position);
+                if (std::isinf (x))
+                  return false;
+                if (std::isnan (x)) {
+                  position += point_size;
+                  return true;
+                }
+                ++num_points;
+              }
+              return false;
+            }
+
+          //! fetch vertex \a n from the mapped data, handling byte order & precision
+          point_type get_point (const uint8_t* data, size_t n) const
+          {
+            switch (dtype()) {
+              case DataType::Float32LE:
+                return { ValueType(Raw::fetch_LE<float> (data, 3*n)), ValueType(Raw::fetch_LE<float> (data, 3*n+1)), ValueType(Raw::fetch_LE<float> (data, 3*n+2)) };
+              case DataType::Float32BE:
+                return { ValueType(Raw::fetch_BE<float> (data, 3*n)), ValueType(Raw::fetch_BE<float> (data, 3*n+1)), ValueType(Raw::fetch_BE<float> (data, 3*n+2)) };
+              case DataType::Float64LE:
+                return { ValueType(Raw::fetch_LE<double> (data, 3*n)), ValueType(Raw::fetch_LE<double> (data, 3*n+1)), ValueType(Raw::fetch_LE<double> (data, 3*n+2)) };
+              case DataType::Float64BE:
+                return { ValueType(Raw::fetch_BE<double> (data, 3*n)), ValueType(Raw::fetch_BE<double> (data, 3*n+1)), ValueType(Raw::fetch_BE<double> (data, 3*n+2)) };
+              default:
+                assert (0);
+                break;
+            }
+            return { NaN, NaN, NaN };
+          }
 
           //! takes care of byte ordering issues
 
@@ -171,7 +452,7 @@ namespace MR
           //! Check that the weights file does not contain excess entries
           void check_excess_weights()
           {
-            if (!weights.size())
+            if (!weights.size() || random_access)
               return;
             if (size_t(weights.size()) > current_index) {
               WARN ("Streamline weights file contains more entries (" + str(weights.size()) + ") than .tck file (" + str(current_index) + ")");
@@ -199,6 +480,12 @@ namespace MR
        * use cases where a very large number of track files are being written
        * at once. For most applications (where typically one track file is
        * written at a time), the Writer class is more appropriate.
+       *
+       * If \a file has the suffix .tckz, a compressed track file is written
+       * (see Compressed), with vertex positions quantised as specified by
+       * the TrackWriterPrecision config file option. In this case, each
+       * streamline is written as a separate compressed block, so the Writer
+       * class will yield much better compression.
        * */
       template <class ValueType = float>
         class WriterUnbuffered : public __WriterBase__<ValueType>, public WriterInterface<ValueType>
@@ -217,10 +504,12 @@ namespace MR
 
           //! create a new track file with the specified properties
           WriterUnbuffered (const std::string& file, const Properties& properties) :
-              __WriterBase__<ValueType> (file) {
+              __WriterBase__<ValueType> (file),
+              compressed (Path::has_suffix (name, ".tckz")),
+              precision (compressed ? Compressed::precision() : 0.0) {
 
-            if (!Path::has_suffix (name, ".tck"))
-              throw Exception ("output track files must use the .tck suffix");
+            if (!Path::is_track_file (name))
+              throw Exception ("output track files must use the .tck or .tckz suffix");
 
             File::OFStream out;
             try {
@@ -233,12 +522,30 @@ namespace MR
             const_cast<Properties&> (properties).set_version_info();
             const_cast<Properties&> (properties).update_command_history();
 
-            create (out, properties, "tracks");
+            create (out, properties, compressed ? "tracks compressed" : "tracks");
             barrier_addr = out.tellp();
 
-            vector_type x;
-            format_point (barrier(), x);
-            out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            //CONF option: TrackWriterIndex
+            //CONF default: 0 (false)
+            //CONF Whether to write an index of the byte offset of each
+            //CONF streamline alongside each track file written (with the
+            //CONF additional suffix .idx), allowing other commands to access
+            //CONF any streamline directly without scanning through the file.
+            write_index = !compressed && File::Config::get_bool ("TrackWriterIndex", false);
+            if (write_index)
+              index.reset (barrier_addr);
+            else if (Path::exists (FileIndex::sidecar (name)))
+              File::remove (FileIndex::sidecar (name));
+
+            if (compressed) {
+              const auto x = Compressed::barrier();
+              out.write (reinterpret_cast<const char*> (x.data()), x.size());
+            }
+            else {
+              vector_type x;
+              format_point (barrier(), x);
+              out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            }
             if (!out.good())
               throw Exception ("error writing tracks file \"" + name + "\": " + strerror (errno));
             open_success = true;
@@ -248,8 +555,30 @@ namespace MR
               set_weights_path (opt[0][0]);
           }
 
+          //! write the streamline index to file if requested
+          ~WriterUnbuffered () {
+            if (write_index && open_success) {
+              try {
+                // the index records the modification time of the completed
+                // file, so the final counts must be written out first:
+                {
+                  File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+                  update_counts (out);
+                }
+                open_success = false;
+                index.finalise (barrier_addr);
+                index.save (name);
+              }
+              catch (Exception& e) {
+                e.display();
+              }
+            }
+          }
+
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
+            if (write_index)
+              index.push_back (barrier_addr);
             // allocate buffer on the stack for performance:
             NON_POD_VLA (buffer, vector_type, tck.size()+2);
             for (size_t n = 0; n < tck.size(); ++n) {
@@ -281,6 +610,10 @@ namespace MR
         protected:
           std::string weights_name;
           int64_t barrier_addr;
+          const bool compressed;
+          const double precision;
+          bool write_index;
+          FileIndex index;
 
           //! indicates end of track and start of new track
           vector_type delimiter () const { return { ValueType(NaN), ValueType(NaN), ValueType(NaN) }; }
@@ -311,18 +644,60 @@ namespace MR
           void commit (vector_type* data, size_t num_points) {
             if (num_points == 0 || !open_success)
               return;
+            vector<uint8_t> blocks;
+            const int64_t size = prepare (data, num_points, blocks);
+            write_tail (data, num_points, blocks, barrier_addr);
+            write_head (data, blocks, barrier_addr, count, total_count);
+            barrier_addr += size;
+          }
 
-            int64_t prev_barrier_addr = barrier_addr;
-
+          //! prepare track point data for writing
+          /*! appends the end-of-data marker to \a data, or for compressed
+           * files encodes \a data into \a blocks, followed by the
+           * end-of-data marker. \returns the number of bytes by which the
+           * end-of-data marker will move once these data are written. */
+          int64_t prepare (vector_type* data, size_t num_points, vector<uint8_t>& blocks) {
+            if (compressed) {
+              Compressed::encode (data, num_points, precision, blocks);
+              const auto end = Compressed::barrier();
+              blocks.insert (blocks.end(), end.begin(), end.end());
+              return blocks.size() - Compressed::header_size;
+            }
             format_point (barrier(), data[num_points]);
-            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
-            out.write (reinterpret_cast<const char* const> (data+1), sizeof (vector_type) * num_points);
+            return num_points * sizeof (vector_type);
+          }
+
+          //! write prepared data to file, to be placed at offset \a addr
+          /*! everything is written except the leading vertex or block
+           * header, which would overwrite the end-of-data marker at \a addr,
+           * so that the new data remain invisible to readers until
+           * write_head() is called. */
+          void write_tail (const vector_type* data, size_t num_points, const vector<uint8_t>& blocks, int64_t addr) {
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            if (compressed) {
+              out.seekp (addr + Compressed::header_size, out.beg);
+              out.write (reinterpret_cast<const char*> (blocks.data() + Compressed::header_size), blocks.size() - Compressed::header_size);
+            }
+            else {
+              out.seekp (addr + sizeof (vector_type), out.beg);
+              out.write (reinterpret_cast<const char*> (data+1), sizeof (vector_type) * num_points);
+            }
             verify_stream (out);
-            barrier_addr = int64_t (out.tellp()) - sizeof(vector_type);
-            out.seekp (prev_barrier_addr, out.beg);
-            out.write (reinterpret_cast<const char* const> (data), sizeof(vector_type));
+          }
+
+          //! replace the end-of-data marker at \a addr with the start of the prepared data
+          /*! this links data previously written using write_tail() into
+           * the file, and updates the streamline counts in the header to \a
+           * num_tracks and \a num_total. */
+          void write_head (const vector_type* data, const vector<uint8_t>& blocks, int64_t addr, uint64_t num_tracks, uint64_t num_total) {
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp (addr, out.beg);
+            if (compressed)
+              out.write (reinterpret_cast<const char*> (blocks.data()), Compressed::header_size);
+            else
+              out.write (reinterpret_cast<const char*> (data), sizeof (vector_type));
             verify_stream (out);
-            update_counts (out);
+            update_counts (out, num_tracks, num_total);
           }
 
 
@@ -347,6 +722,18 @@ namespace MR
        * to file concurrently. The size of the write-back buffer defaults to
        * 16MB, and can be set in the config file using the
        * TrackWriterBufferSize field (in bytes).
+       *
+       * Full buffers are committed to file by separate writer threads, while
+       * streamlines are added to a fresh buffer. Up to TrackWriterThreads
+       * buffers are committed concurrently: each thread prepares its buffer
+       * (including compression for .tckz output), reserves the next region
+       * of the file, and writes its data into that region in parallel with
+       * the others. Regions are then linked into the file strictly in
+       * order, by overwriting the end-of-data marker at the start of each
+       * region and updating the streamline counts in the header. Readers
+       * therefore only ever see complete data, and the counts in the header
+       * always match the data before the end-of-data marker, even if the
+       * command is interrupted.
        * */
       template <typename ValueType = float>
         class Writer : public WriterUnbuffered<ValueType>
@@ -358,6 +745,9 @@ namespace MR
           using WriterUnbuffered<ValueType>::format_point;
           using WriterUnbuffered<ValueType>::weights_name;
           using WriterUnbuffered<ValueType>::write_weights;
+          using WriterUnbuffered<ValueType>::barrier_addr;
+          using WriterUnbuffered<ValueType>::write_index;
+          using WriterUnbuffered<ValueType>::index;
           using vector_type = typename WriterUnbuffered<ValueType>::vector_type;
 
           //! create new RAM-buffered track file with specified properties
@@ -375,13 +765,43 @@ namespace MR
             WriterUnbuffered<ValueType> (file, properties),
             buffer_capacity (File::Config::get_int ("TrackWriterBufferSize", default_buffer_capacity) / sizeof (vector_type)),
             buffer (new vector_type [buffer_capacity]),
-            buffer_size (0) { }
+            buffer_size (0),
+            buffer_addr (barrier_addr),
+            //CONF option: TrackWriterThreads
+            //CONF default: 2
+            //CONF The maximum number of write-back buffers to commit to
+            //CONF file concurrently when writing track files, each by its
+            //CONF own thread into its own region of the file, while the
+            //CONF command carries on producing streamlines. Each additional
+            //CONF thread requires an additional write-back buffer. Set to 0
+            //CONF to commit each buffer synchronously instead.
+            max_regions (std::max (File::Config::get_int ("TrackWriterThreads", 2), 0)),
+            num_regions (0),
+            num_placed (0),
+            num_linked (0),
+            next_addr (barrier_addr),
+            error_reported (false) { }
 
           Writer (const Writer& W) = delete;
 
           //! commits any remaining data to file
           ~Writer() {
-            commit();
+            try {
+              commit();
+            }
+            catch (Exception& e) {
+              e.display();
+              App::exit_error_code = 1;
+            }
+            while (regions.size())
+              release_region();
+            try {
+              check_error();
+            }
+            catch (Exception& e) {
+              e.display();
+              App::exit_error_code = 1;
+            }
           }
 
           //! append track to file
@@ -389,6 +809,10 @@ namespace MR
             if (buffer_size + tck.size() + 2 > buffer_capacity)
               commit ();
 
+            // the first point in the buffer will overwrite the current barrier:
+            if (write_index)
+              index.push_back (buffer_addr + buffer_size * sizeof (vector_type));
+
             for (const auto& i : tck) {
               assert (i.allFinite());
               add_point (i);
@@ -405,10 +829,61 @@ namespace MR
 
 
         protected:
+          //! a full buffer, committed to its own region of the file by its own thread
+          class Region { NOMEMALIGN
+            public:
+              Region (Writer& writer, size_t index, std::unique_ptr<vector_type[]>& buffer, size_t num_points,
+                  uint64_t count, uint64_t total_count, std::string& weights) :
+                  writer (writer),
+                  index (index),
+                  data (std::move (buffer)),
+                  num_points (num_points),
+                  count (count),
+                  total_count (total_count),
+                  weights (std::move (weights)),
+                  done (false) {
+                    // held through a type-erased pointer, since the type
+                    // returned by Thread::run() is local to each translation unit:
+                    thread.reset (new auto (Thread::run (*this, "track writer")));
+                  }
+
+              //! wait for the thread to complete
+              ~Region () { thread.reset(); }
+
+              void execute () {
+                writer.write_region (*this);
+                done = true;
+              }
+
+              Writer& writer;
+              const size_t index;
+              std::unique_ptr<vector_type[]> data;
+              const size_t num_points;
+              const uint64_t count, total_count;
+              const std::string weights;
+              std::atomic<bool> done;
+              std::shared_ptr<void> thread;
+          };
+
           const size_t buffer_capacity;
           std::unique_ptr<vector_type[]> buffer;
           size_t buffer_size;
           std::string weights_buffer;
+          // file offset at which the current buffer will be written:
+          int64_t buffer_addr;
+
+          const size_t max_regions;
+          std::deque<std::unique_ptr<Region>> regions;
+          vector<std::unique_ptr<vector_type[]>> spare_buffers;
+          size_t num_regions;
+
+          // state shared with the writer threads:
+          size_t num_placed, num_linked;
+          int64_t next_addr;
+          std::unique_ptr<Exception> error;
+          bool error_reported;
+          std::mutex mutex;
+          std::condition_variable cond;
 
           //! add point to buffer and increment buffer_size accordingly
           void add_point (const vector_type& p) {
@@ -416,12 +891,103 @@ namespace MR
           }
 
           void commit () {
-            WriterUnbuffered<ValueType>::commit (buffer.get(), buffer_size);
+            buffer_addr += buffer_size * sizeof (vector_type);
+
+            if (!max_regions) {
+              WriterUnbuffered<ValueType>::commit (buffer.get(), buffer_size);
+              buffer_size = 0;
+              if (weights_name.size()) {
+                write_weights (weights_buffer);
+                weights_buffer.clear();
+              }
+              return;
+            }
+
+            // reclaim the buffers of regions already written, and wait for
+            // a free writer if all are busy:
+            while (regions.size() && (regions.size() >= max_regions || regions.front()->done))
+              release_region();
+            check_error();
+            if (failed())
+              buffer_size = 0;
+            if (!buffer_size)
+              return;
+
+            regions.emplace_back (new Region (*this, num_regions++, buffer, buffer_size, count, total_count, weights_buffer));
+            weights_buffer.clear();
+            if (spare_buffers.size()) {
+              buffer = std::move (spare_buffers.back());
+              spare_buffers.pop_back();
+            }
+            else
+              buffer.reset (new vector_type [buffer_capacity]);
             buffer_size = 0;
+          }
+
+          //! wait for the oldest region to be written, and recycle its buffer
+          void release_region () {
+            std::unique_ptr<Region> region (std::move (regions.front()));
+            regions.pop_front();
+            region->thread.reset();
+            spare_buffers.push_back (std::move (region->data));
+          }
+
+          //! commit a region to file; invoked from the region's own thread
+          void write_region (Region& region) {
+            try {
+              vector<uint8_t> blocks;
+              const int64_t size = this->prepare (region.data.get(), region.num_points, blocks);
+
+              // reserve the next region of the file; the size of compressed
+              // data is only known at this point, so this is done in order:
+              int64_t addr;
+              {
+                std::unique_lock<std::mutex> lock (mutex);
+                cond.wait (lock, [&] { return num_placed == region.index || error; });
+                if (error)
+                  return;
+                addr = next_addr;
+                next_addr += size;
+                ++num_placed;
+              }
+              cond.notify_all();
+
+              // this is where the bulk of the I/O happens, concurrently
+              // with the other writer threads:
+              this->write_tail (region.data.get(), region.num_points, blocks, addr);
+
+              // link into the file once all preceding regions are in place:
+              std::unique_lock<std::mutex> lock (mutex);
+              cond.wait (lock, [&] { return num_linked == region.index || error; });
+              if (error)
+                return;
+              this->write_head (region.data.get(), blocks, addr, region.count, region.total_count);
+              if (weights_name.size())
+                write_weights (region.weights);
+              barrier_addr = addr + size;
+              ++num_linked;
+              lock.unlock();
+              cond.notify_all();
+            }
+            catch (Exception& e) {
+              std::lock_guard<std::mutex> lock (mutex);
+              if (!error)
+                error.reset (new Exception (e));
+              cond.notify_all();
+            }
+          }
+
+          bool failed () {
+            std::lock_guard<std::mutex> lock (mutex);
+            return bool (error);
+          }
 
-            if (weights_name.size()) {
-              write_weights (weights_buffer);
-              weights_buffer.clear();
+          //! report any error raised in the writer threads (once only)
+          void check_error () {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (error && !error_reported) {
+              error_reported = true;
+              throw Exception (*error, "error writing track file \"" + this->name + "\"");
             }
           }
 
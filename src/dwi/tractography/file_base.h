@@ -41,7 +41,7 @@ namespace MR
       class __ReaderBase__
       { NOMEMALIGN
         public:
-            __ReaderBase__() : current_index (0) { }
+            __ReaderBase__() : data_offset (0), current_index (0) { }
           ~__ReaderBase__ () {
             if (in.is_open())
               in.close();
@@ -54,6 +54,8 @@ namespace MR
         protected:
           std::ifstream in;
           DataType dtype;
+          std::string data_path;
+          int64_t data_offset;
           uint64_t current_index;
       };
 
@@ -146,8 +148,12 @@ namespace MR
             }
 
             void update_counts (File::OFStream& out) {
+              update_counts (out, count, total_count);
+            }
+
+            void update_counts (File::OFStream& out, uint64_t num_tracks, uint64_t num_total) {
               out.seekp (count_offset);
-              out << count << "\ntotal_count: " << total_count << "\nEND\n";
+              out << num_tracks << "\ntotal_count: " << num_total << "\nEND\n";
               verify_stream (out);
             }
         };
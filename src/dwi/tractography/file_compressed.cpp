@@ -0,0 +1,110 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <zlib.h>
+
+#include "raw.h"
+#include "file/config.h"
+#include "dwi/tractography/file_compressed.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Compressed
+      {
+
+
+        double precision ()
+        {
+          //CONF option: TrackWriterPrecision
+          //CONF default: 0.01
+          //CONF The quantisation step (in mm) for vertex positions when
+          //CONF writing compressed track files (.tckz). Vertices are stored
+          //CONF to within half of this distance of their true position.
+          static const double value = File::Config::get_float ("TrackWriterPrecision", 0.01);
+          if (!(value > 0.0))
+            throw Exception ("invalid value for TrackWriterPrecision config file option (must be positive)");
+          return value;
+        }
+
+
+
+        vector<Block> index (const uint8_t* data, int64_t size)
+        {
+          vector<Block> blocks;
+          int64_t offset = 0;
+          size_t num_tracks = 0;
+          while (offset + int64_t(header_size) <= size) {
+            const uint8_t* p = data + offset;
+            Block block;
+            block.offset = offset;
+            block.compressed_size = Raw::fetch_LE<uint64_t> (p, 0);
+            if (!block.compressed_size)
+              return blocks;
+            block.raw_size = Raw::fetch_LE<uint64_t> (p, 1);
+            block.num_tracks = Raw::fetch_LE<uint32_t> (p, 4);
+            block.num_points = Raw::fetch_LE<uint32_t> (p, 5);
+            block.precision = Raw::fetch_LE<double> (p, 3);
+            block.first_track = num_tracks;
+            offset += header_size + block.compressed_size;
+            if (offset > size)
+              break;
+            num_tracks += block.num_tracks;
+            blocks.push_back (block);
+          }
+          WARN ("compressed track data are truncated; only " + str(num_tracks) + " streamlines can be read");
+          return blocks;
+        }
+
+
+
+        void pack (const vector<uint8_t>& raw, uint32_t num_tracks, uint32_t num_points, double precision, vector<uint8_t>& block)
+        {
+          const size_t start = block.size();
+          uLongf compressed_size = compressBound (raw.size());
+          block.resize (start + header_size + compressed_size);
+          if (compress2 (block.data() + start + header_size, &compressed_size, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw Exception ("error compressing streamline data");
+          block.resize (start + header_size + compressed_size);
+
+          uint8_t* p = block.data() + start;
+          Raw::store_LE<uint64_t> (compressed_size, p, 0);
+          Raw::store_LE<uint64_t> (raw.size(), p, 1);
+          Raw::store_LE<double> (precision, p, 3);
+          Raw::store_LE<uint32_t> (num_tracks, p, 4);
+          Raw::store_LE<uint32_t> (num_points, p, 5);
+        }
+
+
+
+        void unpack (const uint8_t* data, const Block& info, vector<uint8_t>& raw)
+        {
+          raw.resize (info.raw_size);
+          uLongf raw_size = info.raw_size;
+          if (uncompress (raw.data(), &raw_size, data + info.offset + header_size, info.compressed_size) != Z_OK || raw_size != info.raw_size)
+            throw Exception ("error decompressing streamline data");
+        }
+
+
+      }
+    }
+  }
+}
+
@@ -0,0 +1,336 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_file_compressed_h__
+#define __dwi_tractography_file_compressed_h__
+
+#include <atomic>
+
+#include "memory.h"
+#include "thread.h"
+#include "types.h"
+#include "file/entry.h"
+#include "file/mmap.h"
+#include "dwi/tractography/streamline.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! Compressed track files (.tckz)
+      /*! These files share the text header of regular track files (with
+       * first line "mrtrix tracks compressed"), but hold the track data as a
+       * series of independently compressed blocks, each holding a number of
+       * complete streamlines. Each block consists of a 32-byte header
+       * holding the sizes of the compressed and uncompressed payload (as
+       * 64-bit integers), the number of streamlines and vertices it contains
+       * (as 32-bit integers), and the quantisation step for vertex positions
+       * (as a 64-bit floating-point value), all little-endian, followed by
+       * the zlib-compressed payload. The end of the data is marked by a
+       * block header with a payload size of zero.
+       *
+       * Within the uncompressed payload, each streamline is stored as its
+       * number of vertices, followed by the position of each vertex as a
+       * multiple of the quantisation step. The first vertex is stored as is,
+       * the second as the difference from the first, and subsequent vertices
+       * as the difference from the position predicted by linear extrapolation
+       * of the previous two. All values are stored as (zig-zag encoded, for
+       * signed values) LEB128 variable-length integers.
+       *
+       * Since the block headers form an index of the file, blocks can be
+       * located without decompressing any data, and are decompressed
+       * concurrently when reading. */
+      namespace Compressed
+      {
+
+        constexpr size_t header_size = 32;
+
+        //! the location and contents of one block within the track data
+        class Block { NOMEMALIGN
+          public:
+            int64_t offset;             /**< byte offset of the block header within the track data */
+            uint64_t compressed_size;   /**< size of the compressed payload */
+            uint64_t raw_size;          /**< size of the uncompressed payload */
+            uint32_t num_tracks;        /**< number of streamlines in the block */
+            uint32_t num_points;        /**< number of vertices in the block */
+            double precision;           /**< quantisation step for vertex positions */
+            size_t first_track;         /**< index of the first streamline in the block */
+        };
+
+        //! the quantisation step to use when writing, in mm
+        double precision ();
+
+        //! locate all blocks within \a size bytes of track data at \a data
+        vector<Block> index (const uint8_t* data, int64_t size);
+
+        //! append the block header & compressed payload for \a raw to \a block
+        void pack (const vector<uint8_t>& raw, uint32_t num_tracks, uint32_t num_points, double precision, vector<uint8_t>& block);
+
+        //! decompress the payload of \a info, with track data at \a data
+        void unpack (const uint8_t* data, const Block& info, vector<uint8_t>& raw);
+
+        //! an empty block header, to mark the end of the track data
+        inline vector<uint8_t> barrier () { return vector<uint8_t> (header_size, 0); }
+
+
+
+        inline void put (vector<uint8_t>& raw, uint64_t value)
+        {
+          while (value >= 0x80) {
+            raw.push_back (uint8_t (value) | 0x80);
+            value >>= 7;
+          }
+          raw.push_back (uint8_t (value));
+        }
+
+        inline void put_signed (vector<uint8_t>& raw, int64_t value)
+        {
+          put (raw, (uint64_t (value) << 1) ^ uint64_t (value >> 63));
+        }
+
+        inline uint64_t get (const uint8_t*& p, const uint8_t* end)
+        {
+          uint64_t value = 0;
+          for (size_t shift = 0; p < end && shift < 64; shift += 7) {
+            const uint8_t byte = *p++;
+            value |= uint64_t (byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+              return value;
+          }
+          throw Exception ("malformed data in compressed track file");
+        }
+
+        inline int64_t get_signed (const uint8_t*& p, const uint8_t* end)
+        {
+          const uint64_t value = get (p, end);
+          return int64_t (value >> 1) ^ -int64_t (value & 1);
+        }
+
+
+
+
+        //! encode vertex data as one or more blocks, appended to \a out
+        /*! \a data holds \a num_points vertices, with the end of each
+         * streamline marked by a vertex with NaN as its first component (as
+         * in the write-back buffer of Writer). Data are split into blocks of
+         * complete streamlines of around \a block_points vertices, and these
+         * are compressed concurrently. */
+        template <typename ValueType>
+          void encode (const Eigen::Matrix<ValueType,3,1>* data, size_t num_points, double precision,
+              vector<uint8_t>& out, size_t block_points = 65536)
+          {
+            // split into blocks at streamline boundaries:
+            vector<std::pair<size_t,size_t>> ranges;
+            size_t start = 0;
+            for (size_t n = 0; n < num_points; ++n) {
+              if (std::isnan (data[n][0]) && (n + 1 - start >= block_points || n + 1 == num_points)) {
+                ranges.push_back ({ start, n+1 });
+                start = n+1;
+              }
+            }
+            assert (start == num_points);
+
+            vector<vector<uint8_t>> blocks (ranges.size());
+            std::atomic<size_t> next (0);
+            auto encoder = [&] () {
+              vector<uint8_t> raw;
+              size_t b;
+              while ((b = next++) < ranges.size()) {
+                raw.clear();
+                uint32_t num_tracks = 0, num_vertices = 0;
+                size_t track_start = ranges[b].first;
+                for (size_t n = ranges[b].first; n < ranges[b].second; ++n) {
+                  if (!std::isnan (data[n][0]))
+                    continue;
+                  put (raw, n - track_start);
+                  Eigen::Matrix<int64_t,3,1> previous (0, 0, 0), step (0, 0, 0);
+                  for (size_t i = track_start; i < n; ++i) {
+                    for (size_t axis = 0; axis < 3; ++axis) {
+                      const int64_t q = std::llround (data[i][axis] / precision);
+                      put_signed (raw, q - previous[axis] - step[axis]);
+                      if (i > track_start)
+                        step[axis] = q - previous[axis];
+                      previous[axis] = q;
+                    }
+                  }
+                  num_vertices += n - track_start;
+                  ++num_tracks;
+                  track_start = n+1;
+                }
+                pack (raw, num_tracks, num_vertices, precision, blocks[b]);
+              }
+            };
+
+            // run single-threaded if already within a multi-threaded section
+            // (e.g. the sink of tckgen's queue), or if -nthreads 0:
+            const size_t num_threads = std::min (Thread::threads_to_execute(), ranges.size());
+            if (num_threads > 1) {
+              struct Encoder { NOMEMALIGN
+                decltype(encoder)& func;
+                void execute () { func(); }
+              } functor { encoder };
+              auto threads = Thread::run (Thread::multi (functor, num_threads), "track compression");
+              threads.wait();
+            }
+            else
+              encoder();
+
+            for (const auto& block : blocks)
+              out.insert (out.end(), block.begin(), block.end());
+          }
+
+
+
+
+
+        //! read streamlines from compressed track data
+        /*! Blocks are decompressed in batches, using as many threads as there
+         * are blocks in each batch. Streamlines are returned as views onto the
+         * decoded vertices, which remain valid until the next batch is
+         * decoded. */
+        template <typename ValueType>
+          class Reader
+          { NOMEMALIGN
+            public:
+              using point_type = Eigen::Matrix<ValueType,3,1>;
+
+              Reader (const std::string& path, int64_t offset) :
+                  mmap (File::Entry (path, offset)),
+                  blocks (index (mmap.address(), mmap.size())),
+                  next_block (0),
+                  current (0),
+                  track (0) { }
+
+              size_t num_tracks () const {
+                return blocks.empty() ? 0 : blocks.back().first_track + blocks.back().num_tracks;
+              }
+
+              //! position the reader so that the next streamline read is streamline \a n
+              void seek (size_t n) {
+                assert (n <= num_tracks());
+                auto it = std::upper_bound (blocks.begin(), blocks.end(), n,
+                    [] (size_t i, const Block& b) { return i < b.first_track; });
+                next_block = it == blocks.begin() ? 0 : (it - blocks.begin()) - 1;
+                decoded.clear();
+                current = 0;
+                track = 0;
+                if (next_block < blocks.size() && decode_batch())
+                  track = n - blocks[next_block - decoded.size()].first_track;
+              }
+
+              //! fetch the vertices of the next streamline
+              bool operator() (StreamlineView<ValueType>& tck) {
+                while (current >= decoded.size() || track >= decoded[current].lengths.size()) {
+                  if (current < decoded.size()) {
+                    ++current;
+                    track = 0;
+                  }
+                  if (current >= decoded.size() && !decode_batch())
+                    return false;
+                }
+                const auto& block (decoded[current]);
+                tck.set (block.vertices.data() + block.offsets[track], block.lengths[track]);
+                ++track;
+                return true;
+              }
+
+            private:
+              class Decoded { NOMEMALIGN
+                public:
+                  vector<point_type> vertices;
+                  vector<size_t> offsets, lengths;
+              };
+
+              File::MMap mmap;
+              const vector<Block> blocks;
+              vector<Decoded> decoded;
+              size_t next_block, current, track;
+
+              bool decode_batch () {
+                const size_t count = std::min (std::max (Thread::threads_to_execute(), size_t(1)), blocks.size() - next_block);
+                decoded.resize (count);
+                current = 0;
+                track = 0;
+                if (!count)
+                  return false;
+
+                std::atomic<size_t> next (0);
+                auto decoder = [&] () {
+                  vector<uint8_t> raw;
+                  size_t n;
+                  while ((n = next++) < count)
+                    decode (blocks[next_block + n], raw, decoded[n]);
+                };
+                struct Decoder { NOMEMALIGN
+                  decltype(decoder)& func;
+                  void execute () { func(); }
+                } functor { decoder };
+                if (count > 1) {
+                  auto threads = Thread::run (Thread::multi (functor, count), "track decompression");
+                  threads.wait();
+                }
+                else
+                  functor.execute();
+
+                next_block += count;
+                return true;
+              }
+
+              void decode (const Block& info, vector<uint8_t>& raw, Decoded& out) const {
+                unpack (mmap.address(), info, raw);
+                out.vertices.resize (info.num_points);
+                out.offsets.resize (info.num_tracks);
+                out.lengths.resize (info.num_tracks);
+                const uint8_t* p = raw.data();
+                const uint8_t* end = p + raw.size();
+                size_t v = 0;
+                for (size_t t = 0; t < info.num_tracks; ++t) {
+                  const size_t length = get (p, end);
+                  if (v + length > info.num_points)
+                    throw Exception ("malformed data in compressed track file \"" + mmap.name() + "\"");
+                  out.offsets[t] = v;
+                  out.lengths[t] = length;
+                  Eigen::Matrix<int64_t,3,1> q (0, 0, 0), step (0, 0, 0);
+                  for (size_t i = 0; i < length; ++i, ++v) {
+                    for (size_t axis = 0; axis < 3; ++axis) {
+                      const int64_t value = q[axis] + step[axis] + get_signed (p, end);
+                      if (i)
+                        step[axis] = value - q[axis];
+                      q[axis] = value;
+                      out.vertices[v][axis] = ValueType (value * info.precision);
+                    }
+                  }
+                }
+                if (v != info.num_points)
+                  throw Exception ("malformed data in compressed track file \"" + mmap.name() + "\"");
+              }
+          };
+
+      }
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -0,0 +1,192 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <fstream>
+
+#include "raw.h"
+#include "file/entry.h"
+#include "file/mmap.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "dwi/tractography/file_index.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      namespace {
+
+        const char magic[] = "MRtckIX2";
+        constexpr size_t magic_size = sizeof (magic) - 1;
+
+        bool stat (const std::string& path, int64_t& size, int64_t& mtime)
+        {
+          struct stat buf;
+          if (::stat (path.c_str(), &buf))
+            return false;
+          size = buf.st_size;
+          mtime = File::modification_time (buf);
+          return true;
+        }
+
+        template <typename ValueType, bool little_endian>
+          void scan (const uint8_t* data, int64_t size, int64_t offset, vector<int64_t>& offsets)
+          {
+            constexpr int64_t point_size = 3 * sizeof (ValueType);
+            offsets.push_back (offset);
+            for (; offset + point_size <= size; offset += point_size) {
+              const ValueType first = little_endian ?
+                Raw::fetch_LE<ValueType> (data + offset) :
+                Raw::fetch_BE<ValueType> (data + offset);
+              if (std::isinf (first))
+                break;
+              if (std::isnan (first))
+                offsets.push_back (offset + point_size);
+            }
+            // last entry is the position of the barrier, even if the file
+            // has been truncated and does not contain one:
+            offsets.back() = offset;
+          }
+
+      }
+
+
+
+
+      bool FileIndex::load (const std::string& path, int64_t offset)
+      {
+        offsets.clear();
+        const std::string index_path = sidecar (path);
+        if (!Path::exists (index_path))
+          return false;
+
+        std::ifstream in (index_path, std::ios::in | std::ios::binary);
+        char header[magic_size + 4*sizeof(uint64_t)];
+        in.read (header, sizeof (header));
+        if (!in || memcmp (header, magic, magic_size)) {
+          WARN ("ignoring invalid track index file \"" + index_path + "\"");
+          return false;
+        }
+        file_size = Raw::fetch_LE<int64_t> (header + magic_size, 0);
+        file_mtime = Raw::fetch_LE<int64_t> (header + magic_size, 1);
+        data_offset = Raw::fetch_LE<int64_t> (header + magic_size, 2);
+        const uint64_t count = Raw::fetch_LE<uint64_t> (header + magic_size, 3);
+
+        int64_t size, mtime;
+        if (!stat (path, size, mtime) || size != file_size || mtime != file_mtime || data_offset != offset) {
+          INFO ("track index file \"" + index_path + "\" does not match track file \"" + path + "\" - ignored");
+          return false;
+        }
+
+        // the number of streamlines must agree with the size of the index
+        // file, so that a corrupt count cannot trigger a huge allocation:
+        int64_t index_size, index_mtime;
+        if (!stat (index_path, index_size, index_mtime) ||
+            index_size <= int64_t (sizeof (header)) ||
+            (index_size - sizeof (header)) % sizeof (uint64_t) ||
+            count != (index_size - sizeof (header)) / sizeof (uint64_t) - 1) {
+          WARN ("ignoring truncated or corrupt track index file \"" + index_path + "\"");
+          return false;
+        }
+
+        vector<uint64_t> raw (count + 1);
+        in.read (reinterpret_cast<char*> (raw.data()), raw.size() * sizeof (uint64_t));
+        if (!in) {
+          WARN ("ignoring truncated track index file \"" + index_path + "\"");
+          return false;
+        }
+
+        // offsets must lie within the track data, in increasing order:
+        offsets.reserve (raw.size());
+        for (const auto& n : raw) {
+          const uint64_t value = ByteOrder::LE (n);
+          if (value < uint64_t (data_offset) || value > uint64_t (file_size) ||
+              (offsets.size() && int64_t (value) <= offsets.back())) {
+            WARN ("ignoring corrupt track index file \"" + index_path + "\"");
+            offsets.clear();
+            return false;
+          }
+          offsets.push_back (value);
+        }
+
+        DEBUG ("loaded track index file \"" + index_path + "\" (" + str(count) + " streamlines)");
+        return true;
+      }
+
+
+
+
+      void FileIndex::build (const std::string& path, int64_t offset, const DataType& dtype)
+      {
+        offsets.clear();
+        data_offset = offset;
+        if (!stat (path, file_size, file_mtime))
+          throw Exception ("error opening track data file \"" + path + "\": " + strerror (errno));
+
+        File::MMap mmap (File::Entry (path, offset), false, false);
+        const uint8_t* data = mmap.address();
+        const int64_t data_size = mmap.size();
+
+        switch (dtype()) {
+          case DataType::Float32LE: scan<float,true>   (data, data_size, 0, offsets); break;
+          case DataType::Float32BE: scan<float,false>  (data, data_size, 0, offsets); break;
+          case DataType::Float64LE: scan<double,true>  (data, data_size, 0, offsets); break;
+          case DataType::Float64BE: scan<double,false> (data, data_size, 0, offsets); break;
+          default: assert (0); break;
+        }
+
+        for (auto& n : offsets)
+          n += offset;
+
+        DEBUG ("indexed track data file \"" + path + "\" (" + str(size()) + " streamlines)");
+      }
+
+
+
+
+      void FileIndex::save (const std::string& path)
+      {
+        assert (!offsets.empty());
+        if (!stat (path, file_size, file_mtime))
+          throw Exception ("error accessing track file \"" + path + "\": " + strerror (errno));
+
+        vector<int64_t> data (4 + offsets.size());
+        Raw::store_LE<int64_t> (file_size, data.data(), 0);
+        Raw::store_LE<int64_t> (file_mtime, data.data(), 1);
+        Raw::store_LE<int64_t> (data_offset, data.data(), 2);
+        Raw::store_LE<int64_t> (size(), data.data(), 3);
+        for (size_t n = 0; n < offsets.size(); ++n)
+          Raw::store_LE<int64_t> (offsets[n], data.data(), n+4);
+
+        const std::string index_path = sidecar (path);
+        File::OFStream out (index_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write (magic, magic_size);
+        out.write (reinterpret_cast<const char*> (data.data()), data.size() * sizeof (int64_t));
+        if (!out.good())
+          throw Exception ("error writing track index file \"" + index_path + "\": " + strerror (errno));
+      }
+
+
+    }
+  }
+}
+
@@ -0,0 +1,103 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_file_index_h__
+#define __dwi_tractography_file_index_h__
+
+#include "datatype.h"
+#include "types.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! the byte offsets of each streamline within a track file
+      /*! This allows random access to any streamline in a track file without
+       * scanning through the preceding data. The index can be stored in a
+       * sidecar file alongside the track file (with the additional suffix
+       * \c .idx), in which case it is validated against the track file
+       * before use; it can otherwise be built by scanning through the track
+       * data once.
+       *
+       * The sidecar file consists of the 8-byte magic string "MRtckIX2",
+       * followed by the size and modification time (in nanoseconds) of the
+       * track file, the offset to its track data, and the number of
+       * streamlines \e N, and finally the \e N+1 offsets to the start of
+       * each streamline and to the end-of-data barrier, all as
+       * little-endian 64-bit integers. The index is only considered valid
+       * if the size and modification time of the track file still match;
+       * it must therefore be saved once the track file is complete. */
+      class FileIndex
+      { NOMEMALIGN
+        public:
+          FileIndex () : file_size (0), file_mtime (0), data_offset (0) { }
+
+          //! the path to the sidecar index file for track file \a path
+          static std::string sidecar (const std::string& path) { return path + ".idx"; }
+
+          //! load the sidecar index for the track data in \a path
+          /*! \returns false if no sidecar index exists, if it does not
+           * match the current size and modification time of the track
+           * file, or if it is corrupt: its streamline count must agree with
+           * its size, and its offsets must increase and lie within the
+           * track data. */
+          bool load (const std::string& path, int64_t offset);
+
+          //! build the index by scanning through the track data in \a path
+          void build (const std::string& path, int64_t offset, const DataType& dtype);
+
+          //! write the index to the sidecar file for track file \a path
+          /*! This records the size and modification time of the track file,
+           * and must therefore only be invoked once it has been closed. */
+          void save (const std::string& path);
+
+          //! start a new index for track data at \a offset in a file being written
+          void reset (int64_t offset) {
+            offsets.clear();
+            data_offset = offset;
+            file_size = 0;
+          }
+          //! record the start of the next streamline, at byte offset \a offset
+          void push_back (int64_t offset) { offsets.push_back (offset); }
+          //! record the end of the track data, at byte offset \a barrier
+          void finalise (int64_t barrier) { offsets.push_back (barrier); }
+
+          bool empty () const { return offsets.empty(); }
+          //! the number of streamlines in the index
+          size_t size () const { return offsets.empty() ? 0 : offsets.size() - 1; }
+          //! the byte offset of the first vertex of streamline \a n
+          /*! if \a n equals size(), this is the offset to the end-of-data
+           * barrier. */
+          int64_t operator[] (size_t n) const { assert (n < offsets.size()); return offsets[n]; }
+
+        private:
+          vector<int64_t> offsets;
+          int64_t file_size, file_mtime, data_offset;
+      };
+
+
+    }
+  }
+}
+
+
+#endif
+
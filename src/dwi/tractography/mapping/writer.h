@@ -22,8 +22,10 @@
 #include "file/utils.h"
 #include "image.h"
 #include "algo/loop.h"
+#include "algo/threaded_loop.h"
 #include "thread_queue.h"
 
+#include "dwi/tractography/streamline.h"
 #include "dwi/tractography/mapping/twi_stats.h"
 #include "dwi/tractography/mapping/voxel.h"
 #include "dwi/tractography/mapping/gaussian/voxel.h"
@@ -66,6 +68,11 @@ namespace MR {
             // std::terminate() with no further ado).
             virtual void finalise() { }
 
+            // Create an additional writer, into which a single thread can
+            //   accumulate streamlines; these are combined with the output
+            //   when finalise() is called
+            virtual MapWriterBase* partial() { throw Exception ("FIXME: Thread-local buffers not supported by this TWI writer"); }
+
 
 
             virtual bool operator() (const SetVoxel&)    { return false; }
@@ -150,8 +157,16 @@ namespace MR {
 
           MapWriter (const MapWriter&) = delete;
 
+          MapWriterBase* partial () override {
+            std::lock_guard<std::mutex> lock (mutex);
+            partials.push_back (make_unique<MapWriter> (H, output_image_name, voxel_statistic, type));
+            return partials.back().get();
+          }
+
           void finalise () override {
 
+            combine_partials();
+
             auto loop = Loop (buffer, 0, 3);
             switch (voxel_statistic) {
 
@@ -250,6 +265,25 @@ namespace MR {
 
           private:
           Image<value_type> buffer;
+          vector<std::unique_ptr<MapWriter>> partials;
+          std::mutex mutex;
+
+          // Functor for combining the contents of a partial buffer with the output
+          class Combine { NOMEMALIGN
+            public:
+              Combine (const writer_dim type, const vox_stat_t voxel_statistic) :
+                  type (type),
+                  voxel_statistic (voxel_statistic) { }
+              void operator() (Image<value_type>& out, Image<value_type>& in);
+              void operator() (Image<value_type>& out, Image<value_type>& in, Image<float>& out_counts, Image<float>& in_counts);
+            private:
+              const writer_dim type;
+              const vox_stat_t voxel_statistic;
+              static void add (Image<value_type>& out, Image<value_type>& in);
+              static void copy (Image<value_type>& out, Image<value_type>& in);
+          };
+
+          void combine_partials();
 
           // Template functions used so that the functors don't have to be written twice
           //   (once for standard TWI and one for Gaussian track-wise statistic)
@@ -440,6 +474,89 @@ namespace MR {
 
 
 
+        template <typename value_type>
+          void MapWriter<value_type>::combine_partials ()
+          {
+            // Greyscale and dixel buffers are combined element-wise; DEC and TOD
+            //   buffers need all volumes of each voxel to be processed together
+            const bool per_voxel = (type == DEC || type == TOD);
+            for (auto& p : partials) {
+              Combine combine (type, voxel_statistic);
+              auto loop = ThreadedLoop ("combining thread-local TWI buffers", buffer, 0, per_voxel ? 3 : buffer.ndim());
+              if (counts)
+                loop.run (combine, buffer, p->buffer, *counts, *p->counts);
+              else
+                loop.run (combine, buffer, p->buffer);
+              p.reset();
+            }
+            partials.clear();
+          }
+
+
+
+        template <typename value_type>
+          void MapWriter<value_type>::Combine::add (Image<value_type>& out, Image<value_type>& in)
+          {
+            for (auto l = Loop (3) (out, in); l; ++l)
+              out.value() = value_type (out.value() + in.value());
+          }
+
+        template <typename value_type>
+          void MapWriter<value_type>::Combine::copy (Image<value_type>& out, Image<value_type>& in)
+          {
+            for (auto l = Loop (3) (out, in); l; ++l)
+              out.value() = in.value();
+          }
+
+        template <typename value_type>
+          void MapWriter<value_type>::Combine::operator() (Image<value_type>& out, Image<value_type>& in)
+          {
+            switch (type) {
+              case DEC:
+                if (voxel_statistic == V_MEAN) {
+                  add (out, in);
+                } else {
+                  default_type norm_out = 0.0, norm_in = 0.0;
+                  for (auto l = Loop (3) (out, in); l; ++l) {
+                    norm_out += Math::pow2 (default_type (out.value()));
+                    norm_in  += Math::pow2 (default_type (in.value()));
+                  }
+                  if (voxel_statistic == V_MIN ? (norm_in < norm_out) : (norm_in > norm_out))
+                    copy (out, in);
+                }
+                break;
+              case TOD:
+                add (out, in);
+                break;
+              default:
+                switch (voxel_statistic) {
+                  case V_MIN: out.value() = std::min (value_type (out.value()), value_type (in.value())); break;
+                  case V_MAX: out.value() = std::max (value_type (out.value()), value_type (in.value())); break;
+                  default:    out.value() = value_type (out.value() + in.value()); break;
+                }
+            }
+          }
+
+        template <typename value_type>
+          void MapWriter<value_type>::Combine::operator() (Image<value_type>& out, Image<value_type>& in, Image<float>& out_counts, Image<float>& in_counts)
+          {
+            // With TOD min / max, the counts buffers hold the factor of the streamline mapped to each voxel
+            if (type == TOD && (voxel_statistic == V_MIN || voxel_statistic == V_MAX)) {
+              if (voxel_statistic == V_MIN ? (in_counts.value() < out_counts.value()) : (in_counts.value() > out_counts.value())) {
+                copy (out, in);
+                out_counts.value() = in_counts.value();
+              }
+              return;
+            }
+            if (type == DEC || type == TOD)
+              add (out, in);
+            else
+              out.value() = value_type (out.value() + in.value());
+            out_counts.value() += in_counts.value();
+          }
+
+
+
         template <>
         inline void MapWriter<bool>::add (const default_type weight, const default_type factor)
         {
@@ -503,6 +620,46 @@ namespace MR {
 
 
 
+
+
+        // Maps streamlines and accumulates them within each processing thread,
+        //   rather than passing the mapped voxels of every streamline to a single
+        //   writer thread; each copy of this functor writes into its own partial
+        //   buffer obtained from MapWriterBase::partial()
+        template <class MapperType, class SetType>
+          class MapAccumulator
+        { MEMALIGN(MapAccumulator<MapperType,SetType>)
+
+          public:
+            MapAccumulator (const MapperType& mapper, MapWriterBase& writer) :
+                mapper (mapper),
+                writer (writer),
+                local (nullptr) { }
+
+            MapAccumulator (const MapAccumulator& that) :
+                mapper (that.mapper),
+                writer (that.writer),
+                local (nullptr) { }
+
+            bool operator() (Streamline<>& in)
+            {
+              if (!local)
+                local = writer.partial();
+              mapper (in, voxels);
+              return (*local) (voxels);
+            }
+
+          private:
+            MapperType mapper;
+            MapWriterBase& writer;
+            MapWriterBase* local;
+            SetType voxels;
+        };
+
+
+
+
+
       }
     }
   }
@@ -23,7 +23,18 @@ namespace MR
     namespace Tractography
     {
 
-      thread_local Math::RNG rng;
+      thread_local RNG rng;
+
+
+
+      uint64_t RNG::get_base_seed ()
+      {
+        const char* from_env = getenv ("MRTRIX_RNG_SEED");
+        if (from_env)
+          return to<uint64_t> (from_env);
+        std::random_device rd;
+        return (uint64_t (rd()) << 32) | uint64_t (rd());
+      }
 
     }
   }
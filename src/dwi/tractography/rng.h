@@ -26,8 +26,59 @@ namespace MR
     namespace Tractography
     {
 
+      //! random number generator used during streamline tractography
+      /*! By default, this behaves exactly as Math::RNG. Once set_stream()
+       * has been called, it instead produces a counter-based sequence of
+       * numbers that depends only on the base seed and the stream index
+       * provided (e.g. the index of the seed point being tracked), and not
+       * on what the generator was previously used for. This allows the
+       * output of multi-threaded tracking to be independent of which thread
+       * processes which streamline. */
+      class RNG : public Math::RNG
+      { NOMEMALIGN
+        public:
+          RNG () : counter_based (false), key (0), counter (0) { }
+          RNG (const RNG& that) : Math::RNG (that), counter_based (false), key (0), counter (0) { }
+
+          //! switch to the counter-based sequence for stream \a index of \a seed
+          void set_stream (uint64_t seed, uint64_t index) {
+            key = mix (mix (seed) ^ (index * weyl));
+            counter = 0;
+            counter_based = true;
+          }
+
+          //! revert to the default std::mt19937 sequence
+          void clear_stream () { counter_based = false; }
+
+          result_type operator() () {
+            if (!counter_based)
+              return Math::RNG::operator() ();
+            return result_type (mix (key + (++counter) * weyl) >> 32);
+          }
+
+          //! seed for reproducible multi-threaded tracking
+          /*! This is set from the MRTRIX_RNG_SEED environment variable if
+           * present, and drawn from std::random_device otherwise. */
+          static uint64_t get_base_seed ();
+
+        private:
+          bool counter_based;
+          uint64_t key, counter;
+
+          static constexpr uint64_t weyl = 0x9E3779B97F4A7C15ULL;
+
+          // SplitMix64 finaliser
+          static uint64_t mix (uint64_t x) {
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+          }
+      };
+
+
+
       //! thread-local, but globally accessible RNG to vastly simplify multi-threading
-      extern thread_local Math::RNG rng;
+      extern thread_local RNG rng;
 
     }
   }
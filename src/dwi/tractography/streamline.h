@@ -130,6 +130,46 @@ namespace MR
 
 
 
+      //! a read-only view onto streamline vertices stored elsewhere
+      /*! This provides the same interface as a const Streamline for
+       * iterating over its vertices, but does not own them: the vertices
+       * typically reside directly within a memory-mapped track file (see
+       * Reader::operator()(StreamlineView&)), and remain valid only until the
+       * next streamline is read. */
+      template <typename ValueType = float>
+        class StreamlineView : public DataIndex
+      { NOMEMALIGN
+        public:
+          using point_type = Eigen::Matrix<ValueType,3,1>;
+          using value_type = ValueType;
+          using const_iterator = const point_type*;
+
+          StreamlineView () : first (nullptr), num_points (0), weight (1.0f) { }
+          StreamlineView (const point_type* first, size_t num_points) :
+            first (first), num_points (num_points), weight (1.0f) { }
+
+          const point_type* data () const { return first; }
+          size_t size () const { return num_points; }
+          bool empty () const { return !num_points; }
+          const point_type& operator[] (size_t n) const { assert (n < num_points); return first[n]; }
+          const point_type& front () const { assert (num_points); return first[0]; }
+          const point_type& back () const { assert (num_points); return first[num_points-1]; }
+          const_iterator begin () const { return first; }
+          const_iterator end () const { return first + num_points; }
+
+          void set (const point_type* data, size_t size) { first = data; num_points = size; }
+          void clear () { first = nullptr; num_points = 0; DataIndex::clear(); weight = 1.0; }
+
+        private:
+          const point_type* first;
+          size_t num_points;
+
+        public:
+          float weight;
+      };
+
+
+
       template <typename PointType>
       typename PointType::Scalar length (const vector<PointType>& tck)
       {
@@ -141,6 +181,17 @@ namespace MR
         return value;
       }
 
+      template <typename ValueType>
+      ValueType length (const StreamlineView<ValueType>& tck)
+      {
+        if (tck.empty())
+          return std::numeric_limits<ValueType>::quiet_NaN();
+        ValueType value = ValueType(0);
+        for (size_t i = 1; i != tck.size(); ++i)
+          value += (tck[i] - tck[i-1]).norm();
+        return value;
+      }
+
 
 
     }
@@ -0,0 +1,98 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/tracking/bricked_volume.h"
+
+#include "algo/threaded_loop.h"
+#include "file/config.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        BrickedVolume::BrickedVolume (const Image<float>& image) :
+            image (image),
+            num_volumes (image.ndim() > 3 ? image.size(3) : 1),
+            //CONF option: TrackingHalfPrecision
+            //CONF default: 0 (false)
+            //CONF Whether to store the copies of the input images used
+            //CONF during streamline tractography (see TrackingBrickedImages)
+            //CONF as 16-bit floating-point values, halving their memory
+            //CONF footprint at the expense of precision.
+            half_precision (File::Config::get_bool ("TrackingHalfPrecision", false))
+        {
+          for (size_t axis = 0; axis < 3; ++axis)
+            num_bricks[axis] = (image.size (axis) + brick_size - 1) / brick_size;
+        }
+
+
+
+        bool BrickedVolume::enabled ()
+        {
+          //CONF option: TrackingBrickedImages
+          //CONF default: 0 (false)
+          //CONF Whether to copy the images used during streamline
+          //CONF tractography into a layout optimised for access along
+          //CONF streamlines, with all volumes of each voxel contiguous and
+          //CONF voxels grouped into spatial bricks of 4x4x4, irrespective
+          //CONF of the strides of the images on file. The original images
+          //CONF remain loaded, so this roughly doubles the memory required
+          //CONF for them (see also TrackingHalfPrecision).
+          static const bool value = File::Config::get_bool ("TrackingBrickedImages", false);
+          return value;
+        }
+
+
+
+        void BrickedVolume::pack () const
+        {
+          const size_t size = num_bricks[0] * num_bricks[1] * num_bricks[2] * brick_size * brick_size * brick_size * num_volumes;
+          if (half_precision)
+            data_half.resize (size, Eigen::half (0.0f));
+          else
+            data.resize (size, 0.0f);
+
+          auto in = image;
+          ThreadedLoop ("preparing image \"" + image.name() + "\" for tracking", in, 0, 3).run ([&] (Image<float>& voxel) {
+            const size_t offset = voxel_offset (voxel.index(0), voxel.index(1), voxel.index(2));
+            for (ssize_t n = 0; n < num_volumes; ++n) {
+              if (num_volumes > 1)
+                voxel.index(3) = n;
+              if (half_precision)
+                data_half[offset + n] = Eigen::half (voxel.value());
+              else
+                data[offset + n] = voxel.value();
+            }
+          }, in);
+
+          INFO ("image \"" + image.name() + "\" repacked for tracking (" + str (size * (half_precision ? 2 : 4) / (1024.0*1024.0), 3) + " MB)");
+        }
+
+
+
+      }
+    }
+  }
+}
+
@@ -0,0 +1,105 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_tracking_bricked_volume_h__
+#define __dwi_tractography_tracking_bricked_volume_h__
+
+
+#include <mutex>
+
+#include "image.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        //! A copy of a 4D image laid out for access along streamlines
+        /*! All volumes of each voxel are stored contiguously, and voxels are
+         * grouped into spatial bricks of 4x4x4 voxels, each stored
+         * contiguously; the 8 corners of any interpolation cell therefore
+         * usually lie within a few kB of each other, irrespective of the
+         * strides of the image on file. Values can optionally be stored as
+         * 16-bit floating-point, halving the memory footprint.
+         *
+         * The image is only repacked on the first call to get(), so that
+         * tracking algorithms that do not use it incur no cost. The
+         * original image is retained (it is still needed for its header,
+         * and by seeding and other consumers), so the copy adds to the
+         * memory footprint; repacking is therefore only performed if
+         * enabled via the TrackingBrickedImages config file option. */
+        class BrickedVolume
+        { MEMALIGN(BrickedVolume)
+          public:
+            static constexpr ssize_t brick_size = 4;
+
+            BrickedVolume (const Image<float>& image);
+
+            //! whether repacking of images for tracking is enabled
+            static bool enabled ();
+
+            //! the volume, repacked if this has not already been done
+            const BrickedVolume* get () const {
+              std::call_once (packed, [this] () { pack(); });
+              return this;
+            }
+
+            //! copy the values of all volumes at voxel [ \a x \a y \a z ] into \a values
+            template <class VectorType>
+              FORCE_INLINE void load (ssize_t x, ssize_t y, ssize_t z, VectorType&& values) const
+              {
+                const size_t offset = voxel_offset (x, y, z);
+                if (half_precision)
+                  values = Eigen::Map<const Eigen::Matrix<Eigen::half,Eigen::Dynamic,1>> (data_half.data() + offset, num_volumes).template cast<float>();
+                else
+                  values = Eigen::Map<const Eigen::VectorXf> (data.data() + offset, num_volumes);
+              }
+
+          protected:
+            Image<float> image;
+            const ssize_t num_volumes;
+            ssize_t num_bricks[3];
+            const bool half_precision;
+            mutable vector<float> data;
+            mutable vector<Eigen::half> data_half;
+            mutable std::once_flag packed;
+
+            FORCE_INLINE size_t voxel_offset (ssize_t x, ssize_t y, ssize_t z) const
+            {
+              const size_t brick = ((z / brick_size) * num_bricks[1] + (y / brick_size)) * num_bricks[0] + (x / brick_size);
+              const size_t within = ((z % brick_size) * brick_size + (y % brick_size)) * brick_size + (x % brick_size);
+              return (brick * brick_size * brick_size * brick_size + within) * num_volumes;
+            }
+
+            void pack () const;
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
@@ -20,6 +20,7 @@
 
 #include "thread.h"
 #include "thread_queue.h"
+#include "ordered_thread_queue.h"
 #include "dwi/directions/set.h"
 #include "dwi/tractography/streamline.h"
 #include "dwi/tractography/rng.h"
@@ -52,6 +53,48 @@ namespace MR
       {
 
 
+        //! A seed point, along with its position in the sequence of seeds drawn
+        class Seed { MEMALIGN(Seed)
+          public:
+            Eigen::Vector3f pos, dir;
+            uint64_t index;
+        };
+
+
+
+        //! Draws seed points one at a time for deterministic tracking
+        /*! Each seed is drawn using its own random number stream, which
+         * depends only on the index of the seed; the tracking of each seed
+         * uses a different stream, again determined only by that index. */
+        class SeedSource { MEMALIGN(SeedSource)
+          public:
+            SeedSource (const SharedBase& shared) :
+                S (shared),
+                count (0) { }
+
+            bool operator() (Seed& seed)
+            {
+              seed.index = count++;
+              seed.dir = { NaN, NaN, NaN };
+              rng.set_stream (S.rng_seed, 2 * seed.index);
+              if (S.properties.seeds.is_finite())
+                return S.properties.seeds.get_seed (seed.pos, seed.dir);
+              for (size_t num_attempts = 0; num_attempts != MAX_NUM_SEED_ATTEMPTS; ++num_attempts) {
+                if (S.properties.seeds.get_seed (seed.pos, seed.dir))
+                  return true;
+              }
+              FAIL ("Failed to find suitable seed point after " + str (MAX_NUM_SEED_ATTEMPTS) + " attempts - aborting");
+              return false;
+            }
+
+          private:
+            const SharedBase& S;
+            uint64_t count;
+        };
+
+
+
+
         // TODO Try having ACT as a template boolean; allow compiler to optimise out branch statements
 
         template <class Method> class Exec { MEMALIGN(Exec<Method>)
@@ -66,7 +109,20 @@ namespace MR
                 typename Method::Shared shared (diff_path, properties);
                 WriteKernel writer (shared, destination, properties);
                 Exec<Method> tracker (shared);
-                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+
+                if (shared.deterministic) {
+                  // Seeds are drawn in order, and streamlines written back in that same
+                  //   order, so the output does not depend on the scheduling of threads
+                  SeedSource seeds (shared);
+                  Thread::run_ordered_queue (
+                      seeds,
+                      Thread::batch (Seed(), TRACKING_BATCH_SIZE),
+                      Thread::multi (tracker),
+                      Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE),
+                      writer);
+                } else {
+                  Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                }
 
               } else {
 
@@ -126,10 +182,41 @@ namespace MR
             bool operator() (GeneratedTrack& item) {
               if (!seed_track (item))
                 return false;
+              track (item);
+              return true;
+            }
+
+
+            bool operator() (const Seed& seed, GeneratedTrack& item) {
+              rng.set_stream (S.rng_seed, 2 * seed.index + 1);
+              item.clear();
+              track_excluded = false;
+              include_visitation.reset();
+              method.pos = seed.pos;
+              method.dir = seed.dir;
+              if (!method.check_seed() || !method.init()) {
+                track_excluded = true;
+                item.set_status (GeneratedTrack::status_t::SEED_REJECTED);
+              }
+              track (item);
+              return true;
+            }
+
+
+          private:
+
+            const typename Method::Shared& S;
+            Method method;
+            bool track_excluded;
+            IncludeROIVisitation include_visitation;
+
+
+            void track (GeneratedTrack& item)
+            {
               if (track_excluded) {
                 item.set_status (GeneratedTrack::status_t::SEED_REJECTED);
                 S.add_rejection (INVALID_SEED);
-                return true;
+                return;
               }
               gen_track (item);
               if (track_rejected (item)) {
@@ -141,18 +228,9 @@ namespace MR
               } else {
                 item.set_status (GeneratedTrack::status_t::ACCEPTED);
               }
-              return true;
             }
 
 
-          private:
-
-            const typename Method::Shared& S;
-            Method method;
-            bool track_excluded;
-            IncludeROIVisitation include_visitation;
-
-
             term_t iterate ()
             {
               const term_t method_term = (S.rk4 ? next_rk4() : method.next());
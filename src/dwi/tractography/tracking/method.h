@@ -45,6 +45,8 @@ namespace MR
               dir (0.0, 0.0, 1.0),
               S (shared),
               act_method_additions (S.is_act() ? new ACT::ACT_Method_additions (S) : nullptr),
+              cache_hits (0),
+              cache_lookups (0),
               values (shared.source.size(3)) { }
 
             MethodBase (const MethodBase& that) :
@@ -52,9 +54,17 @@ namespace MR
               dir (0.0, 0.0, 1.0),
               S (that.S),
               act_method_additions (S.is_act() ? new ACT::ACT_Method_additions (that.act()) : nullptr),
+              cache_hits (0),
+              cache_lookups (0),
               uniform (that.uniform),
               values (that.values.size()) { }
 
+            ~MethodBase ()
+            {
+              if (cache_lookups)
+                S.update_cache_stats (cache_hits, cache_lookups);
+            }
+
 
             template <class InterpolatorType>
             FORCE_INLINE bool get_data (InterpolatorType& source, const Eigen::Vector3f& position)
@@ -66,6 +76,18 @@ namespace MR
               return !std::isnan (values[0]);
             }
 
+            template <class ImageType>
+            FORCE_INLINE bool get_data (VoxelCache<ImageType>& source, const Eigen::Vector3f& position)
+            {
+              if (!source.scanner (position))
+                return false;
+              ++cache_lookups;
+              if (source.cached())
+                ++cache_hits;
+              source.row (values);
+              return !std::isnan (values[0]);
+            }
+
             template <class InterpolatorType>
             FORCE_INLINE bool get_data (InterpolatorType& source)
             {
@@ -89,6 +111,7 @@ namespace MR
           private:
             const SharedBase& S;
             std::unique_ptr<ACT::ACT_Method_additions> act_method_additions;
+            size_t cache_hits, cache_lookups;
 
 
           protected:
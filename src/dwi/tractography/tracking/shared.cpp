@@ -49,7 +49,10 @@ namespace MR
             rk4 (false),
             stop_on_all_include (false),
             implicit_max_num_seeds (properties.find ("max_num_seeds") == properties.end()),
-            downsampler (1)
+            deterministic (properties.find ("rng_seed") != properties.end()),
+            rng_seed (deterministic ? to<uint64_t> (properties["rng_seed"]) : 0),
+            downsampler (1),
+            source_bricks (source)
 #ifdef DEBUG_TERMINATIONS
           , debug_header (Header::open (properties.find ("act") == properties.end() ? diff_path : properties["act"])),
             transform (debug_header)
@@ -94,6 +97,7 @@ namespace MR
             terminations[i] = 0;
           for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
             rejections[i] = 0;
+          cache_hits = cache_lookups = 0;
 
 #ifdef DEBUG_TERMINATIONS
           debug_header.ndim() = 3;
@@ -169,6 +173,9 @@ namespace MR
               INFO ("  " + reject_type + ": " + str (rejections[i]));
           }
 
+          if (cache_lookups)
+            INFO ("Image voxel cache hit rate: " + str (100.0 * cache_hits / (double)cache_lookups, 3) + "\% (" + str (cache_lookups) + " lookups)");
+
 #ifdef DEBUG_TERMINATIONS
           for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i) {
             delete debug_images[i];
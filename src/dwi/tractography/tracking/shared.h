@@ -27,6 +27,7 @@
 #include "dwi/tractography/roi.h"
 #include "dwi/tractography/ACT/shared.h"
 #include "dwi/tractography/resampling/downsampler.h"
+#include "dwi/tractography/tracking/bricked_volume.h"
 #include "dwi/tractography/tracking/types.h"
 #include "dwi/tractography/tracking/tractography.h"
 
@@ -67,7 +68,8 @@ namespace MR
             float max_angle_1o, max_angle_ho, cos_max_angle_1o, cos_max_angle_ho;
             float step_size, min_radius, threshold, init_threshold;
             size_t max_seed_attempts;
-            bool unidirectional, rk4, stop_on_all_include, implicit_max_num_seeds;
+            bool unidirectional, rk4, stop_on_all_include, implicit_max_num_seeds, deterministic;
+            uint64_t rng_seed;
             DWI::Tractography::Resampling::Downsampler downsampler;
 
             // Additional members for ACT
@@ -89,10 +91,19 @@ namespace MR
             // (Only utilised for Exec::satisfy_wm_requirement())
             virtual float internal_step_size() const { return step_size; }
 
+            // The source image repacked for tracking, if enabled (see BrickedVolume)
+            const BrickedVolume* bricks() const { return BrickedVolume::enabled() ? source_bricks.get() : nullptr; }
+
 
             void add_termination (const term_t i)   const { terminations[i].fetch_add (1, std::memory_order_relaxed); }
             void add_rejection   (const reject_t i) const { rejections[i]  .fetch_add (1, std::memory_order_relaxed); }
 
+            void update_cache_stats (const size_t hits, const size_t lookups) const
+            {
+              cache_hits.fetch_add (hits, std::memory_order_relaxed);
+              cache_lookups.fetch_add (lookups, std::memory_order_relaxed);
+            }
+
 
 #ifdef DEBUG_TERMINATIONS
             void add_termination (const term_t i, const Eigen::Vector3f& p) const;
@@ -102,6 +113,9 @@ namespace MR
           private:
             mutable std::atomic<size_t> terminations[TERMINATION_REASON_COUNT];
             mutable std::atomic<size_t> rejections  [REJECTION_REASON_COUNT];
+            mutable std::atomic<size_t> cache_hits, cache_lookups;
+
+            BrickedVolume source_bricks;
 
             std::unique_ptr<ACT::ACT_Shared_additions> act_shared_additions;
 
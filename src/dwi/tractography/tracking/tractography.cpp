@@ -15,6 +15,7 @@
  */
 
 #include "dwi/tractography/tracking/tractography.h"
+#include "dwi/tractography/rng.h"
 
 
 namespace MR
@@ -95,7 +96,12 @@ namespace MR
 
       + Option ("downsample", "downsample the generated streamlines to reduce output file size "
                               "(default is (samples-1) for iFOD2, no downsampling for all other algorithms)")
-          + Argument ("factor").type_integer (1);
+          + Argument ("factor").type_integer (1)
+
+      + Option ("deterministic", "generate streamlines reproducibly irrespective of multi-threading: "
+                                 "the output then depends only on the random seed, which is recorded in the "
+                                 "output file header, and can be set using the MRTRIX_RNG_SEED environment variable "
+                                 "(incurs a small performance penalty; not compatible with dynamic seeding)");
 
 
       /**
@@ -154,6 +160,13 @@ namespace MR
         opt = get_options ("grad");
         if (opt.size()) properties["DW_scheme"] = std::string (opt[0][0]);
 
+        opt = get_options ("deterministic");
+        if (opt.size()) {
+          if (properties.find ("seed_dynamic") != properties.end())
+            throw Exception ("-deterministic option cannot be used in conjunction with dynamic seeding");
+          properties["rng_seed"] = str (RNG::get_base_seed());
+        }
+
       }
 
 
@@ -21,6 +21,7 @@
 #include "image.h"
 #include "interp/linear.h"
 #include "interp/masked.h"
+#include "dwi/tractography/tracking/voxel_cache.h"
 
 
 
@@ -50,7 +51,7 @@ namespace MR
         template <class ImageType>
           class Interpolator { MEMALIGN(Interpolator<ImageType>)
             public:
-              using type = Interp::Masked<Interp::Linear<ImageType>>;
+              using type = VoxelCache<ImageType>;
           };
 
 
@@ -0,0 +1,156 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_tracking_voxel_cache_h__
+#define __dwi_tractography_tracking_voxel_cache_h__
+
+
+#include "interp/linear.h"
+#include "dwi/tractography/tracking/bricked_volume.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        //! Masked trilinear interpolation of all volumes, caching the current cell
+        /*! This behaves as Interp::Masked<Interp::Linear<ImageType>>, but is
+         * intended for retrieving all volumes at once using row(). The image
+         * values at the 8 corners of the cell containing the current
+         * position are retained, along with whether each corner contains
+         * any data; successive positions within the same cell (as is
+         * typical of consecutive samples along a streamline) are then
+         * interpolated without fetching anything further from the image.
+         * If a BrickedVolume copy of the image is provided, corner values
+         * are fetched from it rather than from the image itself.
+         *
+         * Each tracking thread holds its own copy, so no synchronisation is
+         * required. */
+        template <class ImageType>
+          class VoxelCache : public Interp::Linear<ImageType>
+        { MEMALIGN(VoxelCache<ImageType>)
+          public:
+            using InterpType = Interp::Linear<ImageType>;
+            using value_type = typename InterpType::value_type;
+            using InterpType::factors;
+            using InterpType::clamp;
+
+            VoxelCache (const ImageType& parent, const BrickedVolume* bricks = nullptr) :
+                InterpType (parent),
+                bricks (bricks),
+                corners (parent.size(3), 8),
+                valid (false),
+                hit (false) { }
+
+            VoxelCache (const VoxelCache& that) :
+                InterpType (that),
+                bricks (that.bricks),
+                corners (that.corners.rows(), 8),
+                valid (false),
+                hit (false) { }
+
+            //! Set the current position to <b>voxel space</b> position \a pos
+            /*! As with Interp::Masked, this returns false if the position is
+             * outside of the image FoV, and marks the position as out of
+             * bounds if the nearest voxel contains no data. */
+            template <class VectorType>
+              bool voxel (const VectorType& pos)
+              {
+                if (InterpType::set_out_of_bounds (pos))
+                  return false;
+
+                const ssize_t c[] = { ssize_t (std::floor (pos[0])), ssize_t (std::floor (pos[1])), ssize_t (std::floor (pos[2])) };
+                hit = valid && c[0] == cell[0] && c[1] == cell[1] && c[2] == cell[2];
+                if (!hit)
+                  load (c);
+
+                const size_t nearest = (ssize_t (std::round (pos[0])) - c[0])
+                                     + 2 * (ssize_t (std::round (pos[1])) - c[1])
+                                     + 4 * (ssize_t (std::round (pos[2])) - c[2]);
+                if (!has_data[nearest]) {
+                  InterpType::set_out_of_bounds (true);
+                  return true;
+                }
+                return InterpType::voxel (pos);
+              }
+
+            template <class VectorType>
+              FORCE_INLINE bool scanner (const VectorType& pos) {
+                return voxel (Transform::scanner2voxel * pos.template cast<default_type>());
+              }
+
+            //! Write the interpolated values of all volumes into \a values
+            template <class VectorType>
+              FORCE_INLINE void row (VectorType& values) const
+              {
+                if (InterpType::out_of_bounds)
+                  values.fill (InterpType::out_of_bounds_value);
+                else
+                  values.noalias() = corners * factors;
+              }
+
+            //! whether the data for the current position were already cached
+            bool cached () const { return hit; }
+
+          protected:
+            const BrickedVolume* bricks;
+            Eigen::Matrix<value_type, Eigen::Dynamic, 8> corners;
+            ssize_t cell[3];
+            bool has_data[8];
+            bool valid, hit;
+
+            void load (const ssize_t* c)
+            {
+              size_t i = 0;
+              for (ssize_t z = 0; z < 2; ++z) {
+                ImageType::index(2) = clamp (c[2] + z, ImageType::size (2));
+                for (ssize_t y = 0; y < 2; ++y) {
+                  ImageType::index(1) = clamp (c[1] + y, ImageType::size (1));
+                  for (ssize_t x = 0; x < 2; ++x) {
+                    ImageType::index(0) = clamp (c[0] + x, ImageType::size (0));
+                    if (bricks)
+                      bricks->load (ImageType::index(0), ImageType::index(1), ImageType::index(2), corners.col (i));
+                    else
+                      corners.col (i) = ImageType::row (3);
+                    // as Interp::Masked: any non-zero (or non-finite) value counts as data
+                    has_data[i] = (corners.col (i).array() != value_type(0)).any();
+                    ++i;
+                  }
+                }
+              }
+              cell[0] = c[0];
+              cell[1] = c[1];
+              cell[2] = c[2];
+              valid = true;
+            }
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
@@ -20,6 +20,7 @@
 #include "app.h"
 #include "thread_queue.h"
 #include "types.h"
+#include "file/config.h"
 #include "file/ofstream.h"
 #include "file/path.h"
 #include "file/utils.h"
@@ -450,6 +451,136 @@ namespace MR
 
 
 
+      CSR::CSR (const Reader& reader, const connectivity_value_type C) :
+          fixel_data (nullptr),
+          value_data (nullptr),
+          //CONF option: FixelMatrixHalfPrecision
+          //CONF default: 0 (false)
+          //CONF Whether to store the connectivity values of the fixel-fixel
+          //CONF connectivity matrix as 16-bit floating-point values when
+          //CONF the matrix is loaded for statistical enhancement (e.g. in
+          //CONF fixelcfestats), halving their memory footprint at the
+          //CONF expense of precision.
+          is_half (File::Config::get_bool ("FixelMatrixHalfPrecision", false))
+      {
+        const size_t num_fixels = reader.size();
+        Image<index_image_type> index (reader.index_image);
+        Image<fixel_index_type> fixel (reader.fixel_image);
+        Image<connectivity_value_type> value (reader.value_image);
+        Image<bool> mask (reader.mask_image);
+        auto in_mask = [&] (const size_t i) -> bool {
+          if (!mask.valid())
+            return true;
+          mask.index (0) = i;
+          return mask.value();
+        };
+
+        // First pass: determine the number of connections retained for each
+        //   fixel, and whether the data on file are already laid out in
+        //   the required form
+        offsets.assign (num_fixels + 1, 0);
+        vector<index_image_type> file_offsets (num_fixels, 0);
+        bool contiguous = true;
+        for (size_t i = 0; i != num_fixels; ++i) {
+          index.index (0) = i;
+          index.index (3) = 0;
+          const index_image_type num_connections = index.value();
+          index.index (3) = 1;
+          file_offsets[i] = num_connections ? index_image_type (index.value()) : offsets[i];
+          index_image_type retained = 0;
+          if (num_connections && in_mask (i)) {
+            if (mask.valid()) {
+              for (index_image_type j = file_offsets[i]; j != file_offsets[i] + num_connections; ++j) {
+                fixel.index (0) = j;
+                if (in_mask (fixel.value()))
+                  ++retained;
+              }
+            } else {
+              retained = num_connections;
+            }
+          }
+          if (retained != num_connections || file_offsets[i] != offsets[i])
+            contiguous = false;
+          offsets[i+1] = offsets[i] + retained;
+        }
+        const index_image_type num_connections = offsets[num_fixels];
+
+        // Access the fixel indices and connectivity values in place where possible
+        if (contiguous) {
+          fixel_image = Image<fixel_index_type>::open (Path::join (reader.directory, "fixels.mif")).with_direct_io();
+          if (fixel_image.stride (0) == 1) {
+            fixel_image.index (0) = 0;
+            fixel_data = fixel_image.address();
+          } else {
+            fixel_image = Image<fixel_index_type>();
+          }
+          if (C == connectivity_value_type(1) && !is_half) {
+            value_image = Image<connectivity_value_type>::open (Path::join (reader.directory, "values.mif")).with_direct_io();
+            if (value_image.stride (0) == 1) {
+              value_image.index (0) = 0;
+              value_data = value_image.address();
+            } else {
+              value_image = Image<connectivity_value_type>();
+            }
+          }
+        }
+
+        // Second pass: copy whatever could not be accessed in place,
+        //   and compute the normalisation multipliers
+        if (!fixel_data)
+          fixel_copy.reserve (num_connections);
+        if (is_half)
+          value_copy_half.reserve (num_connections);
+        else if (!value_data)
+          value_copy.reserve (num_connections);
+        norm_multipliers.assign (num_fixels, connectivity_value_type(1));
+        for (size_t i = 0; i != num_fixels; ++i) {
+          if (offsets[i+1] == offsets[i])
+            continue;
+          default_type sum = 0.0;
+          if (fixel_data && value_data) {
+            for (index_image_type j = offsets[i]; j != offsets[i+1]; ++j)
+              sum += value_data[j];
+          } else {
+            index.index (0) = i;
+            index.index (3) = 0;
+            const index_image_type end = file_offsets[i] + index_image_type (index.value());
+            for (index_image_type j = file_offsets[i]; j != end; ++j) {
+              fixel.index (0) = value.index (0) = j;
+              const fixel_index_type target = fixel.value();
+              if (!in_mask (target))
+                continue;
+              connectivity_value_type v = value.value();
+              if (C != connectivity_value_type(1))
+                v = std::pow (v, C);
+              sum += v;
+              if (!fixel_data)
+                fixel_copy.push_back (target);
+              if (is_half)
+                value_copy_half.push_back (Eigen::half (v));
+              else if (!value_data)
+                value_copy.push_back (v);
+            }
+          }
+          norm_multipliers[i] = sum ? connectivity_value_type (1.0 / sum) : connectivity_value_type(0);
+        }
+        if (!fixel_data)
+          fixel_data = fixel_copy.data();
+        if (!value_data)
+          value_data = value_copy.data();
+
+        const size_t bytes_copied = fixel_copy.size() * sizeof (fixel_index_type)
+                                  + value_copy.size() * sizeof (connectivity_value_type)
+                                  + value_copy_half.size() * sizeof (Eigen::half);
+        INFO ("Fixel-fixel connectivity matrix loaded in compressed form: " + str(num_connections) + " connections, "
+              + str(bytes_copied / (1024.0*1024.0), 3) + " MB copied into memory");
+      }
+
+
+
+
+
+
 
 
     }
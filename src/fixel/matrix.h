@@ -226,6 +226,51 @@ namespace MR
           Image<connectivity_value_type> value_image;
           Image<bool> mask_image;
 
+          friend class CSR;
+      };
+
+
+
+      // The connectivity matrix held in compressed sparse row form, for
+      //   repeated traversal of the entire matrix (e.g. once per permutation
+      //   during statistical inference) without reconstructing each fixel's
+      //   connections on every pass. The mask of the Reader (if any) is applied,
+      //   and the connectivity values raised to the power C, only once; the
+      //   per-fixel normalisation multipliers are computed from the resulting
+      //   values. Where neither modifies the data on file, the fixel indices and
+      //   connectivity values are accessed in place rather than being copied.
+      class CSR
+      { MEMALIGN(CSR)
+
+        public:
+          CSR (const Reader& reader, const connectivity_value_type C = connectivity_value_type(1));
+          CSR (const CSR&) = delete;
+
+          size_t size() const { return norm_multipliers.size(); }
+          size_t size (const size_t fixel) const { return offsets[fixel+1] - offsets[fixel]; }
+
+          // Connectivity values may be stored as either 32-bit or 16-bit
+          //   floating-point (see config file option FixelMatrixHalfPrecision);
+          //   only the corresponding accessor may be used
+          bool half_precision() const { return is_half; }
+
+          const fixel_index_type* fixels (const size_t fixel) const { return fixel_data + offsets[fixel]; }
+          const connectivity_value_type* values (const size_t fixel) const { return value_data + offsets[fixel]; }
+          const Eigen::half* values_half (const size_t fixel) const { return value_copy_half.data() + offsets[fixel]; }
+          connectivity_value_type norm_multiplier (const size_t fixel) const { return norm_multipliers[fixel]; }
+
+        protected:
+          vector<index_image_type> offsets;
+          // Retained in order to keep the data accessed in place available
+          Image<fixel_index_type> fixel_image;
+          Image<connectivity_value_type> value_image;
+          vector<fixel_index_type> fixel_copy;
+          vector<connectivity_value_type> value_copy;
+          vector<Eigen::half> value_copy_half;
+          const fixel_index_type* fixel_data;
+          const connectivity_value_type* value_data;
+          vector<connectivity_value_type> norm_multipliers;
+          const bool is_half;
 
       };
 
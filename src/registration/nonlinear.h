@@ -200,6 +200,19 @@ namespace MR
                 }
               }
 
+              DEBUG ("Initialising deformation field and mask scratch images");
+              // allocated once per level and overwritten at each iteration; this avoids
+              // allocating and zero-filling them again, but does not lower peak memory
+              Image<default_type> im1_deform_field = Image<default_type>::scratch (field_header);
+              Image<default_type> im2_deform_field = Image<default_type>::scratch (field_header);
+              Im1MaskType im1_mask_warped, im2_mask_warped;
+              if (im1_mask.valid())
+                im1_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
+              if (im2_mask.valid())
+                im2_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
+              // only allocated if scaling and squaring of the update fields is required
+              Image<default_type> update_scratch1, update_scratch2;
+
               ssize_t iteration = 1;
               default_type grad_step_altered = gradient_step * (field_header.spacing(0) + field_header.spacing(1) + field_header.spacing(2)) / 3.0;
               default_type cost = std::numeric_limits<default_type>::max();
@@ -214,13 +227,10 @@ namespace MR
                   smooth_filter (*im2_update);
                 }
 
-                Image<default_type> im1_deform_field = Image<default_type>::scratch (field_header);
-                Image<default_type> im2_deform_field = Image<default_type>::scratch (field_header);
-
                 if (iteration > 1) {
                   DEBUG ("updating displacement field");
-                  Warp::update_displacement_scaling_and_squaring (*im1_to_mid, *im1_update, *im1_to_mid_new, grad_step_altered);
-                  Warp::update_displacement_scaling_and_squaring (*im2_to_mid, *im2_update, *im2_to_mid_new, grad_step_altered);
+                  Warp::update_displacement_scaling_and_squaring (*im1_to_mid, *im1_update, *im1_to_mid_new, grad_step_altered, update_scratch1, update_scratch2);
+                  Warp::update_displacement_scaling_and_squaring (*im2_to_mid, *im2_update, *im2_to_mid_new, grad_step_altered, update_scratch1, update_scratch2);
 
                   DEBUG ("smoothing displacement field");
                   Filter::Smooth smooth_filter (*im1_to_mid_new);
@@ -250,15 +260,11 @@ namespace MR
                 }
 
                 DEBUG ("warping mask images");
-                Im1MaskType im1_mask_warped;
                 if (im1_mask.valid()) {
-                  im1_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
                   LogLevelLatch level (0);
                   Filter::warp<Interp::Linear> (im1_mask, im1_mask_warped, im1_deform_field, 0.0);
                 }
-                Im1MaskType im2_mask_warped;
                 if (im2_mask.valid()) {
-                  im2_mask_warped = Im1MaskType::scratch (midway_image_header_resized);
                   LogLevelLatch level (0);
                   Filter::warp<Interp::Linear> (im2_mask, im2_mask_warped, im2_deform_field, 0.0);
                 }
@@ -69,17 +69,18 @@ namespace MR
 
         class ComposeDispKernel { MEMALIGN(ComposeDispKernel)
           public:
-            ComposeDispKernel (Image<default_type>& disp_input1, Image<default_type>& disp_input2, default_type step) :
-                               disp1_transform (disp_input1), disp2_interp (disp_input2), step (step) {}
+            ComposeDispKernel (Image<default_type>& disp_input1, Image<default_type>& disp_input2, default_type step, default_type input_step = 1.0) :
+                               disp1_transform (disp_input1), disp2_interp (disp_input2), step (step), input_step (input_step) {}
 
 
             void operator() (Image<default_type>& disp_input1, Image<default_type>& disp_output) {
               Eigen::Vector3 voxel ((default_type)disp_input1.index(0), (default_type)disp_input1.index(1), (default_type)disp_input1.index(2));
               Eigen::Vector3 voxel_position = disp1_transform.voxel2scanner * voxel;
-              Eigen::Vector3 original_position = voxel_position + Eigen::Vector3(disp_input1.row(3));
+              Eigen::Vector3 displacement1 (Eigen::Vector3(disp_input1.row(3)) * input_step);
+              Eigen::Vector3 original_position = voxel_position + displacement1;
               disp2_interp.scanner (original_position);
               if (!disp2_interp) {
-                disp_output.row(3) = disp_input1.row(3);
+                disp_output.row(3) = displacement1;
               } else {
                 Eigen::Vector3 displacement (Eigen::Vector3(disp2_interp.row(3)).array() * step);
                 Eigen::Vector3 new_position = displacement + original_position;
@@ -90,7 +91,28 @@ namespace MR
           protected:
             MR::Transform disp1_transform;
             Interp::Linear<Image<default_type> > disp2_interp;
-            default_type step;
+            default_type step, input_step;
+        };
+
+
+        class MaxNormKernel { MEMALIGN(MaxNormKernel)
+          public:
+            MaxNormKernel (default_type& global_max_norm) :
+                           global_max_norm (global_max_norm), thread_max_norm (0.0), mutex (new std::mutex) {}
+
+            ~MaxNormKernel () {
+              std::lock_guard<std::mutex> lock (*mutex);
+              global_max_norm = std::max (global_max_norm, thread_max_norm);
+            }
+
+            void operator() (Image<default_type>& field) {
+              thread_max_norm = std::max (thread_max_norm, Eigen::Vector3 (field.row(3)).norm());
+            }
+
+          protected:
+            default_type& global_max_norm;
+            default_type thread_max_norm;
+            std::shared_ptr<std::mutex> mutex;
         };
 
 
@@ -149,70 +171,59 @@ namespace MR
       }
 
       // Compose two displacement fields and output a displacement field. The input and output can be the same image.
-      FORCE_INLINE  void update_displacement (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, default_type step = 1.0)
+      // The input displacement is scaled by input_step and the update by step prior to composition.
+      FORCE_INLINE  void update_displacement (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, default_type step = 1.0, default_type input_step = 1.0)
       {
         check_dimensions (input, output, 0, 3);
-        ThreadedLoop (input, 0, 3).run (ComposeDispKernel (input, update, step), input, output);
+        ThreadedLoop (input, 0, 3).run (ComposeDispKernel (input, update, step, input_step), input, output);
       }
 
       // Compose two displacement fields and output a displacement field using scaling and squaring.  The input and output can be the same image.
-      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step = 1.0)
+      // The scratch fields are only allocated if scaling and squaring is required and they are not already valid, so that
+      // the caller can retain them across calls rather than allocating new fields each time.
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step,
+                                                                   Image<default_type>& scratch1, Image<default_type>& scratch2)
       {
         check_dimensions (input, output, 0, 3);
 
         default_type max_norm = 0.0;
-        auto max_norm_func = [&max_norm](Image<default_type>& update) {
-          default_type norm = Eigen::Vector3 (update.row(3)).norm();
-          if (norm > max_norm)
-            max_norm = norm;
-        };
-        ThreadedLoop (update).run (max_norm_func, update);
+        ThreadedLoop (update, 0, 3).run (MaxNormKernel (max_norm), update);
         default_type min_vox_size = static_cast<default_type> (std::min (input.spacing(0), std::min (input.spacing(1), input.spacing(2))));
 
         // if the maximum update is larger than half a voxel, perform scaling and squaring to ensure the displacement field remains diffeomorphic
+        size_t num_squarings = 0;
+        if (max_norm * step >= min_vox_size / 2.0)
+          num_squarings = std::ceil (std::log2 ((max_norm * step) / (min_vox_size / 2.0)));
 
-        default_type scale_factor = 1.0;
-        if (max_norm * step < min_vox_size / 2.0) {
+        if (!num_squarings) {
           update_displacement (input, update, output, step);
-        } else {
-          scale_factor = std::pow (2, std::ceil (std::log ((max_norm * step) / (min_vox_size / 2.0)) / std::log (2.0)));
-
-          std::shared_ptr<Image<default_type>> scaled_update = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
-          std::shared_ptr<Image<default_type>> composed = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
-
-          // Scaling
-          default_type scaled_step = step / scale_factor; // apply the step size and scale factor at once
-          ThreadedLoop (update).run (
-                [&scaled_step](Image<default_type>& update, Image<default_type>& scaled_update) {
-                  scaled_update.row(3) = Eigen::Vector3 (update.row(3)) * scaled_step;
-                }, update, *scaled_update);
-
-//          CONSOLE ("composing " + str(std::log2 (scale_factor)) + "times");
-
-          // Squaring
-          for (size_t i = 0; i < std::log2 (scale_factor); ++i) {
-            update_displacement (*scaled_update, *scaled_update, *composed);
-            std::swap (scaled_update, composed);
-          }
-//          save (*scaled_update, std::string("composed_update.mif"), false);
-//          Adapter::Jacobian<Image<default_type> > jacobian (*scaled_update);
-//          Header header (*scaled_update);
-//          header.ndim() = 3;
-//          bool is_neg = false;
-//          auto jacobian_det = Image<default_type>::scratch (header);
-//          Eigen::MatrixXd ident = Eigen::MatrixXd::Identity (3,3);
-//          for (auto i = Loop (0,3) (jacobian, jacobian_det); i; ++i) {
-//            auto jac_matrix = ident + jacobian.value();
-//            jacobian_det.value() = jac_matrix.determinant();
-//            if (jacobian_det.value() < 0.0)
-//              is_neg = true;
-//          }
-//          save (jacobian_det, std::string("jacobian.mif"), false);
-//          if (is_neg)
-//            throw Exception ("negative jacobians in update");
-
-          update_displacement (input, *scaled_update, output);
+          return;
+        }
+
+        DEBUG ("composing update " + str(num_squarings) + " times");
+        if (!scratch1.valid())
+          scratch1 = Image<default_type>::scratch (update);
+        if (num_squarings > 1 && !scratch2.valid())
+          scratch2 = Image<default_type>::scratch (update);
+
+        // Scaling, applying the step size and scale factor at once, fused with the first squaring
+        const default_type scaled_step = step / std::pow (2.0, num_squarings);
+        auto composed = scratch1, next = scratch2;
+        update_displacement (update, update, composed, scaled_step, scaled_step);
+
+        // Squaring
+        for (size_t i = 1; i < num_squarings; ++i) {
+          update_displacement (composed, composed, next);
+          std::swap (composed, next);
         }
+
+        update_displacement (input, composed, output);
+      }
+
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step = 1.0)
+      {
+        Image<default_type> scratch1, scratch2;
+        update_displacement_scaling_and_squaring (input, update, output, step, scratch1, scratch2);
       }
 
 
@@ -29,7 +29,7 @@ namespace MR
               const value_type H,
               const value_type C,
               const bool norm) :
-        matrix (connectivity_matrix),
+        matrix (connectivity_matrix, Fixel::Matrix::connectivity_value_type (C)),
         dh (dh),
         E (E),
         H (H),
@@ -41,44 +41,55 @@ namespace MR
     void CFE::operator() (in_column_type stats, out_column_type enhanced_stats) const
     {
       enhanced_stats.setZero();
-      vector<default_type> connected_stats;
+      value_type max_stat = value_type(0);
+      for (ssize_t fixel = 0; fixel != stats.size(); ++fixel) {
+        if (std::isfinite (stats[fixel]))
+          max_stat = std::max (max_stat, stats[fixel]);
+      }
+      if (max_stat < dh)
+        return;
+      // Pre-calculate h^H
+      const size_t max_clusters = std::floor (max_stat / dh);
+      vector<default_type> h_pow_H (max_clusters);
+      for (size_t ih = 0; ih != max_clusters; ++ih)
+        h_pow_H[ih] = std::pow (dh*(ih+1), H);
+      vector<default_type> histogram (max_clusters + 1);
       for (size_t fixel = 0; fixel < matrix.size(); ++fixel) {
-        if (stats[fixel] < dh)
+        if (!(stats[fixel] >= dh && std::isfinite (stats[fixel])))
           continue;
-        auto connections = matrix[fixel];
-        // Need to re-normalise based on the value of the power C
-        if (C != 1.0) {
-          default_type sum = 0.0;
-          for (auto& c : connections) {
-            c.exponentiate (C);
-            sum += c.value();
-          }
-          connections.normalise (Fixel::Matrix::connectivity_value_type (sum));
-        }
-        // Rather than allocating data for the stats and then looping over dh,
-        //   divide statistic by dh to determine the number of cluster sizes that should
-        //   be incremented, and dynamically increment all cluster sizes for that
-        //   particular connected fixel
-        vector<Fixel::Matrix::connectivity_value_type> extents (std::floor (stats[fixel]/dh), Fixel::Matrix::connectivity_value_type(0));
-        for (const auto& connection : connections) {
-          const default_type connection_stat = stats[connection.index()];
-          if (connection_stat > dh) {
-            const size_t cluster_count = std::min (extents.size(), size_t(std::floor (connection_stat / dh)));
-            for (size_t cluster_index = 0; cluster_index != cluster_count; ++cluster_index)
-              extents[cluster_index] += connection.value();
-          }
-        }
-        // Pre-calculate h^H
-        if (h_pow_H.size() < extents.size()) {
-          const size_t old_size = h_pow_H.size();
-          h_pow_H.resize (extents.size());
-          for (size_t ih = old_size; ih != h_pow_H.size(); ++ih)
-            h_pow_H[ih] = std::pow (dh*(ih+1), H);
+        // Rather than looping over dh for every connected fixel, build a
+        //   histogram of the number of clusters in which each connected
+        //   fixel participates; the extent of each cluster is then
+        //   the cumulative sum of this histogram from the top down
+        const size_t num_clusters = std::floor (stats[fixel]/dh);
+        std::fill (histogram.begin(), histogram.begin() + num_clusters + 1, default_type(0));
+        if (matrix.half_precision())
+          fill_histogram (stats, fixel, matrix.values_half (fixel), num_clusters, histogram);
+        else
+          fill_histogram (stats, fixel, matrix.values (fixel), num_clusters, histogram);
+        default_type extent = 0.0, enhanced = 0.0;
+        for (size_t cluster_index = num_clusters; cluster_index--;) {
+          extent += histogram[cluster_index+1];
+          enhanced += std::pow (extent, E) * h_pow_H[cluster_index];
         }
-        for (size_t cluster_index = 0; cluster_index != extents.size(); ++cluster_index)
-          enhanced_stats[fixel] += std::pow (extents[cluster_index], E) * h_pow_H[cluster_index];
         if (normalise)
-          enhanced_stats[fixel] *= connections.norm_multiplier;
+          enhanced *= matrix.norm_multiplier (fixel);
+        enhanced_stats[fixel] = enhanced;
+      }
+    }
+
+
+
+    template <typename ValueType>
+    void CFE::fill_histogram (in_column_type stats, const size_t fixel, const ValueType* values,
+                              const size_t num_clusters, vector<default_type>& histogram) const
+    {
+      const Fixel::Matrix::fixel_index_type* fixels = matrix.fixels (fixel);
+      const size_t num_connections = matrix.size (fixel);
+      for (size_t i = 0; i != num_connections; ++i) {
+        const value_type connection_stat = stats[fixels[i]];
+        if (connection_stat > dh && std::isfinite (connection_stat))
+          histogram[std::min (num_clusters, size_t(connection_stat / dh))] += default_type (values[i]);
       }
     }
 
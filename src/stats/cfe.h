@@ -42,13 +42,16 @@ namespace MR
         virtual ~CFE() { }
 
       protected:
-        Fixel::Matrix::Reader matrix;
+        // Mask and power C are applied once on construction
+        const Fixel::Matrix::CSR matrix;
         const value_type dh, E, H, C;
         const bool normalise;
 
-        mutable vector<value_type> h_pow_H;
-
         void operator() (in_column_type, out_column_type) const override;
+
+        template <typename ValueType>
+        void fill_histogram (in_column_type stats, const size_t fixel, const ValueType* values,
+                             const size_t num_clusters, vector<default_type>& histogram) const;
     };
 
 
@@ -16,6 +16,8 @@
 
 #include "stats/permtest.h"
 
+#include "file/config.h"
+
 namespace MR
 {
   namespace Stats
@@ -25,6 +27,43 @@ namespace MR
 
 
 
+      bool ShuffleBlockSource::operator() (vector<Math::Stats::Shuffle>& shuffles)
+      {
+        shuffles.resize (block_size);
+        size_t count = 0;
+        while (count != block_size && shuffler (shuffles[count]))
+          ++count;
+        shuffles.resize (count);
+        return count;
+      }
+
+
+
+      size_t ShuffleBlockSource::default_block_size (const std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator, const size_t num_shuffles)
+      {
+        //CONF option: StatsShuffleBlockSize
+        //CONF default: 64
+        //CONF The maximum number of shuffles for which GLM statistics are
+        //CONF computed together during permutation testing; larger blocks
+        //CONF permit more efficient matrix multiplication, at the expense
+        //CONF of memory usage (the number may be reduced from this value
+        //CONF to limit that memory, or to provide work for all threads).
+        static const size_t max_block_size = std::max (File::Config::get_int ("StatsShuffleBlockSize", 64), 1);
+        // Limit memory for each block to ~64MB: each shuffle holds its own shuffling
+        //   matrix (num_inputs x num_inputs) as well as its statistics; the working
+        //   matrices of the GLM are capped separately (see GLM::TestFixedHomoscedastic)
+        const size_t num_inputs = stats_calculator->num_inputs();
+        const size_t bytes_per_shuffle = (num_inputs * num_inputs + stats_calculator->num_elements() * stats_calculator->num_hypotheses()) * sizeof (value_type);
+        size_t block_size = std::min (max_block_size, std::max (size_t(1), size_t(64*1024*1024) / std::max (bytes_per_shuffle, size_t(1))));
+        // Provide a few blocks per thread
+        const size_t num_threads = std::max (Thread::number_of_threads(), size_t(1));
+        block_size = std::min (block_size, std::max (size_t(1), num_shuffles / (4 * num_threads)));
+        DEBUG ("Processing " + str(num_shuffles) + " shuffles in blocks of " + str(block_size));
+        return block_size;
+      }
+
+
+
       PreProcessor::PreProcessor (const std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator,
                                   const std::shared_ptr<EnhancerBase> enhancer,
                                   const default_type skew,
@@ -37,7 +76,6 @@ namespace MR
           global_enhanced_count (global_enhanced_count),
           enhanced_sum (matrix_type::Zero (stats_calculator->num_elements(), stats_calculator->num_hypotheses())),
           enhanced_count (count_matrix_type::Zero (stats_calculator->num_elements(), stats_calculator->num_hypotheses())),
-          stats (global_enhanced_sum.rows(), global_enhanced_sum.cols()),
           enhanced_stats (global_enhanced_sum.rows(), global_enhanced_sum.cols()),
           mutex (new std::mutex())
       {
@@ -56,17 +94,19 @@ namespace MR
 
 
 
-      bool PreProcessor::operator() (const Math::Stats::Shuffle& shuffle)
+      bool PreProcessor::operator() (const vector<Math::Stats::Shuffle>& shuffles)
       {
-        if (!shuffle.data.rows())
+        if (shuffles.empty())
           return false;
-        (*stats_calculator) (shuffle.data, stats);
-        (*enhancer) (stats, enhanced_stats);
-        for (size_t ih = 0; ih != stats_calculator->num_hypotheses(); ++ih) {
-          for (size_t ie = 0; ie != stats_calculator->num_elements(); ++ie) {
-            if (enhanced_stats(ie, ih) > 0.0) {
-              enhanced_sum(ie, ih) += std::pow (enhanced_stats(ie, ih), skew);
-              enhanced_count(ie, ih)++;
+        (*stats_calculator) (shuffles, stats);
+        for (const auto& s : stats) {
+          (*enhancer) (s, enhanced_stats);
+          for (size_t ih = 0; ih != stats_calculator->num_hypotheses(); ++ih) {
+            for (size_t ie = 0; ie != stats_calculator->num_elements(); ++ie) {
+              if (enhanced_stats(ie, ih) > 0.0) {
+                enhanced_sum(ie, ih) += std::pow (enhanced_stats(ie, ih), skew);
+                enhanced_count(ie, ih)++;
+              }
             }
           }
         }
@@ -90,7 +130,6 @@ namespace MR
           enhancer (enhancer),
           empirical_enhanced_statistics (empirical_enhanced_statistics),
           default_enhanced_statistics (default_enhanced_statistics),
-          statistics (stats_calculator->num_elements(), stats_calculator->num_hypotheses()),
           enhanced_statistics (stats_calculator->num_elements(), stats_calculator->num_hypotheses()),
           null_dist (perm_dist),
           global_null_dist_contributions (perm_dist_contributions),
@@ -113,25 +152,34 @@ namespace MR
 
 
 
-      bool Processor::operator() (const Math::Stats::Shuffle& shuffle)
+      bool Processor::operator() (const vector<Math::Stats::Shuffle>& shuffles)
+      {
+        (*stats_calculator) (shuffles, statistics);
+        for (size_t i = 0; i != shuffles.size(); ++i)
+          process (shuffles[i].index, statistics[i]);
+        return true;
+      }
+
+
+
+      void Processor::process (const size_t index, const matrix_type& stats)
       {
-        (*stats_calculator) (shuffle.data, statistics);
         if (enhancer)
-          (*enhancer) (statistics, enhanced_statistics);
+          (*enhancer) (stats, enhanced_statistics);
         else
-          enhanced_statistics = statistics;
+          enhanced_statistics = stats;
 
         if (empirical_enhanced_statistics.size())
           enhanced_statistics.array() /= empirical_enhanced_statistics.array();
 
         if (null_dist.cols() == 1) { // strong fwe control
           ssize_t max_element, max_hypothesis;
-          null_dist(shuffle.index, 0) = enhanced_statistics.maxCoeff (&max_element, &max_hypothesis);
+          null_dist(index, 0) = enhanced_statistics.maxCoeff (&max_element, &max_hypothesis);
           null_dist_contribution_counter(max_element, max_hypothesis)++;
         } else { // weak fwe control
           ssize_t max_index;
           for (ssize_t ih = 0; ih != enhanced_statistics.cols(); ++ih) {
-            null_dist(shuffle.index, ih) = enhanced_statistics.col (ih).maxCoeff (&max_index);
+            null_dist(index, ih) = enhanced_statistics.col (ih).maxCoeff (&max_index);
             null_dist_contribution_counter(max_index, ih)++;
           }
         }
@@ -142,8 +190,6 @@ namespace MR
               uncorrected_pvalue_counter(ie, ih)++;
           }
         }
-
-        return true;
       }
 
 
@@ -162,8 +208,9 @@ namespace MR
         count_matrix_type global_enhanced_count (count_matrix_type::Zero (stats_calculator->num_elements(), stats_calculator->num_hypotheses()));
         {
           Math::Stats::Shuffler shuffler (stats_calculator->num_inputs(), true, "Pre-computing empirical statistic for non-stationarity correction");
+          ShuffleBlockSource source (shuffler, ShuffleBlockSource::default_block_size (stats_calculator, shuffler.size()));
           PreProcessor preprocessor (stats_calculator, enhancer, skew, empirical_statistic, global_enhanced_count);
-          Thread::run_queue (shuffler, Math::Stats::Shuffle(), Thread::multi (preprocessor));
+          Thread::run_queue (source, vector<Math::Stats::Shuffle>(), Thread::multi (preprocessor));
         }
         for (size_t contrast = 0; contrast != stats_calculator->num_hypotheses(); ++contrast) {
           for (size_t ie = 0; ie != stats_calculator->num_elements(); ++ie) {
@@ -231,7 +278,8 @@ namespace MR
                                null_dist,
                                null_dist_contributions,
                                global_uncorrected_pvalue_count);
-          Thread::run_queue (shuffler, Math::Stats::Shuffle(), Thread::multi (processor));
+          ShuffleBlockSource source (shuffler, ShuffleBlockSource::default_block_size (stats_calculator, shuffler.size()));
+          Thread::run_queue (source, vector<Math::Stats::Shuffle>(), Thread::multi (processor));
         }
         uncorrected_pvalues = global_uncorrected_pvalue_count.cast<default_type>() / default_type(shuffler.size());
       }
@@ -53,6 +53,27 @@ namespace MR
 
 
 
+      /*! Provides shuffles in blocks, such that the GLM statistics for
+       * all shuffles in a block can be computed together */
+      class ShuffleBlockSource { NOMEMALIGN
+        public:
+          ShuffleBlockSource (Math::Stats::Shuffler& shuffler, const size_t block_size) :
+              shuffler (shuffler),
+              block_size (block_size) { }
+
+          bool operator() (vector<Math::Stats::Shuffle>&);
+
+          // Number of shuffles per block, such that each thread receives several blocks,
+          //   and the statistics for one block do not occupy an excessive amount of memory
+          static size_t default_block_size (const std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator, const size_t num_shuffles);
+
+        protected:
+          Math::Stats::Shuffler& shuffler;
+          const size_t block_size;
+      };
+
+
+
       /*! A class to pre-compute the empirical enhanced statistic image for non-stationarity correction */
       class PreProcessor { MEMALIGN (PreProcessor)
         public:
@@ -64,7 +85,7 @@ namespace MR
 
           ~PreProcessor();
 
-          bool operator() (const Math::Stats::Shuffle&);
+          bool operator() (const vector<Math::Stats::Shuffle>&);
 
         protected:
           std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator;
@@ -74,7 +95,7 @@ namespace MR
           count_matrix_type& global_enhanced_count;
           matrix_type enhanced_sum;
           count_matrix_type enhanced_count;
-          matrix_type stats;
+          vector<matrix_type> stats;
           matrix_type enhanced_stats;
           std::shared_ptr<std::mutex> mutex;
       };
@@ -95,14 +116,14 @@ namespace MR
 
           ~Processor();
 
-          bool operator() (const Math::Stats::Shuffle&);
+          bool operator() (const vector<Math::Stats::Shuffle>&);
 
         protected:
           std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator;
           std::shared_ptr<EnhancerBase> enhancer;
           const matrix_type& empirical_enhanced_statistics;
           const matrix_type& default_enhanced_statistics;
-          matrix_type statistics;
+          vector<matrix_type> statistics;
           matrix_type enhanced_statistics;
           matrix_type& null_dist;
           count_matrix_type& global_null_dist_contributions;
@@ -110,6 +131,8 @@ namespace MR
           count_matrix_type& global_uncorrected_pvalue_counter;
           count_matrix_type uncorrected_pvalue_counter;
           std::shared_ptr<std::mutex> mutex;
+
+          void process (const size_t index, const matrix_type& stats);
       };
 
 
@@ -0,0 +1,139 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "header.h"
+#include "image.h"
+#include "stride.h"
+#include "algo/loop.h"
+#include "file/config.h"
+#include "interp/linear.h"
+#include "interp/masked.h"
+#include "math/rng.h"
+#include "dwi/tractography/tracking/bricked_volume.h"
+#include "dwi/tractography/tracking/voxel_cache.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::Tracking;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test that sampling bricked copies of images for tracking matches sampling the images themselves";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// random values, with around a fifth of voxels empty, and dimensions that
+// are not multiples of the brick size:
+Image<float> make_image (const vector<ssize_t>& strides)
+{
+  Header header;
+  header.ndim() = 4;
+  const ssize_t sizes[] = { 7, 9, 5, 6 };
+  for (size_t n = 0; n < 4; ++n) {
+    header.size(n) = sizes[n];
+    header.spacing(n) = 1.0;
+  }
+  header.transform().setIdentity();
+  header.datatype() = DataType::Float32;
+  Stride::set (header, strides);
+
+  auto image = Image<float>::scratch (header, "bricked volume test image");
+  Math::RNG::Uniform<float> uniform;
+  for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+    const bool empty = uniform() < 0.2;
+    for (auto v = Loop (image, 3) (image); v; ++v)
+      image.value() = empty ? 0.0f : 2.0f * uniform() - 0.5f;
+  }
+  return image;
+}
+
+
+
+// whether two interpolated rows match to within a relative tolerance,
+// treating NaN (i.e. out of bounds) as equal:
+bool match (const Eigen::VectorXf& a, const Eigen::VectorXf& b, float tolerance)
+{
+  for (ssize_t n = 0; n < a.size(); ++n) {
+    if (std::isnan (a[n]) || std::isnan (b[n])) {
+      if (!(std::isnan (a[n]) && std::isnan (b[n])))
+        return false;
+    }
+    else if (std::abs (a[n] - b[n]) > tolerance * std::max (1.0f, std::abs (a[n])))
+      return false;
+  }
+  return true;
+}
+
+
+
+void run ()
+{
+  Math::RNG::Uniform<float> uniform;
+
+  for (const auto& strides : { vector<ssize_t> ({ 2, 3, 4, 1 }), vector<ssize_t> ({ 1, 2, 3, 4 }), vector<ssize_t> ({ -3, 2, 4, 1 }) }) {
+    auto image = make_image (strides);
+
+    for (const std::string half_precision : { "false", "true" }) {
+      const std::string name = "strides " + str(strides) + (half_precision == "true" ? ", half precision" : ", full precision");
+      // float16 has an 11-bit significand:
+      const float tolerance = half_precision == "true" ? 1.0e-3 : 0.0;
+      File::Config::set ("TrackingHalfPrecision", half_precision);
+      BrickedVolume bricks (image);
+
+      VoxelCache<Image<float>> plain (image), bricked (image, bricks.get());
+      Interp::Masked<Interp::Linear<Image<float>>> reference (image);
+
+      Eigen::VectorXf plain_values (image.size(3)), bricked_values (image.size(3));
+      size_t num_mismatched = 0, num_wrong = 0, num_inside = 0;
+      Eigen::Vector3d pos;
+      for (size_t n = 0; n < 5000; ++n) {
+        // mostly small steps within a cell, as along a streamline, with the
+        // occasional jump anywhere (including just outside the image):
+        if (n % 20 == 0)
+          pos = { (image.size(0)+1.0) * uniform() - 1.0, (image.size(1)+1.0) * uniform() - 1.0, (image.size(2)+1.0) * uniform() - 1.0 };
+        else
+          pos += Eigen::Vector3d (uniform() - 0.5, uniform() - 0.5, uniform() - 0.5) * 0.3;
+
+        const bool plain_inside = plain.voxel (pos);
+        const bool bricked_inside = bricked.voxel (pos);
+        plain.row (plain_values);
+        bricked.row (bricked_values);
+        if (plain_inside != bricked_inside || !match (plain_values, bricked_values, tolerance))
+          ++num_mismatched;
+
+        if (reference.voxel (pos)) {
+          ++num_inside;
+          if (!match (reference.row (3), bricked_values, std::max (tolerance, 1.0e-5f)))
+            ++num_wrong;
+        }
+      }
+
+      if (num_inside <= 1000)
+        throw Exception (name + ": too few positions within the image (" + str(num_inside) + ")");
+      if (num_mismatched)
+        throw Exception (name + ": bricked sampling differs from plain sampling at " + str(num_mismatched) + " positions");
+      if (num_wrong)
+        throw Exception (name + ": bricked sampling differs from masked linear interpolation at " + str(num_wrong) + " positions");
+    }
+  }
+}
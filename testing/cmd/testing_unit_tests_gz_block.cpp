@@ -0,0 +1,90 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "math/rng.h"
+#include "file/gz.h"
+#include "file/gz_block.h"
+#include "file/utils.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test round-trip of block-compressed gzip files";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+void run ()
+{
+  // compressible data: slowly varying values with some noise
+  const size_t lead_in_size = 352, data_size = 5*File::GZBlock::block_size() + 12345;
+  vector<uint8_t> lead_in (lead_in_size), data (data_size);
+  Math::RNG::Integer<uint8_t> rng (7);
+  for (size_t n = 0; n < lead_in_size; ++n)
+    lead_in[n] = n;
+  for (size_t n = 0; n < data_size; ++n)
+    data[n] = (n / 4096) + (rng() & 0x03);
+
+  const std::string filename = File::create_tempfile (0, "gz");
+  File::GZBlock::write (filename, { { lead_in.data(), lead_in_size }, { data.data(), data_size } });
+
+  const auto blocks = File::GZBlock::index (filename);
+  if (blocks.size() != (lead_in_size + data_size + File::GZBlock::block_size() - 1) / File::GZBlock::block_size())
+    throw Exception ("unexpected number of blocks in index (" + str(blocks.size()) + ")");
+
+  // whole data region, starting part-way through the first block:
+  vector<uint8_t> buffer (data_size);
+  if (!File::GZBlock::read (filename, lead_in_size, buffer.data(), data_size))
+    throw Exception ("file not detected as block-compressed");
+  if (buffer != data)
+    throw Exception ("mismatch reading back full data region");
+
+  // random access to a region spanning a block boundary:
+  const size_t offset = 2*File::GZBlock::block_size() - 1000, size = 5000;
+  vector<uint8_t> region (size);
+  File::GZBlock::read (filename, lead_in_size + offset, region.data(), size);
+  if (!std::equal (region.begin(), region.end(), data.begin() + offset))
+    throw Exception ("mismatch reading back partial region");
+
+  // must remain readable as a regular gzip stream:
+  {
+    File::GZ zf (filename, "rb");
+    zf.seek (lead_in_size);
+    std::fill (buffer.begin(), buffer.end(), 0);
+    zf.read (reinterpret_cast<char*> (buffer.data()), data_size);
+  }
+  if (buffer != data)
+    throw Exception ("mismatch reading back as regular gzip stream");
+
+  // regular gzip files must not be mistaken for block-compressed files:
+  {
+    File::GZ zf (filename, "wb");
+    zf.write (reinterpret_cast<const char*> (data.data()), data_size);
+  }
+  if (File::GZBlock::read (filename, 0, buffer.data(), data_size))
+    throw Exception ("regular gzip file detected as block-compressed");
+
+  File::remove (filename);
+}
+
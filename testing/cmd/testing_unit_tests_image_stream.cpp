@@ -0,0 +1,159 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "algo/threaded_loop.h"
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test writing, reading and modifying images streamed through a small window";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// a value varying from voxel to voxel, exactly representable in all types tested:
+template <class ImageType>
+  float expected (const ImageType& image)
+  {
+    float value = 0.0f;
+    for (size_t n = 0; n < image.ndim(); ++n)
+      value = std::fmod (value * 7.0f + (image.index (n) % 7), 121.0f);
+    return value + 1.0f;
+  }
+
+
+
+template <class ImageType>
+  size_t count_mismatches (ImageType& in, float scale)
+  {
+    size_t mismatches = 0;
+    for (auto l = Loop (in) (in); l; ++l)
+      if (in.value() != scale * expected (in))
+        ++mismatches;
+    return mismatches;
+  }
+
+
+
+void test (const std::string& suffix, const vector<int>& size, const vector<ssize_t>& strides, DataType datatype)
+{
+  const std::string name = suffix + " image, size [ " + join (size, " ") + " ], strides [ " + join (strides, " ") + " ], "
+    + datatype.specifier();
+
+  Header H;
+  H.ndim() = size.size();
+  for (size_t n = 0; n < size.size(); ++n) {
+    H.size (n) = size[n];
+    H.stride (n) = strides[n];
+    H.spacing (n) = 1.0;
+  }
+  H.datatype() = datatype;
+  H.transform().setIdentity();
+
+  const std::string prefix = "testing_unit_tests_image_stream-" + str(getpid());
+  const std::string path = Path::join (File::tmpfile_dir(), prefix + suffix);
+  auto remove_files = [&] () {
+    Path::Dir dir (File::tmpfile_dir());
+    std::string entry;
+    while ((entry = dir.read_name()).size())
+      if (entry.substr (0, prefix.size()) == prefix)
+        File::remove (Path::join (File::tmpfile_dir(), entry));
+  };
+
+  try {
+    // write sequentially to a new image:
+    {
+      auto out = Image<float>::create (path, H);
+      for (auto l = Loop (out) (out); l; ++l)
+        out.value() = expected (out);
+    }
+
+    // read back sequentially:
+    {
+      auto in = Image<float>::open (path);
+      if (in.ndim() != H.ndim() || voxel_count (in) != voxel_count (H))
+        throw Exception ("dimensions differ on read");
+      const size_t mismatches = count_mismatches (in, 1.0f);
+      if (mismatches)
+        throw Exception (str(mismatches) + " voxels differ on sequential read");
+    }
+
+    // modify in place using several threads:
+    {
+      auto image = Image<float>::open (path, true);
+      ThreadedLoop (image).run ([] (decltype(image)& v) { v.value() = 2.0f * v.value(); }, image);
+    }
+    {
+      auto in = Image<float>::open (path);
+      const size_t mismatches = count_mismatches (in, 2.0f);
+      if (mismatches)
+        throw Exception (str(mismatches) + " voxels differ after in-place modification");
+    }
+
+    // read in reverse order along the outermost axis, so that slabs
+    // released ahead of time are accessed again:
+    {
+      auto in = Image<float>::open (path);
+      const size_t axis = in.ndim() - 1;
+      size_t mismatches = 0;
+      for (ssize_t i = in.size (axis) - 1; i >= 0; --i) {
+        in.index (axis) = i;
+        for (auto l = Loop (in, 0, axis) (in); l; ++l)
+          if (in.value() != 2.0f * expected (in))
+            ++mismatches;
+      }
+      if (mismatches)
+        throw Exception (str(mismatches) + " voxels differ on non-sequential read");
+    }
+  }
+  catch (Exception& E) {
+    remove_files();
+    throw Exception (E, "image stream test failed for " + name);
+  }
+  remove_files();
+}
+
+
+
+void run ()
+{
+  // streaming applies to images larger than 1MB; this must be set before any
+  // image is opened:
+  File::Config::set ("ImageIOStreamWindow", "1");
+
+  test (".mif", { 128, 128, 40 }, { 1, 2, 3 }, DataType::Float32);
+  test (".mif", { 177, 61, 57 }, { -1, 2, -3 }, DataType::Int16);
+  test (".mif", { 40, 30, 20, 9 }, { 2, 3, 4, 1 }, DataType::Float64);
+  test (".mif", { 80, 60, 20, 9 }, { 1, 2, 3, 4 }, DataType::UInt16BE);
+  // one file per volume, each streamed as a single slab:
+  test ("-[].nii", { 64, 64, 16, 12 }, { 1, 2, 3, 4 }, DataType::Float32);
+  // too small to be streamed:
+  test (".mif", { 32, 32, 32 }, { 1, 2, 3 }, DataType::Float32);
+}
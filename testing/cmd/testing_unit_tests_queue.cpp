@@ -0,0 +1,146 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "thread_queue.h"
+#include "timer.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test Thread::Queue backends with multiple writers and readers";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+using queue_t = Thread::Queue<size_t>;
+
+const size_t items_per_writer = 200000;
+const size_t num_writers = 16;
+const size_t num_readers = 4;
+
+
+
+class Writer { NOMEMALIGN
+  public:
+    Writer (queue_t& queue, size_t batch_size, std::atomic<size_t>& next_ID) :
+      writer (queue), batch_size (batch_size), next_ID (next_ID) { }
+    void execute () {
+      const size_t first = (next_ID++) * items_per_writer;
+      if (batch_size > 1) {
+        auto out = queue_t::Writer::Items (writer, batch_size);
+        size_t n = 0;
+        for (size_t value = first; value < first + items_per_writer; ++value) {
+          out[n++] = value;
+          if (n == out.size()) {
+            if (!out.write())
+              return;
+            n = 0;
+          }
+        }
+        if (n)
+          out.write (n);
+      }
+      else {
+        auto out = writer.placeholder();
+        for (size_t value = first; value < first + items_per_writer; ++value) {
+          *out = value;
+          if (!out.write())
+            return;
+        }
+      }
+    }
+  private:
+    queue_t::Writer writer;
+    const size_t batch_size;
+    std::atomic<size_t>& next_ID;
+};
+
+
+
+class Reader { NOMEMALIGN
+  public:
+    Reader (queue_t& queue, size_t batch_size, std::atomic<size_t>& count, std::atomic<size_t>& sum) :
+      reader (queue), batch_size (batch_size), count (count), sum (sum) { }
+    void execute () {
+      size_t local_count = 0, local_sum = 0;
+      if (batch_size > 1) {
+        auto in = queue_t::Reader::Items (reader, batch_size);
+        while (size_t n = in.read()) {
+          for (size_t i = 0; i < n; ++i)
+            local_sum += in[i];
+          local_count += n;
+        }
+      }
+      else {
+        auto in = reader.placeholder();
+        while (in.read()) {
+          local_sum += *in;
+          ++local_count;
+        }
+      }
+      count += local_count;
+      sum += local_sum;
+    }
+  private:
+    queue_t::Reader reader;
+    const size_t batch_size;
+    std::atomic<size_t>& count;
+    std::atomic<size_t>& sum;
+};
+
+
+
+
+void run ()
+{
+  const size_t total = num_writers * items_per_writer;
+  const size_t expected_sum = total * (total-1) / 2;
+  size_t failures = 0;
+
+  for (auto backend : { queue_t::MUTEX, queue_t::LOCK_FREE }) {
+    for (size_t batch_size : { 1, 64 }) {
+      const std::string name = std::string (backend == queue_t::MUTEX ? "mutex" : "lock-free")
+        + " backend, batch size " + str(batch_size);
+      std::atomic<size_t> count (0), sum (0), next_ID (0);
+      Timer timer;
+      {
+        queue_t queue ("test", MRTRIX_QUEUE_DEFAULT_CAPACITY, backend);
+        Writer writer (queue, batch_size, next_ID);
+        Reader reader (queue, batch_size, count, sum);
+        auto writers = Thread::run (Thread::multi (writer, num_writers), "writers");
+        auto readers = Thread::run (Thread::multi (reader, num_readers), "readers");
+        writers.wait();
+        readers.wait();
+      }
+      CONSOLE (name + ": " + str(timer.elapsed(), 4) + " seconds");
+      if (count != total || sum != expected_sum) {
+        WARN ("FAIL: " + name + ": received " + str(size_t(count)) + " items (expected " + str(total) + ")");
+        ++failures;
+      }
+    }
+  }
+
+  if (failures)
+    throw Exception (str(failures) + " queue configuration(s) failed");
+}
+
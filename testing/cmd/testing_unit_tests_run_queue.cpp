@@ -0,0 +1,161 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <thread>
+
+#include "command.h"
+#include "exception.h"
+#include "thread_queue.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test the coalescing of items into batches by Thread::run_queue()";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+using std::chrono::steady_clock;
+
+struct Item { NOMEMALIGN
+  size_t value;
+  steady_clock::time_point produced;
+};
+
+
+
+// produces num items, optionally pausing before each one:
+class Source { NOMEMALIGN
+  public:
+    Source (size_t num, std::chrono::milliseconds pause = std::chrono::milliseconds (0)) :
+      num (num), count (0), pause (pause) { }
+    bool operator() (Item& item) {
+      if (count >= num)
+        return false;
+      if (pause.count())
+        std::this_thread::sleep_for (pause);
+      item.value = count++;
+      item.produced = steady_clock::now();
+      return true;
+    }
+  private:
+    const size_t num;
+    size_t count;
+    const std::chrono::milliseconds pause;
+};
+
+// passes items through, optionally pausing on each one:
+class Pipe { NOMEMALIGN
+  public:
+    Pipe (std::chrono::milliseconds pause = std::chrono::milliseconds (0)) : pause (pause) { }
+    bool operator() (const Item& in, Item& out) {
+      if (pause.count())
+        std::this_thread::sleep_for (pause);
+      out.value = in.value;
+      out.produced = steady_clock::now();
+      return true;
+    }
+  private:
+    const std::chrono::milliseconds pause;
+};
+
+// records the items received, and how long each spent in the queue:
+class Sink { NOMEMALIGN
+  public:
+    Sink (vector<size_t>& values, vector<double>& latencies) :
+      values (values), latencies (latencies) { values.clear(); latencies.clear(); }
+    bool operator() (const Item& item) {
+      values.push_back (item.value);
+      latencies.push_back (std::chrono::duration<double, std::milli> (steady_clock::now() - item.produced).count());
+      return true;
+    }
+  private:
+    vector<size_t>& values;
+    vector<double>& latencies;
+};
+
+
+
+
+// all items must arrive exactly once, including those in the final
+// partially filled batch of each stage:
+void check_complete (const vector<size_t>& values, size_t num, bool ordered, const std::string& name)
+{
+  vector<size_t> sorted (values);
+  if (!ordered)
+    std::sort (sorted.begin(), sorted.end());
+  bool correct = sorted.size() == num;
+  for (size_t n = 0; correct && n < num; ++n)
+    correct = sorted[n] == n;
+  if (!correct)
+    throw Exception (name + ": received " + str(values.size()) + " items (expected " + str(num) + " distinct items" + (ordered ? " in order" : "") + ")");
+}
+
+
+
+// once a stage is known to produce items slowly, they must be sent on
+// without waiting for the batch to fill up:
+void check_latency (const vector<double>& latencies, double max_latency, const std::string& name)
+{
+  for (size_t n = 1; n < latencies.size(); ++n)
+    if (latencies[n] >= max_latency)
+      throw Exception (name + ": item " + str(n) + " held for " + str(latencies[n]) + " ms (expected less than " + str(max_latency) + " ms)");
+}
+
+
+
+
+void run ()
+{
+  using namespace Thread;
+  vector<size_t> values;
+  vector<double> latencies;
+
+  const size_t batch_size = queue_batch_size();
+  for (const size_t num : { size_t(0), size_t(1), batch_size-1, batch_size, batch_size+1, 3*batch_size+5, size_t(100000) }) {
+    run_queue (Source (num), Item(), Sink (values, latencies));
+    check_complete (values, num, true, "2-stage, " + str(num) + " items");
+
+    run_queue (Source (num), Item(), Pipe(), Item(), Sink (values, latencies));
+    check_complete (values, num, true, "3-stage, " + str(num) + " items");
+
+    run_queue (Source (num), Item(), multi (Pipe()), Item(), Sink (values, latencies));
+    check_complete (values, num, false, "3-stage multi-threaded, " + str(num) + " items");
+  }
+
+  // items produced well apart should not be held back until the end of the
+  // stream, which is where a batch of fewer than ThreadQueueBatchSize items
+  // would otherwise be sent:
+  const std::chrono::milliseconds pause (queue_batch_timeout() + std::chrono::milliseconds (40));
+  const double max_latency = queue_batch_timeout().count() + 25.0;
+  const size_t num_slow = std::min (batch_size, size_t(6));
+  if (num_slow > 2) {
+    run_queue (Source (num_slow, pause), Item(), Sink (values, latencies));
+    check_complete (values, num_slow, true, "slow source");
+    check_latency (latencies, max_latency, "slow source");
+
+    run_queue (Source (num_slow), Item(), Pipe (pause), Item(), Sink (values, latencies));
+    check_complete (values, num_slow, true, "slow pipe");
+    check_latency (latencies, max_latency, "slow pipe");
+  }
+}
+
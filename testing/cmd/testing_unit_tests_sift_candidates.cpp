@@ -0,0 +1,94 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "timer.h"
+#include "math/rng.h"
+#include "dwi/tractography/SIFT/gradient_sort.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::SIFT;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test selection of SIFT filtering candidates from the gradient vector";
+  DESCRIPTION
+  + "Candidates are selected from a simulated gradient vector, and compared against "
+    "a full sort of that vector; the time taken by each is reported at the -info level.";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// simulated gradient vector: Gaussian values, optionally quantised so that
+// many streamlines share the same gradient:
+vector<Cost_fn_gradient_sort> simulate (size_t num_tracks, bool ties)
+{
+  Math::RNG::Normal<float> rng;
+  vector<Cost_fn_gradient_sort> gradient_vector (num_tracks, Cost_fn_gradient_sort (num_tracks, 0.0, 0.0));
+  for (track_t index = 0; index != num_tracks; ++index) {
+    float value = rng();
+    if (ties)
+      value = std::round (value * 4.0f) / 4.0f;
+    gradient_vector[index].set (index, value, value);
+  }
+  return gradient_vector;
+}
+
+
+
+void run ()
+{
+  for (const size_t num_tracks : { size_t(0), size_t(1), size_t(5), size_t(1000), size_t(100000) }) {
+    for (const bool ties : { false, true }) {
+      const std::string name = str(num_tracks) + " streamlines" + (ties ? " with tied gradients" : "");
+      const auto gradient_vector = simulate (num_tracks, ties);
+
+      // expected order: all negative gradients, most negative first, with
+      // ties broken by streamline index:
+      Timer sort_timer;
+      vector<Cost_fn_gradient_sort> expected;
+      for (const auto& i : gradient_vector)
+        if (i.get_gradient_per_unit_length() < 0.0)
+          expected.push_back (i);
+      std::sort (expected.begin(), expected.end(), [] (const Cost_fn_gradient_sort& a, const Cost_fn_gradient_sort& b) {
+          return a.get_gradient_per_unit_length() == b.get_gradient_per_unit_length() ?
+              a.get_tck_index() < b.get_tck_index() :
+              a.get_gradient_per_unit_length() < b.get_gradient_per_unit_length(); });
+      INFO ("full sort of " + name + ": " + str(sort_timer.elapsed() * 1000.0) + " ms");
+
+      auto temp_gv (gradient_vector);
+      Timer timer;
+      MT_gradient_vector_heap heap (temp_gv);
+      vector<track_t> order;
+      for (auto candidate = heap.get(); candidate != temp_gv.end(); candidate = heap.get())
+        order.push_back (candidate->get_tck_index());
+      INFO ("selection of all candidates from " + name + ": " + str(timer.elapsed() * 1000.0) + " ms");
+
+      bool same = order.size() == expected.size();
+      for (size_t n = 0; same && n < order.size(); ++n)
+        same = order[n] == expected[n].get_tck_index();
+      if (!same)
+        throw Exception (name + ": " + str(order.size()) + " candidates selected (expected " + str(expected.size())
+          + "), or not in order of gradient");
+    }
+  }
+}
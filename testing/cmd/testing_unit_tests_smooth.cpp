@@ -0,0 +1,160 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "header.h"
+#include "image.h"
+#include "stride.h"
+#include "timer.h"
+#include "algo/loop.h"
+#include "filter/smooth.h"
+#include "math/rng.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test that recursive Gaussian smoothing matches convolution with an explicit kernel";
+  DESCRIPTION
+  + "The reference is convolution with a kernel truncated at 6 standard deviations. "
+    "The time taken by the recursive filter and by the default truncated kernel "
+    "is reported at the -info level.";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// a smooth blob plus uniform noise, on an anisotropic grid, with a few
+// non-finite voxels if requested:
+Image<float> make_image (const vector<ssize_t>& strides, bool with_nan)
+{
+  Header header;
+  header.ndim() = 3;
+  const ssize_t sizes[] = { 48, 40, 36 };
+  const default_type spacings[] = { 1.0, 1.5, 2.0 };
+  for (size_t n = 0; n < 3; ++n) {
+    header.size(n) = sizes[n];
+    header.spacing(n) = spacings[n];
+  }
+  header.transform().setIdentity();
+  header.datatype() = DataType::Float32;
+  Stride::set (header, strides);
+
+  auto image = Image<float>::scratch (header, "smoothing test image");
+  Math::RNG::Uniform<float> uniform;
+  for (auto l = Loop (image) (image); l; ++l) {
+    default_type r2 = 0.0;
+    for (size_t n = 0; n < 3; ++n)
+      r2 += Math::pow2 ((image.index(n) - 0.4 * image.size(n)) * image.spacing(n));
+    image.value() = std::exp (-r2 / 200.0) + uniform() - 0.5f;
+    if (with_nan && uniform() < 0.002)
+      image.value() = NaN;
+  }
+  return image;
+}
+
+
+
+Image<float> smooth (Image<float>& input, default_type stdev, bool recursive, bool in_place, bool zero_boundary, size_t extent_in_stdevs = 0)
+{
+  Filter::Smooth filter (input);
+  filter.set_stdev (stdev);
+  filter.set_recursive (recursive);
+  filter.set_zero_boundary (zero_boundary);
+  if (extent_in_stdevs) {
+    vector<uint32_t> extent (3);
+    for (size_t n = 0; n < 3; ++n)
+      extent[n] = 2 * std::ceil (extent_in_stdevs * stdev / input.spacing(n)) + 1;
+    filter.set_extent (extent);
+  }
+  auto output = Image<float>::scratch (input, "smoothed test image");
+  if (in_place) {
+    threaded_copy (input, output);
+    filter (output);
+  }
+  else
+    filter (input, output);
+  return output;
+}
+
+
+
+// maximum absolute difference between finite values, relative to the
+// largest reference value; a voxel finite in one image only counts as
+// infinitely different:
+default_type max_error (Image<float>& result, Image<float>& reference)
+{
+  default_type error = 0.0, peak = 0.0;
+  for (auto l = Loop (result) (result, reference); l; ++l) {
+    if (std::isfinite (float (result.value())) != std::isfinite (float (reference.value())))
+      return std::numeric_limits<default_type>::infinity();
+    if (std::isfinite (float (reference.value()))) {
+      error = std::max (error, default_type (std::abs (result.value() - reference.value())));
+      peak = std::max (peak, default_type (std::abs (reference.value())));
+    }
+  }
+  return error / peak;
+}
+
+
+
+void run ()
+{
+  for (const auto& strides : { vector<ssize_t> ({ 1, 2, 3 }), vector<ssize_t> ({ -2, 3, 1 }) }) {
+    for (const bool with_nan : { false, true }) {
+      auto input = make_image (strides, with_nan);
+
+      for (const default_type stdev : { 2.0, 4.0, 8.0, 16.0 }) {
+        const std::string name = "stdev " + str(stdev) + " mm, strides " + str(strides) + (with_nan ? ", with non-finite values" : "");
+
+        Timer timer;
+        auto recursive = smooth (input, stdev, true, false, false);
+        const default_type recursive_time = timer.elapsed();
+        timer.start();
+        auto truncated = smooth (input, stdev, false, false, false);
+        const default_type truncated_time = timer.elapsed();
+        auto reference = smooth (input, stdev, false, false, false, 6);
+
+        const default_type recursive_error = max_error (recursive, reference);
+        INFO (name + ": recursive " + str(recursive_time) + " s, error " + str(100.0 * recursive_error)
+            + "%; truncated " + str(truncated_time) + " s, error " + str(100.0 * max_error (truncated, reference)) + "%");
+        if (!(recursive_error < 0.02))
+          throw Exception (name + ": recursive smoothing differs from reference by " + str(100.0 * recursive_error) + "%");
+
+        auto in_place = smooth (input, stdev, true, true, false);
+        if (!(max_error (in_place, recursive) < 1.0e-5))
+          throw Exception (name + ": recursive smoothing differs when performed in place");
+
+        auto zero_boundary = smooth (input, stdev, true, true, true);
+        size_t num_nonzero = 0;
+        for (auto l = Loop (zero_boundary) (zero_boundary); l; ++l) {
+          bool on_boundary = false;
+          for (size_t n = 0; n < 3; ++n)
+            on_boundary |= zero_boundary.index(n) == 0 || zero_boundary.index(n) == zero_boundary.size(n) - 1;
+          if (on_boundary && zero_boundary.value() != 0.0f)
+            ++num_nonzero;
+        }
+        if (num_nonzero)
+          throw Exception (name + ": " + str(num_nonzero) + " non-zero boundary voxels with zero boundary set");
+      }
+    }
+  }
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "header.h"
+#include "thread.h"
+#include "timer.h"
+#include "algo/threaded_loop.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test and benchmark ThreadedLoop() scheduling on masked data";
+  DESCRIPTION
+  + "This runs a synthetic workload over an image whose mask only covers "
+    "the central part of the field of view, as is typical of brain data, "
+    "using both the shared and the work-stealing schedulers. For each, the "
+    "wall time, the load imbalance (maximum over mean per-thread busy time) "
+    "and the fraction of thread time spent idle are reported. Run with "
+    "different values of -nthreads to assess scaling with core count.";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+struct Stats { NOMEMALIGN
+  std::mutex mutex;
+  vector<double> busy;
+};
+
+
+// processes one row along the x axis, with a cost proportional to the
+// number of voxels within a central ellipsoid:
+class MaskedWork { NOMEMALIGN
+  public:
+    MaskedWork (const Header& H, vector<uint8_t>& visits, Stats& stats) :
+      H (H), visits (visits), stats (stats), busy (0.0), count (0), sink (0.0) { }
+
+    ~MaskedWork () {
+      if (count) {
+        std::lock_guard<std::mutex> lock (stats.mutex);
+        stats.busy.push_back (busy);
+      }
+    }
+
+    void operator() (const Iterator& pos) {
+      Timer timer;
+      const ssize_t y = pos.index(1), z = pos.index(2);
+      ++visits[y + H.size(1)*z];
+      const double ry = 2.0 * (y + 0.5) / H.size(1) - 1.0;
+      const double rz = 4.0 * (z + 0.5) / H.size(2) - 2.0;
+      for (ssize_t x = 0; x < H.size(0); ++x) {
+        const double rx = 2.0 * (x + 0.5) / H.size(0) - 1.0;
+        if (rx*rx + ry*ry + rz*rz > 1.0)
+          continue;
+        double v = rx;
+        for (size_t n = 0; n < 200; ++n)
+          v = std::sin (v + ry*rz);
+        sink += v;
+      }
+      busy += timer.elapsed();
+      ++count;
+    }
+
+  private:
+    const Header& H;
+    vector<uint8_t>& visits;
+    Stats& stats;
+    double busy;
+    size_t count;
+    double sink;
+};
+
+
+
+
+void run ()
+{
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = H.size(1) = 96;
+  H.size(2) = 64;
+
+  const size_t nthreads = std::max<size_t> (1, Thread::number_of_threads());
+  CONSOLE ("running with " + str(nthreads) + " threads");
+
+  size_t failures = 0;
+  for (auto schedule : { ThreadedLoopSchedule::SHARED, ThreadedLoopSchedule::WORK_STEALING }) {
+    const std::string name = schedule == ThreadedLoopSchedule::SHARED ? "shared" : "work-stealing";
+    vector<uint8_t> visits (H.size(1)*H.size(2), 0);
+    Stats stats;
+
+    Timer timer;
+    {
+      MaskedWork work (H, visits, stats);
+      ThreadedLoop (H, vector<size_t> ({ 1, 2 }), vector<size_t> ({ 0 }))
+        .schedule (schedule)
+        .run_outer (work);
+    }
+    const double elapsed = timer.elapsed();
+
+    for (auto v : visits) {
+      if (v != 1) {
+        WARN ("FAIL: " + name + " scheduler did not visit every position exactly once");
+        ++failures;
+        break;
+      }
+    }
+
+    double sum = 0.0, max = 0.0;
+    for (auto b : stats.busy) {
+      sum += b;
+      max = std::max (max, b);
+    }
+    const double mean = sum / nthreads;
+    CONSOLE (name + ": " + str(elapsed, 4) + " seconds; load imbalance " + str(mean > 0.0 ? max / mean : 1.0, 4)
+        + "; idle fraction " + str(std::max (0.0, 1.0 - sum / (nthreads * elapsed)), 4));
+  }
+
+  if (failures)
+    throw Exception (str(failures) + " scheduler(s) failed");
+}
+
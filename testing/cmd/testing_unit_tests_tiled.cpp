@@ -0,0 +1,147 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "math/rng.h"
+
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test round-trip of and partial access to tiled MRtrix images (.mift)";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// a value varying from voxel to voxel, exactly representable in all types tested:
+template <class ImageType>
+  float expected (const ImageType& image)
+  {
+    float value = 0.0f;
+    for (size_t n = 0; n < image.ndim(); ++n)
+      value = std::fmod (value * 7.0f + (image.index (n) % 7), 251.0f);
+    return value + 1.0f;
+  }
+
+
+
+void test (const vector<int>& size, const vector<ssize_t>& strides, DataType datatype, bool compressed)
+{
+  const std::string name = "size [ " + join (size, " ") + " ], strides [ " + join (strides, " ") + " ], "
+    + datatype.specifier() + (compressed ? ", compressed" : ", uncompressed");
+  File::Config::set ("TiledImageCompression", compressed ? "true" : "false");
+
+  Header H;
+  H.ndim() = size.size();
+  for (size_t n = 0; n < size.size(); ++n) {
+    H.size (n) = size[n];
+    H.stride (n) = strides[n];
+  }
+  H.datatype() = datatype;
+  H.transform().setIdentity();
+
+  // temporary file names are reserved for piped images, which must be .mif:
+  const std::string path = Path::join (File::tmpfile_dir(), "testing_unit_tests_tiled-" + str(getpid()) + ".mift");
+  try {
+    {
+      auto out = Image<float>::create (path, H);
+      for (auto l = Loop (out) (out); l; ++l)
+        out.value() = expected (out);
+    }
+
+    // read back in full:
+    size_t mismatches = 0;
+    {
+      auto in = Image<float>::open (path);
+      if (in.ndim() != H.ndim() || voxel_count (in) != voxel_count (H))
+        throw Exception ("dimensions differ on read");
+      for (auto l = Loop (in) (in); l; ++l)
+        if (in.value() != expected (in))
+          ++mismatches;
+    }
+    if (mismatches)
+      throw Exception (str(mismatches) + " voxels differ on full read");
+
+    // partial access, touching only a few voxels of a freshly opened image:
+    Math::RNG::Integer<int> rng (size.size());
+    for (size_t trial = 0; trial < 20; ++trial) {
+      auto in = Image<float>::open (path);
+      for (size_t n = 0; n < in.ndim(); ++n)
+        in.index (n) = rng() % in.size (n);
+      if (in.value() != expected (in))
+        throw Exception ("voxel differs on partial read");
+    }
+
+    // modify a single voxel in place, leaving the rest of the image undecoded:
+    vector<int> modified (size.size());
+    for (size_t n = 0; n < size.size(); ++n)
+      modified[n] = size[n] / 2;
+    {
+      auto image = Image<float>::open (path, true);
+      for (size_t n = 0; n < image.ndim(); ++n)
+        image.index (n) = modified[n];
+      image.value() = 0.0f;
+    }
+    mismatches = 0;
+    {
+      auto in = Image<float>::open (path);
+      for (auto l = Loop (in) (in); l; ++l) {
+        bool is_modified = true;
+        for (size_t n = 0; n < in.ndim(); ++n)
+          is_modified = is_modified && in.index (n) == modified[n];
+        if (in.value() != (is_modified ? 0.0f : expected (in)))
+          ++mismatches;
+      }
+    }
+    if (mismatches)
+      throw Exception (str(mismatches) + " voxels differ after in-place modification");
+  }
+  catch (Exception& E) {
+    File::remove (path);
+    throw Exception (E, "tiled image test failed for " + name);
+  }
+  File::remove (path);
+}
+
+
+
+void run ()
+{
+  File::Config::set ("TiledImageChunkSize", "8,8,8");
+
+  for (const bool compressed : { true, false }) {
+    test ({ 37, 23, 19 }, { 1, 2, 3 }, DataType::Float32, compressed);
+    test ({ 37, 23, 19 }, { -1, 2, -3 }, DataType::Int16, compressed);
+    test ({ 37, 23, 19 }, { 3, 2, 1 }, DataType::UInt16BE, compressed);
+    test ({ 20, 17, 9, 5 }, { 2, 3, 4, 1 }, DataType::Float64, compressed);
+    test ({ 20, 17, 9, 5 }, { -2, -3, -4, 1 }, DataType::UInt8, compressed);
+    test ({ 16, 16, 16 }, { 1, 2, 3 }, DataType::Float32, compressed);
+    test ({ 45, 1, 1 }, { -1, 2, 3 }, DataType::Float32, compressed);
+  }
+}
+
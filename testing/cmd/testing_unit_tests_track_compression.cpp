@@ -0,0 +1,178 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "exception.h"
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "math/rng.h"
+#include "dwi/tractography/file.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test conversion of track files to and from the compressed (.tckz) format";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// random walks with 0.5 mm steps, of random length, with empty streamlines
+// interspersed; enough vertices for the compressed data to span many blocks:
+vector<Streamline<>> generate (size_t num)
+{
+  Math::RNG::Integer<size_t> length (400);
+  Math::RNG::Uniform<float> uniform;
+  Math::RNG::Normal<float> normal;
+  vector<Streamline<>> tracks (num);
+  for (size_t n = 0; n < num; ++n) {
+    if (n % 11 == 0)
+      continue;
+    Streamline<>::point_type p (200.0*uniform()-100.0, 200.0*uniform()-100.0, 200.0*uniform()-100.0);
+    Streamline<>::point_type dir (0.0, 0.0, 1.0);
+    tracks[n].resize (length() + 2);
+    for (auto& vertex : tracks[n]) {
+      vertex = p;
+      dir = (dir + 0.2 * Streamline<>::point_type (normal(), normal(), normal())).normalized();
+      p += 0.5 * dir;
+    }
+  }
+  return tracks;
+}
+
+
+
+int64_t file_size (const std::string& path)
+{
+  struct stat buf;
+  if (::stat (path.c_str(), &buf))
+    throw Exception ("cannot stat file \"" + path + "\": " + strerror (errno));
+  return buf.st_size;
+}
+
+
+
+void write (const std::string& path, const vector<Streamline<>>& tracks, const Properties& properties)
+{
+  Writer<> writer (path, properties);
+  for (const auto& tck : tracks)
+    writer (tck);
+}
+
+
+
+vector<Streamline<>> read (const std::string& path, Properties& properties)
+{
+  Reader<> reader (path, properties);
+  vector<Streamline<>> tracks;
+  Streamline<> tck;
+  while (reader (tck))
+    tracks.push_back (tck);
+  return tracks;
+}
+
+
+
+// largest distance between corresponding vertices, or infinity if the
+// number or lengths of the streamlines differ:
+float max_error (const vector<Streamline<>>& a, const vector<Streamline<>>& b)
+{
+  if (a.size() != b.size())
+    return std::numeric_limits<float>::infinity();
+  float error = 0.0;
+  for (size_t n = 0; n < a.size(); ++n) {
+    if (a[n].size() != b[n].size())
+      return std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < a[n].size(); ++i)
+      error = std::max (error, (a[n][i] - b[n][i]).cwiseAbs().maxCoeff());
+  }
+  return error;
+}
+
+
+
+void run ()
+{
+  const std::string base = Path::join (File::tmpfile_dir(), "testing_unit_tests_track_compression-" + str(getpid()));
+  const vector<std::string> paths = { base + "-in.tck", base + ".tckz", base + "-out.tck" };
+  auto remove_files = [&] () {
+    for (const auto& path : paths)
+      if (Path::exists (path))
+        File::remove (path);
+  };
+  App::overwrite_files = true;
+  File::Config::set ("TrackWriterIndex", "false");
+  const float precision = 0.01;
+  File::Config::set ("TrackWriterPrecision", str(precision));
+
+  try {
+    if (!Path::is_track_file (paths[0]) || !Path::is_track_file (paths[1]) || Path::is_track_file (base + ".txt"))
+      throw Exception ("track file suffixes not recognised");
+
+    const auto original = generate (2000);
+    Properties properties;
+    properties["step_size"] = "0.5";
+    write (paths[0], original, properties);
+
+    // .tck -> .tckz:
+    Properties tck_properties;
+    const auto tck_tracks = read (paths[0], tck_properties);
+    if (max_error (tck_tracks, original) != 0.0)
+      throw Exception (".tck round-trip not exact");
+    write (paths[1], tck_tracks, tck_properties);
+    if (!Path::exists (paths[1]) || file_size (paths[1]) >= file_size (paths[0]))
+      throw Exception ("compressed file is not smaller");
+
+    // .tckz -> .tck:
+    Properties tckz_properties;
+    const auto tckz_tracks = read (paths[1], tckz_properties);
+    const float error = max_error (tckz_tracks, original);
+    // allow for single-precision rounding at coordinates of up to ~100 mm:
+    if (!(error <= 0.5 * precision + 1.0e-5))
+      throw Exception ("compressed vertices differ by " + str(error) + " mm, beyond half the quantisation step");
+    if (tckz_properties["step_size"] != "0.5")
+      throw Exception ("properties not preserved in compressed file");
+    if (tckz_properties["count"] != str(original.size()))
+      throw Exception ("incorrect count in compressed file: " + tckz_properties["count"]);
+    write (paths[2], tckz_tracks, tckz_properties);
+
+    // the final .tck file must hold exactly what was decoded from the .tckz:
+    Properties out_properties;
+    const auto out_tracks = read (paths[2], out_properties);
+    if (max_error (out_tracks, tckz_tracks) != 0.0)
+      throw Exception ("streamlines differ after conversion back to .tck");
+    if (out_properties["count"] != str(original.size()))
+      throw Exception ("incorrect count after conversion back to .tck");
+
+    size_t num_empty = 0;
+    for (const auto& tck : out_tracks)
+      num_empty += tck.empty();
+    if (num_empty != (original.size() + 10) / 11)
+      throw Exception ("empty streamlines not preserved: " + str(num_empty));
+  }
+  catch (Exception&) {
+    remove_files();
+    throw;
+  }
+  remove_files();
+}
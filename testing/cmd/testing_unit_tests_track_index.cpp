@@ -0,0 +1,228 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <fstream>
+#include <thread>
+
+#include "command.h"
+#include "exception.h"
+#include "raw.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "math/rng.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/file_index.h"
+#include "dwi/tractography/editing/loader.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test seeking through track files using the streamline index";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const size_t num_tracks = 500;
+
+
+
+// write tracks of random length, with runs of empty streamlines
+// interspersed, including at the very start of the file:
+void write_tracks (const std::string& path)
+{
+  Math::RNG::Integer<size_t> length (20);
+  Math::RNG::Normal<float> position;
+  Properties properties;
+  Writer<> writer (path, properties);
+  for (size_t n = 0; n < num_tracks; ++n) {
+    Streamline<> tck;
+    if (n > 2 && n % 7) {
+      tck.resize (length() + 1);
+      for (auto& p : tck)
+        p = { position(), position(), position() };
+    }
+    writer (tck);
+  }
+}
+
+
+
+// read the first num streamlines remaining in loader
+vector<Streamline<>> read (Editing::Loader& loader, size_t num)
+{
+  vector<Streamline<>> tracks;
+  Streamline<> tck;
+  while (tracks.size() < num && loader (tck))
+    tracks.push_back (tck);
+  return tracks;
+}
+
+
+
+bool same (const vector<Streamline<>>& a, const vector<Streamline<>>& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t n = 0; n < a.size(); ++n) {
+    if (a[n].size() != b[n].size() || a[n].get_index() != b[n].get_index())
+      return false;
+    for (size_t i = 0; i < a[n].size(); ++i)
+      if (a[n][i] != b[n][i])
+        return false;
+  }
+  return true;
+}
+
+
+
+void run ()
+{
+  const std::string path = Path::join (File::tmpfile_dir(), "testing_unit_tests_track_index-" + str(getpid()) + ".tck");
+  const vector<std::string> files (1, path);
+  App::overwrite_files = true;
+  auto remove_files = [&] () {
+    for (const auto& file : { path, FileIndex::sidecar (path) })
+      if (Path::exists (file))
+        File::remove (file);
+  };
+
+  try {
+    // without a sidecar index, seeking must not be offered:
+    File::Config::set ("TrackWriterIndex", "false");
+    write_tracks (path);
+    {
+      Editing::Loader loader (files);
+      if (loader.can_seek())
+        throw Exception ("seeking available without an index");
+    }
+
+    File::Config::set ("TrackWriterIndex", "true");
+    write_tracks (path);
+
+    for (const std::string memory_map : { "true", "false" }) {
+      File::Config::set ("TrackReaderMemoryMap", memory_map);
+      for (const size_t skip : { size_t(0), size_t(1), size_t(2), size_t(5), size_t(37), size_t(200), size_t(num_tracks) }) {
+        const std::string name = "skip " + str(skip) + (memory_map == "true" ? ", memory-mapped" : ", streamed");
+
+        // sequential: skip the first non-empty streamlines as tckedit's
+        // receiver would, counting empty ones separately:
+        Editing::Loader sequential (files);
+        size_t remaining = skip, num_read = 0, num_empty = 0;
+        Streamline<> tck;
+        vector<Streamline<>> expected;
+        bool exhausted = true;
+        while (sequential (tck)) {
+          if (remaining && tck.size()) {
+            --remaining;
+            ++num_read;
+            continue;
+          }
+          if (remaining) {
+            ++num_read;
+            ++num_empty;
+            continue;
+          }
+          expected.push_back (tck);
+          exhausted = false;
+          break;
+        }
+        // the loader must not be called again once it has returned false:
+        if (!exhausted) {
+          const auto more = read (sequential, 24);
+          expected.insert (expected.end(), more.begin(), more.end());
+        }
+
+        Editing::Loader seeking (files);
+        if (!seeking.can_seek())
+          throw Exception (name + ": valid index not detected");
+        size_t seek_empty;
+        const size_t seek_read = seeking.seek (skip, seek_empty);
+        if (seek_read != num_read || seek_empty != num_empty)
+          throw Exception (name + ": skipped " + str(seek_read) + " streamlines ("
+            + str(seek_empty) + " empty), expected " + str(num_read) + " (" + str(num_empty) + " empty)");
+        if (!same (read (seeking, expected.size()), expected))
+          throw Exception (name + ": streamlines differ after seeking");
+      }
+    }
+
+    // a corrupt index must be rejected rather than trusted; each field is
+    // overwritten in turn in a copy of the valid index:
+    const std::string index_path = FileIndex::sidecar (path);
+    std::string valid_index;
+    {
+      std::ifstream in (index_path, std::ios::in | std::ios::binary);
+      valid_index.assign (std::istreambuf_iterator<char> (in), std::istreambuf_iterator<char>());
+    }
+    const size_t count_pos = 32, offsets_pos = 40;
+    const uint64_t first_offset = Raw::fetch_LE<uint64_t> (&valid_index[offsets_pos]);
+    const vector<std::pair<std::string,std::pair<size_t,uint64_t>>> corruptions = {
+      { "streamline count too large", { count_pos, std::numeric_limits<uint64_t>::max() } },
+      { "streamline count too small", { count_pos, num_tracks - 1 } },
+      { "offsets not increasing", { offsets_pos + 8, first_offset } },
+      { "offset before track data", { offsets_pos, 0 } },
+      { "offset beyond end of file", { offsets_pos + 8 * num_tracks, std::numeric_limits<int64_t>::max() } }
+    };
+    for (const auto& corruption : corruptions) {
+      std::string index (valid_index);
+      Raw::store_LE<uint64_t> (corruption.second.second, &index[corruption.second.first]);
+      {
+        File::OFStream out (index_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write (index.data(), index.size());
+      }
+      Editing::Loader loader (files);
+      if (loader.can_seek())
+        throw Exception ("corrupt index accepted: " + corruption.first);
+    }
+    {
+      File::OFStream out (index_path, std::ios::out | std::ios::binary | std::ios::trunc);
+      out.write (valid_index.data(), valid_index.size());
+    }
+    {
+      Editing::Loader loader (files);
+      if (!loader.can_seek())
+        throw Exception ("valid index rejected after restoring it");
+    }
+
+    // the index must be rejected once the track file has been modified,
+    // even if its size is unchanged:
+    std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    {
+      File::OFStream out (path, std::ios::in | std::ios::out | std::ios::binary);
+      out.seekp (-1, std::ios::end);
+      out.put (0);
+    }
+    {
+      Editing::Loader loader (files);
+      if (loader.can_seek())
+        throw Exception ("stale index accepted after track file was modified");
+    }
+  }
+  catch (Exception&) {
+    remove_files();
+    throw;
+  }
+  remove_files();
+}
+
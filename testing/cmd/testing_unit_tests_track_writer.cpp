@@ -0,0 +1,168 @@
+/* Copyright (c) 2008-2021 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <fstream>
+
+#include "command.h"
+#include "exception.h"
+#include "file/config.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "math/rng.h"
+#include "dwi/tractography/file.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+
+void usage ()
+{
+  AUTHOR = "agent (agent@local)";
+  SYNOPSIS = "test writing track files with concurrent writer threads";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+vector<Streamline<>> generate (size_t num)
+{
+  Math::RNG::Integer<size_t> length (60);
+  Math::RNG::Normal<float> position;
+  vector<Streamline<>> tracks (num);
+  for (size_t n = 0; n < num; ++n) {
+    if (n % 13 == 0)
+      continue;
+    tracks[n].resize (length() + 1);
+    for (auto& p : tracks[n])
+      p = { 10.0f*position(), 10.0f*position(), 10.0f*position() };
+    tracks[n].weight = n;
+  }
+  return tracks;
+}
+
+
+
+vector<Streamline<>> read (const std::string& path, Properties& properties)
+{
+  Reader<> reader (path, properties);
+  vector<Streamline<>> tracks;
+  Streamline<> tck;
+  while (reader (tck))
+    tracks.push_back (tck);
+  return tracks;
+}
+
+
+
+// largest distance between corresponding vertices in the first a.size()
+// streamlines, or infinity if a is not a prefix of b:
+float max_error (const vector<Streamline<>>& a, const vector<Streamline<>>& b)
+{
+  if (a.size() > b.size())
+    return std::numeric_limits<float>::infinity();
+  float error = 0.0;
+  for (size_t n = 0; n < a.size(); ++n) {
+    if (a[n].size() != b[n].size())
+      return std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < a[n].size(); ++i)
+      error = std::max (error, (a[n][i] - b[n][i]).cwiseAbs().maxCoeff());
+  }
+  return error;
+}
+
+
+
+void run ()
+{
+  const std::string base = Path::join (File::tmpfile_dir(), "testing_unit_tests_track_writer-" + str(getpid()));
+  const std::string weights_path = base + ".txt";
+  App::overwrite_files = true;
+  // small buffers, so that many regions are in flight at once:
+  File::Config::set ("TrackWriterBufferSize", "4096");
+  File::Config::set ("TrackWriterIndex", "true");
+
+  const auto original = generate (3000);
+  auto remove_files = [&] () {
+    for (const auto& path : { base + ".tck", base + ".tckz", weights_path, FileIndex::sidecar (base + ".tck") })
+      if (Path::exists (path))
+        File::remove (path);
+  };
+
+  try {
+    for (const std::string suffix : { ".tck", ".tckz" }) {
+      const std::string path = base + suffix;
+      const float tolerance = suffix == std::string (".tckz") ? 0.01 : 0.0;
+
+      for (const std::string threads : { "0", "1", "4" }) {
+        const std::string name = suffix + std::string (" with ") + threads + " writer threads";
+        File::Config::set ("TrackWriterThreads", threads);
+        {
+          Properties properties;
+          Writer<> writer (path, properties);
+          writer.set_weights_path (weights_path);
+          for (size_t n = 0; n < original.size(); ++n) {
+            writer (original[n]);
+            // whatever has been linked into the file so far must be
+            // readable, and free of gaps; the file is streamed rather than
+            // memory-mapped, since a mapping cannot follow the file as it
+            // grows. The count in the header may legitimately lag behind
+            // the data while a region is being linked, so is not checked.
+            if (n == original.size() / 2 && suffix == std::string (".tck")) {
+              File::Config::set ("TrackReaderMemoryMap", "false");
+              Properties partial_properties;
+              const auto partial = read (path, partial_properties);
+              if (!(max_error (partial, original) <= tolerance))
+                throw Exception (name + ": incorrect data in partially written file");
+              File::Config::set ("TrackReaderMemoryMap", "true");
+            }
+          }
+        }
+
+        Properties properties;
+        const auto tracks = read (path, properties);
+        if (tracks.size() != original.size())
+          throw Exception (name + ": read " + str(tracks.size()) + " streamlines, expected " + str(original.size()));
+        if (!(max_error (tracks, original) <= tolerance))
+          throw Exception (name + ": streamlines differ");
+        if (properties["count"] != str(original.size()) || properties["total_count"] != str(original.size()))
+          throw Exception (name + ": incorrect counts in header");
+
+        std::ifstream weights (weights_path);
+        size_t num_weights = 0;
+        float weight;
+        bool weights_match = true;
+        while (weights >> weight)
+          weights_match = weights_match && num_weights < original.size() && weight == original[num_weights++].weight;
+        if (!weights_match || num_weights != original.size())
+          throw Exception (name + ": streamline weights not written in order");
+
+        if (suffix == std::string (".tck")) {
+          Properties index_properties;
+          Reader<> reader (path, index_properties);
+          if (!reader.has_index())
+            throw Exception (name + ": no valid streamline index");
+        }
+      }
+    }
+  }
+  catch (Exception&) {
+    remove_files();
+    throw;
+  }
+  remove_files();
+}